@@ -0,0 +1,1708 @@
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <BinaryData.h>
+#include "DspEngine.h"
+#include "InputSource.h"
+#include "LatencyHistogram.h"
+#include "Oversampler.h"
+#include "PerfCounters.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace
+{
+    // How the bench automates the module's parameters while it renders
+    enum class Automation
+    {
+        None,           // Parameters stay at their defaults
+        PerBlock,       // One value per parameter per block
+        SampleAccurate  // A change every automationInterval samples
+    };
+
+    struct Options
+    {
+        std::string inputPath;   // Empty = embedded RawGTR.wav; gen:<signal>; a list of files and directories with --render
+        double inputSeconds = 10.0;  // Length of a gen: input
+        std::string outputPath;  // Empty = stdout
+        std::string format = "json";
+        std::vector<EngineType> engines { EngineType::WAMR, EngineType::WAMRChecked, EngineType::Wasm2c,
+                                          EngineType::Wasm2cGuardPages, EngineType::Wasm2cBoundsChecked,
+                                          EngineType::Wasm2cUnchecked, EngineType::Wasm2cStatic, EngineType::Wasmi,
+                                          EngineType::WAMRClassicInterp, EngineType::WAMRFastInterp,
+                                          EngineType::WAMRFastJit, EngineType::WAMRLlvmJit,
+                                          EngineType::WAMRMultiTierJit };
+        std::vector<ModuleVariant> variants { ModuleVariant::Scalar, ModuleVariant::Simd };
+        std::vector<DspKernel> kernels { DspKernel::Gain };
+        std::vector<ProcessMode> modes { ProcessMode::Block, ProcessMode::PerSample };
+        std::vector<int> blockSizes { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+        std::vector<int> oversampling { 1 };  // Factors the engine runs at between resampling passes
+        std::vector<int> channelCounts { 1, 2 };
+        std::vector<double> sampleRates { 44100.0, 48000.0, 96000.0 };
+        double minSeconds = 0.25;  // Minimum wall time per measurement
+        int instances = 0;         // > 0 also measures this many extra instances per engine
+        int resets = 0;            // > 0 also times this many resets per engine each way
+        std::string aotCacheDir;   // Non-empty also measures runtime AOT compilation, cached here
+        std::vector<std::string> aotVariants;  // AOT matrix builds the AOT engines run; empty = builtin
+        std::string aotDir = WASM_AOT_MATRIX_DIR;
+        MemoryConfig memory;       // Per-instance heap/stack for the WAMR engines
+        std::vector<Automation> automations { Automation::None };
+        int automationInterval = 32;  // Samples between sample-accurate changes
+        std::vector<int> voiceCounts { 32, 64, 128 };  // Notes the synth kernel plays at once
+        std::string renderDir;     // Non-empty: render the inputs to WAV files here instead of benchmarking
+        int jobs = 0;              // Render worker threads; 0 = one per core
+        int renderBlockSize = 512;
+        bool hardwareCounters = false;  // Count cycles, instructions and misses per block (Linux)
+    };
+
+    struct Result
+    {
+        EngineType engine;
+        ModuleVariant variant;
+        DspKernel kernel;
+        ProcessMode mode;
+        Automation automation;
+        int voices;  // Synth kernel only, else 0
+        int blockSize;
+        int oversampling;  // 1 = none
+        int channels;
+        double sampleRate;
+        uint64_t samples;  // Per channel, at the input rate
+        double seconds;
+        double resamplerSeconds;  // Part of seconds spent up- and downsampling
+        std::string label;       // AOT matrix build, empty for the builtin module
+        LatencySummary latency;  // Per block
+        PerfSummary perf;        // Empty without --hw-counters
+    };
+
+    struct InstanceResult
+    {
+        EngineType engine;
+        ModuleVariant variant;
+        int instances;
+        double meanInstantiateUs;
+        double maxInstantiateUs;
+        int64_t rssDeltaBytes;
+    };
+
+    struct ResetResult
+    {
+        EngineType engine;
+        ModuleVariant variant;
+        int resets;
+        ResetKind kind;  // How a plain reset went
+        double meanResetUs;
+        double meanReinstantiateUs;
+    };
+
+    // An AOT matrix build's throughput and p99 block latency relative to the
+    // default build, as geometric means over every configuration both ran
+    struct AotRanking
+    {
+        std::string label;
+        std::string flags;  // wamrc flags, from the matrix's matrix.txt
+        EngineType engine;
+        ModuleVariant variant;
+        double throughputRatio;
+        double p99Ratio;
+        int configurations;
+    };
+
+    // Memory of one loaded engine after all its kernels ran
+    struct MemoryResult
+    {
+        EngineType engine;
+        ModuleVariant variant;
+        std::string label;
+        EngineMemory memory;
+    };
+
+    // One input file rendered through one engine, module build and kernel
+    struct RenderResult
+    {
+        std::string input;   // Empty = embedded RawGTR.wav
+        std::string output;
+        EngineType engine;
+        ModuleVariant variant;
+        std::string label;  // AOT matrix build, empty for the builtin module
+        DspKernel kernel;
+        int channels = 0;
+        double sampleRate = 0.0;
+        uint64_t samples = 0;  // Per channel
+        double seconds = 0.0;  // Decode, render and encode
+        std::string error;     // Empty on success
+    };
+
+    struct CompileResult
+    {
+        EngineType engine;
+        ModuleVariant variant;
+        double coldCompileUs;  // Compile plus load with nothing cached
+        double cachedLoadUs;   // Load of the image the first load cached
+    };
+
+    void printUsage()
+    {
+        std::cerr <<
+            "Usage: wasm-bench [options]\n"
+            "  --input <file.wav>          Input file (default: embedded RawGTR.wav), or gen:<signal> for a\n"
+            "                              generated one: silence, sweep, white-noise, pink-noise, impulse,\n"
+            "                              denormal-tail\n"
+            "  --input-seconds <s>         Length of a generated input (default: 10)\n"
+            "  --output <file>             Write results to a file instead of stdout\n"
+            "  --format json|csv           Output format (default: json)\n"
+            "  --engines wamr,wasm2c,...   Engines to run: wamr, wamr-checked, wasm2c, wasm2c-guard,\n"
+            "                              wasm2c-bounds, wasm2c-unchecked, wasm2c-static, wasmi,\n"
+            "                              wamr-classic-interp, wamr-fast-interp, wamr-fast-jit,\n"
+            "                              wamr-llvm-jit, wamr-multi-tier-jit (default: all)\n"
+            "  --variants scalar,simd      Module builds to run (default: both)\n"
+            "  --kernels gain,fir,...|all  DSP kernels to run: gain, biquad, fir, fft, oscillators, fdn,\n"
+            "                              waveshaper, synth (default: gain)\n"
+            "  --modes block,per-sample    Call paths to run (default: both)\n"
+            "  --param-updates <l,...>     Parameter automation to run: none, per-block, sample-accurate\n"
+            "                              (default: none)\n"
+            "  --automation-interval <n>   Samples between sample-accurate parameter changes (default: 32)\n"
+            "  --voices 32,64,128          Notes the synth kernel plays at once, sent as MIDI (default: 32,64,128)\n"
+            "  --block-sizes 16,...,4096   Block sizes to sweep\n"
+            "  --oversampling 1,2,...,16   Oversampling factors to sweep; the engine renders each block at\n"
+            "                              this multiple of its size between polyphase up- and downsampling,\n"
+            "                              timed separately (default: 1)\n"
+            "  --channels 1,2,8,16         Channel counts to sweep (default: 1,2)\n"
+            "  --sample-rates 44100,...    Sample rates the real-time factor is computed for\n"
+            "  --min-seconds <s>           Minimum measured time per run (default: 0.25)\n"
+            "  --instances <n>             Also create n instances per engine and report instantiation\n"
+            "                              time and resident memory per instance (JSON only)\n"
+            "  --resets <n>                Also time n resets per engine from its instantiation snapshot\n"
+            "                              and n by instantiating again (JSON only)\n"
+            "  --aot-variants <l,...>|all  Run the WAMR engines on these builds from the AOT option matrix\n"
+            "                              (default, O0, size1, bounds-checks, host-cpu, ...) and rank them\n"
+            "                              against the default build\n"
+            "  --aot-dir <dir>             AOT matrix directory (default: " WASM_AOT_MATRIX_DIR ")\n"
+            "  --aot-cache <dir>           Also compile the wasm module at load time for the WAMR engines,\n"
+            "                              caching images in dir, and report cold-compile vs cached-load\n"
+            "                              time (JSON only)\n"
+            "  --wamr-heap <bytes>         App heap per WAMR instance (default: 524288; 0 for none)\n"
+            "  --wamr-stack <bytes>        Exec env stack per WAMR instance (default: 8192)\n"
+            "  --hw-counters on|off        Count cycles, instructions, cache, branch and dTLB misses per\n"
+            "                              sample with perf_event_open (Linux; default: off)\n"
+            "  --render <dir>              Instead of benchmarking, render every --input (comma-separated\n"
+            "                              WAV files and directories of them) through every engine, variant\n"
+            "                              and kernel into 32-bit float WAV files in dir, in parallel\n"
+            "  --jobs <n>                  Render worker threads (default: one per core)\n"
+            "  --render-block-size <n>     Samples per render block (default: 512)\n";
+    }
+
+    std::vector<std::string> splitList (const std::string& list)
+    {
+        std::vector<std::string> items;
+        std::stringstream stream (list);
+        std::string item;
+        while (std::getline (stream, item, ','))
+            if (! item.empty())
+                items.push_back (item);
+        return items;
+    }
+
+    // Command-line names of the engines, also used in rendered file names
+    const std::pair<const char*, EngineType> engineOptions[] = {
+        { "wamr",                EngineType::WAMR },
+        { "wamr-checked",        EngineType::WAMRChecked },
+        { "wasm2c",              EngineType::Wasm2c },
+        { "wasm2c-guard",        EngineType::Wasm2cGuardPages },
+        { "wasm2c-bounds",       EngineType::Wasm2cBoundsChecked },
+        { "wasm2c-unchecked",    EngineType::Wasm2cUnchecked },
+        { "wasm2c-static",       EngineType::Wasm2cStatic },
+        { "wasmi",               EngineType::Wasmi },
+        { "wamr-classic-interp", EngineType::WAMRClassicInterp },
+        { "wamr-fast-interp",    EngineType::WAMRFastInterp },
+        { "wamr-fast-jit",       EngineType::WAMRFastJit },
+        { "wamr-llvm-jit",       EngineType::WAMRLlvmJit },
+        { "wamr-multi-tier-jit", EngineType::WAMRMultiTierJit },
+    };
+
+    bool parseEngine (const std::string& name, EngineType& type)
+    {
+        for (auto& [option, engine] : engineOptions)
+        {
+            if (name == option)
+            {
+                type = engine;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char* getEngineOption (EngineType type)
+    {
+        for (auto& [option, engine] : engineOptions)
+            if (engine == type)
+                return option;
+        return "bypass";
+    }
+
+    bool parseKernel (const std::string& name, DspKernel& kernel)
+    {
+        for (int i = 0; i < numKernels; ++i)
+        {
+            if (name == getKernelName ((DspKernel) i))
+            {
+                kernel = (DspKernel) i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const char* getModeName (ProcessMode mode)
+    {
+        return mode == ProcessMode::Block ? "block" : "per-sample";
+    }
+
+    const char* getAutomationName (Automation automation)
+    {
+        switch (automation)
+        {
+            case Automation::None:           return "none";
+            case Automation::PerBlock:       return "per-block";
+            case Automation::SampleAccurate: return "sample-accurate";
+        }
+        return "none";
+    }
+
+    bool parseOptions (int argc, char* argv[], Options& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--help" || arg == "-h")
+                return false;
+
+            if (i + 1 >= argc)
+            {
+                std::cerr << "✗ Missing value for " << arg << std::endl;
+                return false;
+            }
+            std::string value = argv[++i];
+
+            if (arg == "--input")
+                options.inputPath = value;
+            else if (arg == "--input-seconds")
+                options.inputSeconds = std::atof (value.c_str());
+            else if (arg == "--output")
+                options.outputPath = value;
+            else if (arg == "--format")
+                options.format = value;
+            else if (arg == "--min-seconds")
+                options.minSeconds = std::atof (value.c_str());
+            else if (arg == "--instances")
+                options.instances = std::atoi (value.c_str());
+            else if (arg == "--resets")
+                options.resets = std::atoi (value.c_str());
+            else if (arg == "--aot-cache")
+                options.aotCacheDir = value;
+            else if (arg == "--wamr-heap")
+                options.memory.heapBytes = (uint32_t) std::strtoul (value.c_str(), nullptr, 10);
+            else if (arg == "--wamr-stack")
+                options.memory.stackBytes = (uint32_t) std::strtoul (value.c_str(), nullptr, 10);
+            else if (arg == "--automation-interval")
+                options.automationInterval = std::atoi (value.c_str());
+            else if (arg == "--aot-dir")
+                options.aotDir = value;
+            else if (arg == "--aot-variants")
+                options.aotVariants = splitList (value);
+            else if (arg == "--render")
+                options.renderDir = value;
+            else if (arg == "--jobs")
+                options.jobs = std::atoi (value.c_str());
+            else if (arg == "--render-block-size")
+                options.renderBlockSize = std::atoi (value.c_str());
+            else if (arg == "--hw-counters")
+            {
+                if (value != "on" && value != "off")
+                {
+                    std::cerr << "✗ --hw-counters takes on or off" << std::endl;
+                    return false;
+                }
+                options.hardwareCounters = value == "on";
+            }
+            else if (arg == "--engines")
+            {
+                options.engines.clear();
+                for (auto& name : splitList (value))
+                {
+                    EngineType type;
+                    if (! parseEngine (name, type))
+                    {
+                        std::cerr << "✗ Unknown engine: " << name << std::endl;
+                        return false;
+                    }
+                    options.engines.push_back (type);
+                }
+            }
+            else if (arg == "--variants")
+            {
+                options.variants.clear();
+                for (auto& name : splitList (value))
+                {
+                    if (name == "scalar")
+                        options.variants.push_back (ModuleVariant::Scalar);
+                    else if (name == "simd")
+                        options.variants.push_back (ModuleVariant::Simd);
+                    else
+                    {
+                        std::cerr << "✗ Unknown variant: " << name << std::endl;
+                        return false;
+                    }
+                }
+            }
+            else if (arg == "--kernels")
+            {
+                options.kernels.clear();
+                for (auto& name : splitList (value))
+                {
+                    if (name == "all")
+                    {
+                        for (int i = 0; i < numKernels; ++i)
+                            options.kernels.push_back ((DspKernel) i);
+                        continue;
+                    }
+
+                    DspKernel kernel;
+                    if (! parseKernel (name, kernel))
+                    {
+                        std::cerr << "✗ Unknown kernel: " << name << std::endl;
+                        return false;
+                    }
+                    options.kernels.push_back (kernel);
+                }
+            }
+            else if (arg == "--modes")
+            {
+                options.modes.clear();
+                for (auto& name : splitList (value))
+                {
+                    if (name == "block")
+                        options.modes.push_back (ProcessMode::Block);
+                    else if (name == "per-sample")
+                        options.modes.push_back (ProcessMode::PerSample);
+                    else
+                    {
+                        std::cerr << "✗ Unknown mode: " << name << std::endl;
+                        return false;
+                    }
+                }
+            }
+            else if (arg == "--param-updates")
+            {
+                options.automations.clear();
+                for (auto& name : splitList (value))
+                {
+                    if (name == "none")
+                        options.automations.push_back (Automation::None);
+                    else if (name == "per-block")
+                        options.automations.push_back (Automation::PerBlock);
+                    else if (name == "sample-accurate")
+                        options.automations.push_back (Automation::SampleAccurate);
+                    else
+                    {
+                        std::cerr << "✗ Unknown parameter update mode: " << name << std::endl;
+                        return false;
+                    }
+                }
+            }
+            else if (arg == "--voices")
+            {
+                options.voiceCounts.clear();
+                for (auto& count : splitList (value))
+                    options.voiceCounts.push_back (std::atoi (count.c_str()));
+            }
+            else if (arg == "--block-sizes")
+            {
+                options.blockSizes.clear();
+                for (auto& size : splitList (value))
+                    options.blockSizes.push_back (std::atoi (size.c_str()));
+            }
+            else if (arg == "--oversampling")
+            {
+                options.oversampling.clear();
+                for (auto& factor : splitList (value))
+                    options.oversampling.push_back (std::atoi (factor.c_str()));
+            }
+            else if (arg == "--channels")
+            {
+                options.channelCounts.clear();
+                for (auto& count : splitList (value))
+                    options.channelCounts.push_back (std::atoi (count.c_str()));
+            }
+            else if (arg == "--sample-rates")
+            {
+                options.sampleRates.clear();
+                for (auto& rate : splitList (value))
+                    options.sampleRates.push_back (std::atof (rate.c_str()));
+            }
+            else
+            {
+                std::cerr << "✗ Unknown option: " << arg << std::endl;
+                return false;
+            }
+        }
+
+        // "all" expands to every build in the matrix. The default build is
+        // always run first, since the others are ranked against it
+        if (std::find (options.aotVariants.begin(), options.aotVariants.end(), "all") != options.aotVariants.end())
+        {
+            options.aotVariants.clear();
+            for (auto& file : juce::File (options.aotDir).findChildFiles (juce::File::findFiles, false, "module-*.aot"))
+                options.aotVariants.push_back (file.getFileNameWithoutExtension().fromFirstOccurrenceOf ("-", false, false).toStdString());
+            std::sort (options.aotVariants.begin(), options.aotVariants.end());
+            if (options.aotVariants.empty())
+            {
+                std::cerr << "✗ No AOT variants in " << options.aotDir << std::endl;
+                return false;
+            }
+        }
+        options.aotVariants.erase (std::remove (options.aotVariants.begin(), options.aotVariants.end(), "default"),
+                                   options.aotVariants.end());
+        if (! options.aotVariants.empty())
+            options.aotVariants.insert (options.aotVariants.begin(), "default");
+
+        if (options.format != "json" && options.format != "csv")
+        {
+            std::cerr << "✗ Unknown format: " << options.format << std::endl;
+            return false;
+        }
+        if (options.automationInterval <= 0)
+        {
+            std::cerr << "✗ Automation interval must be positive" << std::endl;
+            return false;
+        }
+        if (options.jobs < 0)
+        {
+            std::cerr << "✗ Job count cannot be negative" << std::endl;
+            return false;
+        }
+        if (options.renderBlockSize <= 0)
+        {
+            std::cerr << "✗ Render block size must be positive" << std::endl;
+            return false;
+        }
+        if (options.instances < 0 || options.resets < 0)
+        {
+            std::cerr << "✗ Instance and reset counts cannot be negative" << std::endl;
+            return false;
+        }
+        for (int count : options.voiceCounts)
+        {
+            if (count < 1 || count > 128)
+            {
+                std::cerr << "✗ Voice counts must be between 1 and 128" << std::endl;
+                return false;
+            }
+        }
+        for (int size : options.blockSizes)
+        {
+            if (size <= 0)
+            {
+                std::cerr << "✗ Block sizes must be positive" << std::endl;
+                return false;
+            }
+        }
+        for (int factor : options.oversampling)
+        {
+            if (factor < 1 || factor > Oversampler::maxFactor || (factor & (factor - 1)) != 0)
+            {
+                std::cerr << "✗ Oversampling factors must be 1, 2, 4, 8 or 16" << std::endl;
+                return false;
+            }
+        }
+        for (int count : options.channelCounts)
+        {
+            if (count < 1 || count > DspEngine::maxChannels)
+            {
+                std::cerr << "✗ Channel counts must be between 1 and " << DspEngine::maxChannels << std::endl;
+                return false;
+            }
+        }
+        for (double rate : options.sampleRates)
+        {
+            if (rate <= 0.0)
+            {
+                std::cerr << "✗ Sample rates must be positive" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // A reader for an audio file, or for the embedded RawGTR.wav if path is empty
+    std::unique_ptr<juce::AudioFormatReader> createReader (juce::AudioFormatManager& formatManager, const std::string& path)
+    {
+        if (path.empty())
+            return std::unique_ptr<juce::AudioFormatReader> (
+                formatManager.createReaderFor (std::make_unique<juce::MemoryInputStream> (BinaryData::RawGTR_wav,
+                                                                                          (size_t) BinaryData::RawGTR_wavSize,
+                                                                                          false)));
+
+        return std::unique_ptr<juce::AudioFormatReader> (
+            formatManager.createReaderFor (juce::File::getCurrentWorkingDirectory().getChildFile (path)));
+    }
+
+    // Decode every channel of the input into memory so file I/O stays out of
+    // the timed loop; a gen: input is generated mono at 48 kHz
+    bool loadInput (const Options& options, std::vector<std::vector<float>>& channels)
+    {
+        if (options.inputPath.rfind ("gen:", 0) == 0)
+        {
+            auto name = options.inputPath.substr (4);
+            for (int i = 0; i < numTestSignals; ++i)
+            {
+                if (name != getTestSignalName ((TestSignal) i))
+                    continue;
+
+                auto length = (int) (options.inputSeconds * 48000.0);
+                if (length <= 0)
+                    return false;
+                auto source = InputSource::createSignal ((TestSignal) i);
+                source->prepare (48000.0, length);
+                channels.assign (1, std::vector<float> ((size_t) length));
+                float* pointers[] = { channels[0].data() };
+                source->read (pointers, 1, length);
+                return true;
+            }
+            std::cerr << "✗ Unknown test signal: " << name << std::endl;
+            return false;
+        }
+
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+
+        auto reader = createReader (formatManager, options.inputPath);
+        if (reader == nullptr || reader->lengthInSamples <= 0)
+            return false;
+
+        juce::AudioBuffer<float> buffer ((int) reader->numChannels, (int) reader->lengthInSamples);
+        reader->read (&buffer, 0, (int) reader->lengthInSamples, 0, true, true);
+        channels.clear();
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+            channels.emplace_back (buffer.getReadPointer (ch), buffer.getReadPointer (ch) + buffer.getNumSamples());
+        return true;
+    }
+
+    // An engine running the builtin module, or the AOT matrix build label
+    std::unique_ptr<DspEngine> createEngine (EngineType type, ModuleVariant variant, const std::string& label,
+                                             const std::string& aotDir, const MemoryConfig& memory)
+    {
+        auto engine = DspEngine::create (type, variant);
+        if (engine != nullptr)
+            engine->setMemoryConfig (memory);
+        if (engine == nullptr || ! (label.empty() ? engine->loadBuiltinModule() : engine->loadAotVariant (aotDir, label)))
+            return nullptr;
+
+        return engine;
+    }
+
+    std::string describe (EngineType type, ModuleVariant variant, const std::string& label)
+    {
+        return std::string (getEngineName (type)) + " (" + getVariantName (variant) + (label.empty() ? "" : ", " + label) + ")";
+    }
+
+    // Planar input/output for a channel count, cycling through the file's
+    // channels when more are requested than it has
+    struct ChannelSet
+    {
+        ChannelSet (const std::vector<std::vector<float>>& source, int numChannels)
+        {
+            for (int ch = 0; ch < numChannels; ++ch)
+            {
+                input.push_back (source[(size_t) ch % source.size()]);
+                output.emplace_back (input.back().size());
+            }
+        }
+
+        // Pointers to every channel, offset to a block start
+        void pointersAt (int pos, std::vector<const float*>& in, std::vector<float*>& out)
+        {
+            for (size_t ch = 0; ch < input.size(); ++ch)
+            {
+                in[ch] = input[ch].data() + pos;
+                out[ch] = output[ch].data() + pos;
+            }
+        }
+
+        int numChannels() const { return (int) input.size(); }
+        int length() const      { return (int) input[0].size(); }
+
+        std::vector<std::vector<float>> input, output;
+    };
+
+    // Synthetic automation: gain and tone sweep down and back up once over
+    // the input, mix stays fully wet
+    void automationAt (int pos, int length, float* values)
+    {
+        float phase = (float) pos / (float) length;
+        float sweep = 1.0f - std::abs (2.0f * phase - 1.0f);  // 0 -> 1 -> 0
+        values[(int) ModuleParam::Gain] = -12.0f * sweep;
+        values[(int) ModuleParam::Mix] = 1.0f;
+        values[(int) ModuleParam::Tone] = 20000.0f * std::pow (0.025f, sweep);  // 20 kHz -> 500 Hz
+    }
+
+    // The parameter changes for one block of an automated pass
+    void collectChanges (Automation automation, int interval, int pos, int numSamples, int length,
+                         std::vector<ParamChange>& changes)
+    {
+        changes.clear();
+        if (automation == Automation::None)
+            return;
+
+        int step = automation == Automation::PerBlock ? numSamples : interval;
+        float values[numModuleParams];
+        for (int offset = 0; offset < numSamples; offset += step)
+        {
+            automationAt (pos + offset, length, values);
+            for (int p = 0; p < numModuleParams; ++p)
+                changes.push_back ({ offset, (ModuleParam) p, values[p] });
+        }
+    }
+
+    // Synth workload over the whole input, timed by absolute sample: a chord
+    // of voices notes struck every half second, the previous one released
+    // just before, so envelopes, note-offs and voice stealing all run
+    std::vector<MidiEvent> playChords (int voices, int length)
+    {
+        const int interval = 24000;
+        std::vector<MidiEvent> events;
+        for (int pos = 0, chord = 0; pos < length; pos += interval, ++chord)
+        {
+            for (int v = 0; pos > 0 && v < voices; ++v)
+                events.push_back ({ pos, 0x80, (uint8_t) (24 + (v * 7 + chord - 1) % 96), 0, 0 });
+            for (int v = 0; v < voices; ++v)
+                events.push_back ({ pos, 0x90, (uint8_t) (24 + (v * 7 + chord) % 96), (uint8_t) (64 + v % 64), 0 });
+        }
+        return events;
+    }
+
+    // Render the whole input once, timing each block into latency if given.
+    // The automation and each block's share of midi (absolute sample
+    // offsets) are prepared before its timer starts; handing the MIDI to the
+    // module is timed. With counters, each block is also counted into
+    // counterTotals, the counter reads just outside its timer.
+    //
+    // Oversampled, each block is upsampled, rendered at the higher rate with
+    // its offsets scaled, and downsampled into the output. The resampling is
+    // part of the block's time and counters, and its time is also added up
+    // in resamplerSeconds
+    void renderPass (DspEngine& engine, ProcessMode mode, Automation automation, int interval, int blockSize,
+                     ChannelSet& channels, const std::vector<MidiEvent>& midi, Oversampler& oversampler,
+                     LatencyHistogram* latency = nullptr, double* resamplerSeconds = nullptr,
+                     const PerfCounters* counters = nullptr, PerfAccumulator* counterTotals = nullptr)
+    {
+        std::vector<const float*> in ((size_t) channels.numChannels());
+        std::vector<float*> out ((size_t) channels.numChannels());
+        std::vector<ParamChange> changes;
+        changes.reserve ((size_t) ((blockSize + interval - 1) / interval * numModuleParams));
+        std::vector<MidiEvent> blockMidi;
+        blockMidi.reserve ((size_t) DspEngine::maxMidiEvents);
+        size_t nextMidi = 0;
+        const int length = channels.length();
+        const auto updateMode = automation == Automation::SampleAccurate ? ParamUpdateMode::SampleAccurate
+                                                                         : ParamUpdateMode::PerBlock;
+        const int factor = oversampler.getFactor();
+        const int numChannels = channels.numChannels();
+
+        for (int pos = 0; pos < length; pos += blockSize)
+        {
+            const int numSamples = std::min (blockSize, length - pos);
+            channels.pointersAt (pos, in, out);
+            collectChanges (automation, interval, pos, numSamples, length, changes);
+            for (auto& change : changes)
+                change.sampleOffset *= factor;
+            blockMidi.clear();
+            for (; nextMidi < midi.size() && midi[nextMidi].sampleOffset < pos + numSamples; ++nextMidi)
+            {
+                blockMidi.push_back (midi[nextMidi]);
+                blockMidi.back().sampleOffset = (blockMidi.back().sampleOffset - pos) * factor;
+            }
+
+            PerfCounts countsBefore, countsAfter;
+            bool counting = counters != nullptr && counters->read (countsBefore);
+
+            auto start = std::chrono::steady_clock::now();
+            auto engineStart = start;
+            const float* const* engineIn = in.data();
+            float* const* engineOut = out.data();
+            if (factor > 1)
+            {
+                engineIn = oversampler.upsample (in.data(), numChannels, numSamples);
+                engineOut = oversampler.getOversampledOutput (0);
+                engineStart = std::chrono::steady_clock::now();
+            }
+
+            if (! blockMidi.empty())
+                engine.queueMidi (blockMidi.data(), (int) blockMidi.size());
+            if (automation == Automation::None)
+                engine.process (engineIn, engineOut, numChannels, numSamples * factor, mode);
+            else
+                engine.process (engineIn, engineOut, numChannels, numSamples * factor,
+                                changes.data(), (int) changes.size(), updateMode, mode);
+
+            auto end = std::chrono::steady_clock::now();
+            if (factor > 1)
+            {
+                auto engineEnd = end;
+                oversampler.downsample (0, out.data(), numChannels, numSamples);
+                end = std::chrono::steady_clock::now();
+                if (resamplerSeconds != nullptr)
+                    *resamplerSeconds += std::chrono::duration<double> ((engineStart - start) + (end - engineEnd)).count();
+            }
+            if (latency != nullptr)
+                latency->record ((uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds> (end - start).count(), false);
+
+            if (counting && counters->read (countsAfter))
+                counterTotals->add (PerfCounters::difference (countsBefore, countsAfter),
+                                    (uint64_t) numSamples * (uint64_t) numChannels);
+        }
+    }
+
+    // Render the whole input in blocks, repeating until minSeconds has elapsed
+    Result measure (DspEngine& engine, ProcessMode mode, Automation automation, int interval, int voices, int blockSize,
+                    int oversampling, double sampleRate, ChannelSet& channels, double minSeconds, const PerfCounters* counters)
+    {
+        uint64_t samples = 0;
+        double seconds = 0.0, resamplerSeconds = 0.0;
+        LatencyHistogram latency;
+        PerfAccumulator counterTotals;
+        auto midi = voices > 0 ? playChords (voices, channels.length()) : std::vector<MidiEvent>();
+        Oversampler oversampler;
+        oversampler.prepare (channels.numChannels(), blockSize);
+        oversampler.setFactor (oversampling);
+
+        // The module designs its kernel for the rate it actually runs at. A
+        // module without set_sample_rate keeps its own
+        engine.setSampleRate ((int) sampleRate * oversampling);
+
+        // One untimed pass to fault in code and memory
+        renderPass (engine, mode, automation, interval, blockSize, channels, midi, oversampler);
+
+        do
+        {
+            auto start = std::chrono::steady_clock::now();
+            renderPass (engine, mode, automation, interval, blockSize, channels, midi, oversampler, &latency,
+                        &resamplerSeconds, counters, &counterTotals);
+            auto end = std::chrono::steady_clock::now();
+
+            seconds += std::chrono::duration<double> (end - start).count();
+            samples += (uint64_t) channels.length();
+        }
+        while (seconds < minSeconds);
+
+        // Later runs start from the module's defaults again: default
+        // parameters and no voices sounding
+        for (int p = 0; p < numModuleParams; ++p)
+            engine.setParam ((ModuleParam) p, DspEngine::getDefaultParam ((ModuleParam) p));
+        if (voices > 0)
+            engine.setKernel (engine.getKernel());
+
+        return { engine.getType(), engine.getVariant(), engine.getKernel(), mode, automation, voices, blockSize, oversampling,
+                 channels.numChannels(), sampleRate, samples, seconds, resamplerSeconds, engine.getModuleLabel(),
+                 latency.getSummary(), counterTotals.getSummary() };
+    }
+
+    // Current resident set size in bytes. Elsewhere than Linux only the peak
+    // is available, which still grows with every instance created here
+    int64_t residentBytes()
+    {
+       #if defined (__linux__)
+        long pages = 0, residentPages = 0;
+        if (FILE* statm = std::fopen ("/proc/self/statm", "r"))
+        {
+            if (std::fscanf (statm, "%ld %ld", &pages, &residentPages) != 2)
+                residentPages = 0;
+            std::fclose (statm);
+        }
+        return (int64_t) residentPages * (int64_t) sysconf (_SC_PAGESIZE);
+       #else
+        struct rusage usage;
+        getrusage (RUSAGE_SELF, &usage);
+        return (int64_t) usage.ru_maxrss;  // Bytes on macOS
+       #endif
+    }
+
+    // Create count more instances of a loaded engine and run one block
+    // through each so their memory is actually touched
+    bool measureInstances (DspEngine& engine, int count, const std::vector<float>& input,
+                           std::vector<float>& output, InstanceResult& result)
+    {
+        std::vector<std::unique_ptr<DspEngine>> instances;
+        instances.reserve ((size_t) count);
+        const int blockSize = (int) std::min<size_t> (input.size(), 512);
+
+        int64_t rssBefore = residentBytes();
+        double totalUs = 0.0, maxUs = 0.0;
+        for (int i = 0; i < count; ++i)
+        {
+            auto instance = engine.createInstance();
+            if (instance == nullptr)
+                return false;
+
+            instance->process (input.data(), output.data(), blockSize);
+            double us = (double) instance->getStats().loadTimeUs;
+            totalUs += us;
+            maxUs = std::max (maxUs, us);
+            instances.push_back (std::move (instance));
+        }
+        int64_t rssAfter = residentBytes();
+
+        result = { engine.getType(), engine.getVariant(), count, totalUs / count, maxUs, rssAfter - rssBefore };
+        return true;
+    }
+
+    // Reset a loaded engine count times from its snapshot, then count times
+    // by instantiating again, each after a block so there is state (and
+    // written memory) to undo, as when a voice is stolen
+    bool measureResets (DspEngine& engine, int count, const std::vector<float>& input,
+                        std::vector<float>& output, ResetResult& result)
+    {
+        const int blockSize = (int) std::min<size_t> (input.size(), 512);
+        double totalUs[2] = {};
+        auto kind = ResetKind::None;
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                engine.process (input.data(), output.data(), blockSize);
+                auto start = std::chrono::steady_clock::now();
+                if (! engine.reset (pass == 1))
+                    return false;
+                totalUs[pass] += std::chrono::duration<double, std::micro> (std::chrono::steady_clock::now() - start).count();
+            }
+            if (pass == 0)
+                kind = engine.getLastResetKind();
+        }
+
+        result = { engine.getType(), engine.getVariant(), count, kind, totalUs[0] / count, totalUs[1] / count };
+        return true;
+    }
+
+    // Load the embedded wasm into an AOT engine twice: with its cache entry
+    // removed, so it is compiled, then again so it comes from the cache
+    bool measureCompile (EngineType type, ModuleVariant variant, CompileResult& result)
+    {
+        auto wasm = getBuiltinWasmModule (variant);
+        std::remove (DspEngine::getAotCachePath (wasm.data, wasm.size).c_str());
+
+        double us[2] = {};
+        const AotSource expected[2] = { AotSource::Compiled, AotSource::Cached };
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            auto engine = DspEngine::create (type, variant);
+            if (engine == nullptr || ! engine->load (wasm.data, wasm.size) || engine->getAotSource() != expected[pass])
+                return false;
+
+            us[pass] = (double) engine->getStats().loadTimeUs;
+        }
+
+        result = { type, variant, us[0], us[1] };
+        return true;
+    }
+
+    // Throughput counts samples on every channel; the real-time factor is per
+    // multichannel frame
+    double samplesPerSecond (const Result& r) { return (double) r.samples * r.channels / r.seconds; }
+    double realtimeFactor (const Result& r)   { return ((double) r.samples / r.sampleRate) / r.seconds; }
+    double nsPerSample (const Result& r)      { return r.seconds * 1.0e9 / ((double) r.samples * r.channels); }
+
+    // The same split between the engine and the resampling around it
+    double resamplerNsPerSample (const Result& r) { return r.resamplerSeconds * 1.0e9 / ((double) r.samples * r.channels); }
+    double engineNsPerSample (const Result& r)    { return nsPerSample (r) - resamplerNsPerSample (r); }
+
+    // Rank every AOT matrix build against the default build of the same
+    // engine and variant, fastest first
+    std::vector<AotRanking> rankAotVariants (const std::vector<Result>& results, const std::string& aotDir)
+    {
+        auto configuration = [] (const Result& r)
+        {
+            return std::to_string ((int) r.engine) + "/" + std::to_string ((int) r.variant) + "/" + std::to_string ((int) r.kernel)
+                   + "/" + std::to_string ((int) r.mode) + "/" + std::to_string ((int) r.automation)
+                   + "/" + std::to_string (r.voices)
+                   + "/" + std::to_string (r.blockSize) + "/" + std::to_string (r.oversampling)
+                   + "/" + std::to_string (r.channels)
+                   + "/" + std::to_string (r.sampleRate);
+        };
+
+        std::map<std::string, const Result*> baseline;
+        for (auto& r : results)
+            if (r.label == "default")
+                baseline[configuration (r)] = &r;
+
+        // Sums of log ratios, keyed by engine/variant/label
+        std::map<std::tuple<int, int, std::string>, AotRanking> rankings;
+        for (auto& r : results)
+        {
+            auto base = baseline.find (configuration (r));
+            if (r.label.empty() || r.label == "default" || base == baseline.end())
+                continue;
+
+            auto& ranking = rankings[std::make_tuple ((int) r.engine, (int) r.variant, r.label)];
+            ranking.label = r.label;
+            ranking.engine = r.engine;
+            ranking.variant = r.variant;
+            ranking.throughputRatio += std::log (samplesPerSecond (r) / samplesPerSecond (*base->second));
+            ranking.p99Ratio += std::log ((double) std::max<uint64_t> (r.latency.p99Ns, 1)
+                                          / (double) std::max<uint64_t> (base->second->latency.p99Ns, 1));
+            ranking.configurations++;
+        }
+
+        // wamrc flags each build was made with
+        std::map<std::string, std::string> flags;
+        std::ifstream matrix (aotDir + "/matrix.txt");
+        for (std::string line; std::getline (matrix, line); )
+            if (auto tab = line.find ('\t'); tab != std::string::npos)
+                flags[line.substr (0, tab)] = line.substr (tab + 1);
+
+        std::vector<AotRanking> ranked;
+        for (auto& [key, ranking] : rankings)
+        {
+            ranking.throughputRatio = std::exp (ranking.throughputRatio / ranking.configurations);
+            ranking.p99Ratio = std::exp (ranking.p99Ratio / ranking.configurations);
+            ranking.flags = flags[ranking.label];
+            ranked.push_back (ranking);
+        }
+        std::sort (ranked.begin(), ranked.end(), [] (const AotRanking& a, const AotRanking& b)
+        {
+            return a.throughputRatio > b.throughputRatio;
+        });
+        return ranked;
+    }
+
+    void writeCsv (std::ostream& out, const std::vector<Result>& results)
+    {
+        // Hardware counter columns are per sample, empty where not counted
+        out << "engine,variant,aot_variant,kernel,mode,param_updates,voices,block_size,oversampling,channels,sample_rate,samples,seconds,"
+               "samples_per_sec,realtime_factor,ns_per_sample,engine_ns_per_sample,resampler_ns_per_sample,"
+               "p50_block_ns,p99_block_ns,p999_block_ns,max_block_ns";
+        for (int e = 0; e < numPerfEvents; ++e)
+            out << ',' << getPerfEventName ((PerfEvent) e) << "_per_sample";
+        out << ",ipc\n";
+        for (auto& r : results)
+        {
+            out << getEngineName (r.engine) << ',' << getVariantName (r.variant) << ',' << r.label << ','
+                << getKernelName (r.kernel) << ',' << getModeName (r.mode) << ',' << getAutomationName (r.automation) << ',' << r.voices << ','
+                << r.blockSize << ',' << r.oversampling << ','
+                << r.channels << ',' << r.sampleRate << ',' << r.samples << ',' << r.seconds << ',' << samplesPerSecond (r) << ','
+                << realtimeFactor (r) << ',' << nsPerSample (r) << ',' << engineNsPerSample (r) << ','
+                << resamplerNsPerSample (r) << ',' << r.latency.p50Ns << ',' << r.latency.p99Ns << ','
+                << r.latency.p999Ns << ',' << r.latency.maxNs;
+            for (int e = 0; e < numPerfEvents; ++e)
+            {
+                out << ',';
+                if (r.perf.has ((PerfEvent) e))
+                    out << r.perf.perSample[(size_t) e];
+            }
+            out << ',';
+            if (r.perf.ipc > 0.0)
+                out << r.perf.ipc;
+            out << '\n';
+        }
+    }
+
+    void writeJson (std::ostream& out, const Options& options, size_t inputSamples, const std::vector<Result>& results,
+                    const std::vector<InstanceResult>& instanceResults, const std::vector<ResetResult>& resetResults,
+                    const std::vector<MemoryResult>& memoryResults, const std::vector<CompileResult>& compileResults,
+                    const std::vector<AotRanking>& ranking, const std::vector<std::string>& unsupported,
+                    const std::vector<std::string>& errors)
+    {
+        out << "{\n";
+        out << "  \"input\": \"" << (options.inputPath.empty() ? "RawGTR.wav (embedded)" : options.inputPath) << "\",\n";
+        out << "  \"input_samples\": " << inputSamples << ",\n";
+        auto writeList = [&out] (const char* name, const std::vector<std::string>& items)
+        {
+            out << "  \"" << name << "\": [";
+            for (size_t i = 0; i < items.size(); ++i)
+                out << (i == 0 ? "" : ", ") << '"' << items[i] << '"';
+            out << "],\n";
+        };
+        writeList ("unsupported", unsupported);
+        writeList ("errors", errors);
+        out << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            auto& r = results[i];
+            out << "    { \"engine\": \"" << getEngineName (r.engine) << "\""
+                << ", \"variant\": \"" << getVariantName (r.variant) << "\""
+                << ", \"aot_variant\": \"" << r.label << "\""
+                << ", \"kernel\": \"" << getKernelName (r.kernel) << "\""
+                << ", \"mode\": \"" << getModeName (r.mode) << "\""
+                << ", \"param_updates\": \"" << getAutomationName (r.automation) << "\""
+                << ", \"voices\": " << r.voices
+                << ", \"block_size\": " << r.blockSize
+                << ", \"oversampling\": " << r.oversampling
+                << ", \"channels\": " << r.channels
+                << ", \"sample_rate\": " << r.sampleRate
+                << ", \"samples\": " << r.samples
+                << ", \"seconds\": " << r.seconds
+                << ", \"samples_per_sec\": " << samplesPerSecond (r)
+                << ", \"realtime_factor\": " << realtimeFactor (r)
+                << ", \"ns_per_sample\": " << nsPerSample (r)
+                << ", \"engine_ns_per_sample\": " << engineNsPerSample (r)
+                << ", \"resampler_ns_per_sample\": " << resamplerNsPerSample (r)
+                << ", \"p50_block_ns\": " << r.latency.p50Ns
+                << ", \"p99_block_ns\": " << r.latency.p99Ns
+                << ", \"p999_block_ns\": " << r.latency.p999Ns
+                << ", \"max_block_ns\": " << r.latency.maxNs;
+            for (int e = 0; e < numPerfEvents; ++e)
+                if (r.perf.has ((PerfEvent) e))
+                    out << ", \"" << getPerfEventName ((PerfEvent) e) << "_per_sample\": " << r.perf.perSample[(size_t) e];
+            if (r.perf.ipc > 0.0)
+                out << ", \"ipc\": " << r.perf.ipc;
+            out << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ],\n";
+        out << "  \"instances\": [\n";
+        for (size_t i = 0; i < instanceResults.size(); ++i)
+        {
+            auto& r = instanceResults[i];
+            out << "    { \"engine\": \"" << getEngineName (r.engine) << "\""
+                << ", \"variant\": \"" << getVariantName (r.variant) << "\""
+                << ", \"instances\": " << r.instances
+                << ", \"mean_instantiate_us\": " << r.meanInstantiateUs
+                << ", \"max_instantiate_us\": " << r.maxInstantiateUs
+                << ", \"rss_delta_bytes\": " << r.rssDeltaBytes
+                << ", \"rss_bytes_per_instance\": " << r.rssDeltaBytes / r.instances
+                << " }" << (i + 1 < instanceResults.size() ? "," : "") << "\n";
+        }
+        out << "  ],\n";
+        out << "  \"resets\": [\n";
+        for (size_t i = 0; i < resetResults.size(); ++i)
+        {
+            auto& r = resetResults[i];
+            out << "    { \"engine\": \"" << getEngineName (r.engine) << "\""
+                << ", \"variant\": \"" << getVariantName (r.variant) << "\""
+                << ", \"resets\": " << r.resets
+                << ", \"reset_kind\": \"" << getResetKindName (r.kind) << "\""
+                << ", \"mean_reset_us\": " << r.meanResetUs
+                << ", \"mean_reinstantiate_us\": " << r.meanReinstantiateUs
+                << " }" << (i + 1 < resetResults.size() ? "," : "") << "\n";
+        }
+        out << "  ],\n";
+        out << "  \"memory\": [\n";
+        for (size_t i = 0; i < memoryResults.size(); ++i)
+        {
+            auto& r = memoryResults[i];
+            out << "    { \"engine\": \"" << getEngineName (r.engine) << "\""
+                << ", \"variant\": \"" << getVariantName (r.variant) << "\""
+                << ", \"aot_variant\": \"" << r.label << "\""
+                << ", \"runtime_bytes\": " << r.memory.runtimeBytes
+                << ", \"linear_memory_bytes\": " << r.memory.linearMemoryBytes
+                << ", \"heap_bytes\": " << r.memory.heapBytes
+                << ", \"pool_bytes\": " << r.memory.poolBytes
+                << ", \"pool_peak_bytes\": " << r.memory.poolPeakBytes
+                << ", \"stack_bytes\": " << r.memory.stackBytes
+                << ", \"stack_high_water_bytes\": " << r.memory.stackHighWaterBytes
+                << ", \"code_bytes\": " << r.memory.codeBytes
+                << " }" << (i + 1 < memoryResults.size() ? "," : "") << "\n";
+        }
+        out << "  ],\n";
+        out << "  \"memory_config\": { \"wamr_heap_bytes\": " << options.memory.heapBytes
+            << ", \"wamr_stack_bytes\": " << options.memory.stackBytes << " },\n";
+        out << "  \"aot_compile\": [\n";
+        for (size_t i = 0; i < compileResults.size(); ++i)
+        {
+            auto& r = compileResults[i];
+            out << "    { \"engine\": \"" << getEngineName (r.engine) << "\""
+                << ", \"variant\": \"" << getVariantName (r.variant) << "\""
+                << ", \"cold_compile_us\": " << r.coldCompileUs
+                << ", \"cached_load_us\": " << r.cachedLoadUs
+                << " }" << (i + 1 < compileResults.size() ? "," : "") << "\n";
+        }
+        out << "  ],\n";
+        out << "  \"aot_ranking\": [\n";
+        for (size_t i = 0; i < ranking.size(); ++i)
+        {
+            auto& r = ranking[i];
+            out << "    { \"aot_variant\": \"" << r.label << "\""
+                << ", \"wamrc_flags\": \"" << r.flags << "\""
+                << ", \"engine\": \"" << getEngineName (r.engine) << "\""
+                << ", \"variant\": \"" << getVariantName (r.variant) << "\""
+                << ", \"throughput_vs_default\": " << r.throughputRatio
+                << ", \"p99_block_latency_vs_default\": " << r.p99Ratio
+                << ", \"configurations\": " << r.configurations
+                << " }" << (i + 1 < ranking.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n";
+        out << "}\n";
+    }
+
+    // Results go to --output, or stdout
+    bool writeOutput (const Options& options, const std::function<void (std::ostream&)>& write)
+    {
+        if (options.outputPath.empty())
+        {
+            write (std::cout);
+            return true;
+        }
+
+        std::ofstream file (options.outputPath);
+        if (! file)
+        {
+            std::cerr << "✗ ERROR: Cannot write " << options.outputPath << std::endl;
+            return false;
+        }
+        write (file);
+        return true;
+    }
+
+    //==============================================================================
+    // Offline rendering (--render)
+
+    // A loaded engine the render workers take their own instances from. One
+    // that can't create instances (wasm2c-static) renders its jobs one at a
+    // time on the source itself
+    struct RenderSource
+    {
+        std::unique_ptr<DspEngine> engine;
+        std::mutex lock;      // Guards createInstance and shared rendering
+        bool shared = false;  // createInstance failed
+    };
+
+    struct RenderJob
+    {
+        std::string input;
+        size_t source;
+        DspKernel kernel;
+    };
+
+    // Files as given and directories expanded to the WAV files directly in
+    // them, sorted. No --input renders the embedded RawGTR.wav
+    std::vector<std::string> listRenderInputs (const std::string& list)
+    {
+        if (list.empty())
+            return { std::string() };
+
+        std::vector<std::string> inputs;
+        for (auto& item : splitList (list))
+        {
+            auto file = juce::File::getCurrentWorkingDirectory().getChildFile (item);
+            if (! file.isDirectory())
+            {
+                inputs.push_back (item);
+                continue;
+            }
+
+            auto files = file.findChildFiles (juce::File::findFiles, false, "*.wav");
+            files.sort();
+            for (auto& child : files)
+                inputs.push_back (child.getFullPathName().toStdString());
+        }
+        return inputs;
+    }
+
+    // Stream one input through an engine a block at a time into a 32-bit
+    // float WAV, so a file of any length renders in constant memory
+    void renderFile (DspEngine& engine, DspKernel kernel, int blockSize, const juce::File& outputFile, RenderResult& result)
+    {
+        auto start = std::chrono::steady_clock::now();
+        juce::AudioFormatManager formatManager;
+        formatManager.registerBasicFormats();
+
+        auto reader = createReader (formatManager, result.input);
+        if (reader == nullptr || reader->lengthInSamples <= 0)
+        {
+            result.error = "cannot read input";
+            return;
+        }
+        const int numChannels = (int) reader->numChannels;
+        if (numChannels > DspEngine::maxChannels)
+        {
+            result.error = "more than " + std::to_string (DspEngine::maxChannels) + " channels";
+            return;
+        }
+
+        // Also clears whatever the previous file left in the kernel
+        if (! engine.setKernel (kernel))
+        {
+            result.error = "cannot select kernel";
+            return;
+        }
+        if (! engine.setSampleRate ((int) reader->sampleRate))
+        {
+            result.error = "cannot run at " + std::to_string ((int) reader->sampleRate) + " Hz";
+            return;
+        }
+
+        outputFile.deleteFile();
+        std::unique_ptr<juce::OutputStream> stream = outputFile.createOutputStream();
+        std::unique_ptr<juce::AudioFormatWriter> writer;
+        if (stream != nullptr)
+            writer.reset (juce::WavAudioFormat().createWriterFor (stream.get(), reader->sampleRate, (unsigned int) numChannels,
+                                                                  32, {}, 0));
+        if (writer == nullptr)
+        {
+            result.error = "cannot write " + result.output;
+            return;
+        }
+        stream.release();  // The writer owns it now
+
+        juce::AudioBuffer<float> input (numChannels, blockSize), output (numChannels, blockSize);
+        const auto length = reader->lengthInSamples;
+        for (juce::int64 pos = 0; pos < length; pos += blockSize)
+        {
+            const int numSamples = (int) std::min<juce::int64> (blockSize, length - pos);
+            reader->read (&input, 0, numSamples, pos, true, true);
+            if (! engine.process (input.getArrayOfReadPointers(), output.getArrayOfWritePointers(), numChannels, numSamples,
+                                  ProcessMode::Block))
+                result.error = "engine failed at sample " + std::to_string (pos);
+            else if (! writer->writeFromFloatArrays (output.getArrayOfReadPointers(), numChannels, numSamples))
+                result.error = "cannot write " + result.output;
+
+            if (! result.error.empty())
+            {
+                writer.reset();
+                outputFile.deleteFile();
+                return;
+            }
+        }
+        writer.reset();  // Finishes the WAV header
+
+        result.channels = numChannels;
+        result.sampleRate = reader->sampleRate;
+        result.samples = (uint64_t) length;
+        result.seconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Work through the jobs on numWorkers threads. Each worker creates its own
+    // instance of an engine the first time it needs one and keeps it for the
+    // rest of its jobs, so workers never share engine state
+    std::vector<RenderResult> renderAll (std::vector<std::unique_ptr<RenderSource>>& sources, const std::vector<RenderJob>& jobs,
+                                         const juce::File& outputDir, int blockSize, int numWorkers)
+    {
+        std::vector<RenderResult> results (jobs.size());
+        std::atomic<size_t> nextJob { 0 };
+
+        auto work = [&]
+        {
+            DspEngine::attachCurrentThread();
+            std::vector<std::unique_ptr<DspEngine>> instances (sources.size());
+
+            for (size_t j = nextJob++; j < jobs.size(); j = nextJob++)
+            {
+                auto& job = jobs[j];
+                auto& source = *sources[job.source];
+                auto& result = results[j];
+                result.input = job.input;
+                result.engine = source.engine->getType();
+                result.variant = source.engine->getVariant();
+                result.label = source.engine->getModuleLabel();
+                result.kernel = job.kernel;
+
+                auto stem = job.input.empty() ? juce::String ("RawGTR") : juce::File::getCurrentWorkingDirectory().getChildFile (job.input)
+                                                                            .getFileNameWithoutExtension();
+                auto outputFile = outputDir.getChildFile (stem + "-" + getEngineOption (result.engine) + "-"
+                                                          + getVariantName (result.variant)
+                                                          + juce::String (result.label.empty() ? "" : "-" + result.label) + "-"
+                                                          + getKernelName (job.kernel) + ".wav");
+                result.output = outputFile.getFullPathName().toStdString();
+
+                std::unique_lock<std::mutex> lock (source.lock);
+                auto& instance = instances[job.source];
+                if (instance == nullptr && ! source.shared)
+                {
+                    instance = source.engine->createInstance();
+                    source.shared = instance == nullptr;
+                }
+
+                // Without an instance of its own the worker keeps the lock and
+                // renders on the source
+                DspEngine* engine = source.engine.get();
+                if (instance != nullptr)
+                {
+                    engine = instance.get();
+                    lock.unlock();
+                }
+                renderFile (*engine, job.kernel, blockSize, outputFile, result);
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < numWorkers; ++i)
+            workers.emplace_back (work);
+        for (auto& worker : workers)
+            worker.join();
+        return results;
+    }
+
+    double realtimeFactor (const RenderResult& r) { return r.seconds > 0.0 ? ((double) r.samples / r.sampleRate) / r.seconds : 0.0; }
+
+    void writeRenderCsv (std::ostream& out, const std::vector<RenderResult>& results)
+    {
+        out << "input,output,engine,variant,aot_variant,kernel,channels,sample_rate,samples,seconds,realtime_factor,error\n";
+        for (auto& r : results)
+            out << r.input << ',' << r.output << ',' << getEngineName (r.engine) << ',' << getVariantName (r.variant) << ','
+                << r.label << ',' << getKernelName (r.kernel) << ',' << r.channels << ',' << r.sampleRate << ','
+                << r.samples << ',' << r.seconds << ',' << realtimeFactor (r) << ',' << r.error << '\n';
+    }
+
+    void writeRenderJson (std::ostream& out, const std::vector<RenderResult>& results, int numWorkers, double wallSeconds,
+                          const std::vector<std::string>& unsupported, const std::vector<std::string>& errors)
+    {
+        double audioSeconds = 0.0;
+        for (auto& r : results)
+            if (r.error.empty())
+                audioSeconds += (double) r.samples / r.sampleRate;
+
+        out << "{\n";
+        out << "  \"jobs\": " << results.size() << ",\n";
+        out << "  \"workers\": " << numWorkers << ",\n";
+        out << "  \"wall_seconds\": " << wallSeconds << ",\n";
+        out << "  \"audio_seconds\": " << audioSeconds << ",\n";
+        out << "  \"realtime_factor\": " << (wallSeconds > 0.0 ? audioSeconds / wallSeconds : 0.0) << ",\n";
+        auto writeList = [&out] (const char* name, const std::vector<std::string>& items)
+        {
+            out << "  \"" << name << "\": [";
+            for (size_t i = 0; i < items.size(); ++i)
+                out << (i == 0 ? "" : ", ") << '"' << items[i] << '"';
+            out << "],\n";
+        };
+        writeList ("unsupported", unsupported);
+        writeList ("errors", errors);
+        out << "  \"renders\": [\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            auto& r = results[i];
+            out << "    { \"input\": \"" << (r.input.empty() ? "RawGTR.wav (embedded)" : r.input) << "\""
+                << ", \"output\": \"" << r.output << "\""
+                << ", \"engine\": \"" << getEngineName (r.engine) << "\""
+                << ", \"variant\": \"" << getVariantName (r.variant) << "\""
+                << ", \"aot_variant\": \"" << r.label << "\""
+                << ", \"kernel\": \"" << getKernelName (r.kernel) << "\""
+                << ", \"channels\": " << r.channels
+                << ", \"sample_rate\": " << r.sampleRate
+                << ", \"samples\": " << r.samples
+                << ", \"seconds\": " << r.seconds
+                << ", \"realtime_factor\": " << realtimeFactor (r)
+                << ", \"error\": \"" << r.error << "\""
+                << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n";
+        out << "}\n";
+    }
+
+    // Render every input through every requested engine, module build and
+    // kernel, with the default parameters and no MIDI
+    int runRender (const Options& options)
+    {
+        auto outputDir = juce::File::getCurrentWorkingDirectory().getChildFile (options.renderDir);
+        if (auto created = outputDir.createDirectory(); created.failed())
+        {
+            std::cerr << "✗ ERROR: Cannot create " << options.renderDir << ": " << created.getErrorMessage() << std::endl;
+            return 1;
+        }
+
+        DspEngine::attachCurrentThread();
+        std::vector<std::unique_ptr<RenderSource>> sources;
+        std::vector<std::string> unsupported;
+        std::vector<std::string> errors;
+        for (auto type : options.engines)
+        {
+            for (auto variant : options.variants)
+            {
+                std::vector<std::string> labels { std::string() };
+                if (isAotEngine (type) && ! options.aotVariants.empty())
+                    labels = options.aotVariants;
+
+                for (auto& label : labels)
+                {
+                    auto name = describe (type, variant, label);
+                    auto engine = createEngine (type, variant, label, options.aotDir, options.memory);
+                    if (engine == nullptr)
+                    {
+                        // As in the benchmark: only a scalar build of an available engine must load
+                        if (variant == ModuleVariant::Simd || ! isEngineAvailable (type))
+                        {
+                            std::cerr << "- " << name << ": unsupported" << std::endl;
+                            unsupported.push_back (name);
+                            continue;
+                        }
+                        std::cerr << "✗ Failed to create/load " << name << std::endl;
+                        errors.push_back ("failed to load " + name);
+                        continue;
+                    }
+                    sources.push_back (std::make_unique<RenderSource>());
+                    sources.back()->engine = std::move (engine);
+                }
+            }
+        }
+
+        auto inputs = listRenderInputs (options.inputPath);
+        std::vector<RenderJob> jobs;
+        for (auto& input : inputs)
+            for (size_t source = 0; source < sources.size(); ++source)
+                for (auto kernel : options.kernels)
+                    jobs.push_back ({ input, source, kernel });
+
+        int numWorkers = options.jobs > 0 ? options.jobs : (int) std::max (1u, std::thread::hardware_concurrency());
+        numWorkers = (int) std::max<size_t> (1, std::min ((size_t) numWorkers, jobs.size()));
+        std::cerr << "✓ Rendering " << inputs.size() << " inputs x " << sources.size() << " engines x "
+                  << options.kernels.size() << " kernels on " << numWorkers << " threads" << std::endl;
+
+        auto start = std::chrono::steady_clock::now();
+        auto results = renderAll (sources, jobs, outputDir, options.renderBlockSize, numWorkers);
+        double wallSeconds = std::chrono::duration<double> (std::chrono::steady_clock::now() - start).count();
+
+        for (auto& r : results)
+        {
+            auto name = describe (r.engine, r.variant, r.label) + " " + getKernelName (r.kernel);
+            if (! r.error.empty())
+            {
+                std::cerr << "✗ " << (r.input.empty() ? "RawGTR.wav" : r.input) << " through " << name << ": " << r.error << std::endl;
+                errors.push_back (r.input + " through " + name + ": " + r.error);
+                continue;
+            }
+            std::cerr << "  " << r.output << ": " << realtimeFactor (r) << "x real time" << std::endl;
+        }
+        std::cerr << "✓ " << results.size() << " renders in " << wallSeconds << " s" << std::endl;
+
+        bool written = writeOutput (options, [&] (std::ostream& out)
+        {
+            if (options.format == "csv")
+                writeRenderCsv (out, results);
+            else
+                writeRenderJson (out, results, numWorkers, wallSeconds, unsupported, errors);
+        });
+        if (! written)
+            return 1;
+        return errors.empty() ? 0 : 2;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    Options options;
+    if (! parseOptions (argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    if (! options.renderDir.empty())
+        return runRender (options);
+
+    std::vector<std::vector<float>> inputChannels;
+    if (! loadInput (options, inputChannels))
+    {
+        std::cerr << "✗ ERROR: Failed to load input audio" << std::endl;
+        return 1;
+    }
+    const auto& input = inputChannels[0];
+    std::vector<float> output (input.size());
+
+    // Progress goes to stderr so stdout stays machine-readable
+    std::cerr << "✓ Input: " << inputChannels.size() << " channels, " << input.size() << " samples" << std::endl;
+
+    std::vector<Result> results;
+    std::vector<InstanceResult> instanceResults;
+    std::vector<ResetResult> resetResults;
+    std::vector<MemoryResult> memoryResults;
+    std::vector<CompileResult> compileResults;
+    std::vector<std::string> unsupported;
+    std::vector<std::string> errors;
+    DspEngine::attachCurrentThread();
+    if (! options.aotCacheDir.empty())
+        DspEngine::setAotCacheDirectory (options.aotCacheDir);
+
+    // Counters count this thread, which does all the measuring
+    PerfCounters counters;
+    if (options.hardwareCounters && ! counters.open())
+    {
+        std::cerr << "- Hardware counters: " << counters.getError() << std::endl;
+        unsupported.push_back ("hardware counters: " + counters.getError());
+    }
+
+    for (auto type : options.engines)
+    {
+        for (auto variant : options.variants)
+        {
+            if (! options.aotCacheDir.empty() && isAotEngine (type))
+            {
+                auto name = describe (type, variant, {});
+                CompileResult result;
+                if (! DspEngine::canCompileAot())
+                {
+                    std::cerr << "- " << name << " runtime compile: unsupported" << std::endl;
+                    unsupported.push_back (name + " runtime compile");
+                }
+                else if (measureCompile (type, variant, result))
+                {
+                    compileResults.push_back (result);
+                    std::cerr << "  " << name << " runtime compile: " << result.coldCompileUs << " us cold, "
+                              << result.cachedLoadUs << " us from cache" << std::endl;
+                }
+                else
+                {
+                    std::cerr << "✗ Failed to compile/cache " << name << std::endl;
+                    errors.push_back ("failed to compile " + name);
+                }
+            }
+
+            // The AOT engines run each requested AOT matrix build in turn
+            std::vector<std::string> labels { std::string() };
+            if (isAotEngine (type) && ! options.aotVariants.empty())
+                labels = options.aotVariants;
+
+            for (auto& label : labels)
+            {
+                auto name = describe (type, variant, label);
+                auto engine = createEngine (type, variant, label, options.aotDir, options.memory);
+                if (engine == nullptr)
+                {
+                    // Scalar must always work; an engine without SIMD support, or
+                    // a WAMR tier this runtime wasn't built with, is reported
+                    // rather than treated as a failure
+                    if (variant == ModuleVariant::Simd || ! isEngineAvailable (type))
+                    {
+                        std::cerr << "- " << name << ": unsupported" << std::endl;
+                        unsupported.push_back (name);
+                        continue;
+                    }
+                    std::cerr << "✗ Failed to create/load " << name << std::endl;
+                    errors.push_back ("failed to load " + name);
+                    continue;
+                }
+
+                for (auto kernel : options.kernels)
+                {
+                    if (! engine->setKernel (kernel))
+                    {
+                        std::cerr << "✗ " << name << " cannot select kernel " << getKernelName (kernel) << std::endl;
+                        errors.push_back ("failed to select " + std::string (getKernelName (kernel)) + " on " + name);
+                        continue;
+                    }
+
+                    // Only the synth plays notes; the other kernels run once without MIDI
+                    auto voiceCounts = kernel == DspKernel::Synth ? options.voiceCounts : std::vector<int> { 0 };
+
+                    for (auto mode : options.modes)
+                    {
+                        for (auto automation : options.automations)
+                        {
+                            for (int voices : voiceCounts)
+                            {
+                                for (int numChannels : options.channelCounts)
+                                {
+                                    ChannelSet channels (inputChannels, numChannels);
+                                    for (int blockSize : options.blockSizes)
+                                    {
+                                        for (int factor : options.oversampling)
+                                        {
+                                            for (double sampleRate : options.sampleRates)
+                                            {
+                                                results.push_back (measure (*engine, mode, automation, options.automationInterval, voices,
+                                                                            blockSize, factor, sampleRate, channels, options.minSeconds,
+                                                                            counters.isOpen() ? &counters : nullptr));
+                                                auto& r = results.back();
+                                                std::cerr << "  " << name << " " << getKernelName (kernel) << " " << getModeName (mode)
+                                                          << (automation == Automation::None ? "" : std::string (" ") + getAutomationName (automation))
+                                                          << (voices > 0 ? " " + std::to_string (voices) + " voices" : std::string())
+                                                          << " block " << blockSize << " x " << numChannels << " ch"
+                                                          << (factor > 1 ? " " + std::to_string (factor) + "x oversampled" : std::string())
+                                                          << " @ " << sampleRate << " Hz: " << nsPerSample (r) << " ns/sample";
+                                                if (factor > 1)
+                                                    std::cerr << " (engine " << engineNsPerSample (r) << ", resampler "
+                                                              << resamplerNsPerSample (r) << ")";
+                                                std::cerr << ", " << realtimeFactor (r) << "x real time, p99 block " << r.latency.p99Ns << " ns";
+                                                if (r.perf.ipc > 0.0)
+                                                    std::cerr << ", " << r.perf.perSample[(size_t) PerfEvent::Cycles]
+                                                              << " cycles/sample, IPC " << r.perf.ipc;
+                                                std::cerr << std::endl;
+                                            }
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+
+                // After every kernel ran, so the stack high-water mark covers them all
+                memoryResults.push_back ({ type, variant, label, engine->getMemoryUsage() });
+                auto& memory = memoryResults.back().memory;
+                std::cerr << "  " << name << " memory: " << memory.linearMemoryBytes << " bytes linear ("
+                          << memory.heapBytes << " heap), " << memory.runtimeBytes << " bytes runtime, stack "
+                          << memory.stackHighWaterBytes << " of " << memory.stackBytes << " bytes used, "
+                          << memory.codeBytes << " bytes code" << std::endl;
+
+                if (options.instances > 0)
+                {
+                    InstanceResult result;
+                    if (measureInstances (*engine, options.instances, input, output, result))
+                    {
+                        instanceResults.push_back (result);
+                        std::cerr << "  " << name << " " << result.instances << " instances: "
+                                  << result.meanInstantiateUs << " us mean instantiation, "
+                                  << result.rssDeltaBytes / result.instances << " bytes RSS each" << std::endl;
+                    }
+                    else
+                    {
+                        std::cerr << "✗ Failed to create instances of " << name << std::endl;
+                        errors.push_back ("failed to instantiate " + name);
+                    }
+                }
+
+                if (options.resets > 0)
+                {
+                    ResetResult result;
+                    if (measureResets (*engine, options.resets, input, output, result))
+                    {
+                        resetResults.push_back (result);
+                        std::cerr << "  " << name << " reset: " << result.meanResetUs << " us ("
+                                  << getResetKindName (result.kind) << "), " << result.meanReinstantiateUs
+                                  << " us reinstantiating" << std::endl;
+                    }
+                    else
+                    {
+                        std::cerr << "✗ Failed to reset " << name << std::endl;
+                        errors.push_back ("failed to reset " + name);
+                    }
+                }
+
+                engine->drainDiagnostics ([&name] (const char* message)
+                {
+                    std::cerr << "  [" << name << "] " << message << std::endl;
+                });
+            }
+        }
+    }
+
+    auto ranking = rankAotVariants (results, options.aotDir);
+    for (auto& r : ranking)
+        std::cerr << "  AOT " << r.label << " (" << getEngineName (r.engine) << ", " << getVariantName (r.variant) << "): "
+                  << r.throughputRatio << "x throughput, " << r.p99Ratio << "x p99 block latency vs default"
+                  << (r.flags.empty() ? "" : "  [" + r.flags + "]") << std::endl;
+
+    bool written = writeOutput (options, [&] (std::ostream& out)
+    {
+        if (options.format == "csv")
+            writeCsv (out, results);
+        else
+            writeJson (out, options, input.size(), results, instanceResults, resetResults, memoryResults, compileResults, ranking, unsupported, errors);
+    });
+    if (! written)
+        return 1;
+    return errors.empty() ? 0 : 2;
+}
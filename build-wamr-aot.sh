@@ -3,25 +3,61 @@
 # Store the project root directory
 PROJECT_ROOT=$(pwd)
 
-# Build WAMR runtime with AOT support for macOS
-cd include/wamr/product-mini/platforms/darwin
+# Pick the WAMR platform and target for the host
+if [ "$(uname)" = "Darwin" ]; then
+  PLATFORM=darwin
+  NPROC=$(sysctl -n hw.ncpu)
+else
+  PLATFORM=linux
+  NPROC=$(nproc)
+fi
+
+if [ "$(uname -m)" = "arm64" ] || [ "$(uname -m)" = "aarch64" ]; then
+  TARGET=AARCH64
+else
+  TARGET=X86_64
+fi
+
+# Runtime AOT compilation needs the LLVM-based compiler in the runtime, which
+# WAMR builds along with its LLVM JIT (using the LLVM that build-wamrc.sh built)
+if [ "$WAMR_RUNTIME_COMPILE" = "1" ]; then
+  JIT_FLAGS="-DWAMR_BUILD_JIT=1"
+else
+  JIT_FLAGS="-DWAMR_BUILD_JIT=0"
+fi
+
+# The interpreter tier is always built. WAMR has either the classic or the
+# fast interpreter, never both
+FAST_INTERP=${WAMR_FAST_INTERP:-1}
+
+# Fast JIT only targets x86-64; with LLVM JIT as well it also gives multi-tier
+if [ "$TARGET" = "X86_64" ]; then
+  JIT_FLAGS="$JIT_FLAGS -DWAMR_BUILD_FAST_JIT=1"
+else
+  JIT_FLAGS="$JIT_FLAGS -DWAMR_BUILD_FAST_JIT=0"
+fi
+
+# Build WAMR runtime with AOT support
+cd include/wamr/product-mini/platforms/$PLATFORM
 
 mkdir -p build
 cd build
 
 cmake .. \
-  -DWAMR_BUILD_PLATFORM=darwin \
-  -DWAMR_BUILD_TARGET=AARCH64 \
-  -DWAMR_BUILD_INTERP=0 \
-  -DWAMR_BUILD_FAST_INTERP=0 \
+  -DWAMR_BUILD_PLATFORM=$PLATFORM \
+  -DWAMR_BUILD_TARGET=$TARGET \
+  -DWAMR_BUILD_INTERP=1 \
+  -DWAMR_BUILD_FAST_INTERP=$FAST_INTERP \
+  $JIT_FLAGS \
   -DWAMR_BUILD_AOT=1 \
+  -DWAMR_BUILD_SIMD=1 \
   -DWAMR_BUILD_LIBC_BUILTIN=1 \
   -DBUILD_SHARED_LIBS=OFF
 
-make -j$(sysctl -n hw.ncpu)
+make -j$NPROC
 
 # Copy the static library to the build directory using absolute path
 mkdir -p "${PROJECT_ROOT}/build"
 cp libiwasm.a "${PROJECT_ROOT}/build/libwamr_aot.a"
 
-echo "✓ Built WAMR AOT runtime library"
\ No newline at end of file
+echo "✓ Built WAMR AOT runtime library for $PLATFORM ($TARGET)"
\ No newline at end of file
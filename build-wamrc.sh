@@ -1,6 +1,15 @@
 #!/bin/bash
 
-# Build wamrc AOT compiler for macOS
+# Pick the WAMR platform for the host
+if [ "$(uname)" = "Darwin" ]; then
+    PLATFORM=darwin
+    NPROC=$(sysctl -n hw.ncpu)
+else
+    PLATFORM=linux
+    NPROC=$(nproc)
+fi
+
+# Build wamrc AOT compiler
 cd include/wamr/wamr-compiler
 
 # Build LLVM components if needed
@@ -12,7 +21,7 @@ fi
 # Build wamrc
 mkdir -p build
 cd build
-cmake .. -DWAMR_BUILD_PLATFORM=darwin
-make -j$(sysctl -n hw.ncpu)
+cmake .. -DWAMR_BUILD_PLATFORM=$PLATFORM
+make -j$NPROC
 
 echo "✓ Built wamrc AOT compiler"
\ No newline at end of file
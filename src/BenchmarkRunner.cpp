@@ -0,0 +1,184 @@
+#include "BenchmarkRunner.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+#if defined (__linux__)
+ #include <pthread.h>
+ #include <sched.h>
+#endif
+
+namespace
+{
+    // Pins the calling thread to one core while it exists, then restores
+    // its previous affinity. macOS has no hard affinity, so it doesn't pin
+    struct CpuPin
+    {
+        explicit CpuPin (int requested)
+        {
+           #if defined (__linux__)
+            if (pthread_getaffinity_np (pthread_self(), sizeof (previous), &previous) != 0)
+                return;
+
+            int target = requested >= 0 ? requested : sched_getcpu();
+            if (target < 0 || target >= CPU_SETSIZE)
+                return;
+
+            cpu_set_t set;
+            CPU_ZERO (&set);
+            CPU_SET (target, &set);
+            if (pthread_setaffinity_np (pthread_self(), sizeof (set), &set) == 0)
+                cpu = target;
+           #else
+            (void) requested;
+           #endif
+        }
+
+        ~CpuPin()
+        {
+           #if defined (__linux__)
+            if (cpu >= 0)
+                pthread_setaffinity_np (pthread_self(), sizeof (previous), &previous);
+           #endif
+        }
+
+        int cpu = -1;
+       #if defined (__linux__)
+        cpu_set_t previous;
+       #endif
+    };
+
+    double median (std::vector<double> values)
+    {
+        auto middle = values.begin() + (std::ptrdiff_t) (values.size() / 2);
+        std::nth_element (values.begin(), middle, values.end());
+        if (values.size() % 2 != 0)
+            return *middle;
+        return (*middle + *std::max_element (values.begin(), middle)) / 2.0;
+    }
+
+    // Iterations of the calibration are capped so a body the compiler
+    // reduced to nothing can't loop for ever
+    constexpr uint64_t maxIterations = uint64_t (1) << 30;
+
+    // Samples between convergence checks once minSamples are in
+    constexpr int checkInterval = 5;
+}
+
+void BenchmarkRunner::add (std::string name, double unitsPerIteration, std::function<void()> body)
+{
+    Case benchmark;
+    benchmark.name = std::move (name);
+    benchmark.units = unitsPerIteration;
+    benchmark.body = std::move (body);
+    cases.push_back (std::move (benchmark));
+}
+
+double BenchmarkRunner::timeIterations (const std::function<void()>& body, uint64_t iterations) const
+{
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; ++i)
+        body();
+    return std::chrono::duration<double, std::nano> (std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t BenchmarkRunner::calibrate (const std::function<void()>& body) const
+{
+    uint64_t iterations = 1;
+    while (iterations < maxIterations && timeIterations (body, iterations) < config.minSampleSeconds * 1.0e9)
+        iterations *= 2;
+    return iterations;
+}
+
+void BenchmarkRunner::summarize (Case& benchmark, uint32_t seed) const
+{
+    auto& samples = benchmark.nsPerUnit;
+    auto& result = benchmark.result;
+    result.samples = (int) samples.size();
+    result.medianNs = median (samples);
+
+    // Percentile bootstrap: the medians of resamples drawn with replacement
+    std::mt19937 random (seed);
+    std::uniform_int_distribution<size_t> pick (0, samples.size() - 1);
+    std::vector<double> medians ((size_t) config.bootstrapResamples), resample (samples.size());
+    for (auto& m : medians)
+    {
+        for (auto& value : resample)
+            value = samples[pick (random)];
+        m = median (resample);
+    }
+    std::sort (medians.begin(), medians.end());
+
+    double tail = (1.0 - config.confidence) / 2.0;
+    auto last = (double) (medians.size() - 1);
+    result.lowNs = medians[(size_t) std::floor (tail * last)];
+    result.highNs = medians[(size_t) std::ceil ((1.0 - tail) * last)];
+    result.relativeError = result.medianNs > 0.0 ? (result.highNs - result.lowNs) / 2.0 / result.medianNs : 0.0;
+    result.converged = result.relativeError <= config.targetRelativeError;
+}
+
+std::vector<BenchmarkResult> BenchmarkRunner::run (const std::atomic<bool>* cancel)
+{
+    CpuPin pin (config.cpu);
+    pinnedCpu = pin.cpu;
+    auto cancelled = [cancel] { return cancel != nullptr && cancel->load (std::memory_order_relaxed); };
+
+    // What the loop, the call through std::function and the clock cost on
+    // their own, subtracted from every sample
+    std::function<void()> empty = [] {};
+    auto emptyIterations = calibrate (empty);
+    std::vector<double> overhead;
+    for (int i = 0; i < config.minSamples; ++i)
+        overhead.push_back (timeIterations (empty, emptyIterations) / (double) emptyIterations);
+    overheadNs = median (overhead);
+
+    for (auto& benchmark : cases)
+    {
+        for (int i = 0; i < config.warmupIterations; ++i)
+            benchmark.body();
+        benchmark.iterations = calibrate (benchmark.body);
+        benchmark.nsPerUnit.clear();
+        benchmark.result = {};
+        benchmark.result.name = benchmark.name;
+        benchmark.result.iterationsPerSample = benchmark.iterations;
+    }
+
+    // A fixed seed keeps the order, and so any residual bias, the same run to run
+    std::mt19937 random (1);
+    std::vector<size_t> order (cases.size());
+    std::iota (order.begin(), order.end(), size_t (0));
+
+    for (int round = 0; round < config.maxSamples && ! cancelled(); ++round)
+    {
+        std::shuffle (order.begin(), order.end(), random);
+        bool pending = false;
+        for (auto index : order)
+        {
+            auto& benchmark = cases[index];
+            if (benchmark.result.converged)
+                continue;
+
+            pending = true;
+            double ns = timeIterations (benchmark.body, benchmark.iterations) / (double) benchmark.iterations;
+            benchmark.nsPerUnit.push_back (std::max (0.0, ns - overheadNs) / benchmark.units);
+
+            int count = (int) benchmark.nsPerUnit.size();
+            if (count >= config.minSamples && (count - config.minSamples) % checkInterval == 0)
+                summarize (benchmark, (uint32_t) (index + 1));
+        }
+        if (! pending)
+            break;
+    }
+
+    std::vector<BenchmarkResult> results;
+    for (size_t i = 0; i < cases.size(); ++i)
+    {
+        auto& benchmark = cases[i];
+        if (! benchmark.result.converged && ! benchmark.nsPerUnit.empty())
+            summarize (benchmark, (uint32_t) (i + 1));
+        results.push_back (benchmark.result);
+    }
+    return results;
+}
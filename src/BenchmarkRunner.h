@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct BenchmarkConfig
+{
+    int cpu = -1;                      // Core to pin the measuring thread to; -1 = the one run() starts on
+    int warmupIterations = 100;        // Untimed iterations of each case before it is calibrated
+    double minSampleSeconds = 0.002;   // Each sample runs enough iterations to take at least this long
+    int minSamples = 10;
+    int maxSamples = 100;
+    double targetRelativeError = 0.01; // Confidence interval half-width over the median
+    double confidence = 0.95;
+    int bootstrapResamples = 1000;
+};
+
+struct BenchmarkResult
+{
+    std::string name;
+    double medianNs = 0.0;  // Per unit of work, timing loop overhead subtracted
+    double lowNs = 0.0;     // Bootstrap confidence interval of the median
+    double highNs = 0.0;
+    double relativeError = 0.0;
+    int samples = 0;
+    uint64_t iterationsPerSample = 0;
+    bool converged = false;  // Reached the target relative error within maxSamples
+};
+
+//==============================================================================
+// Repeated, interleaved timing of a set of cases.
+//
+// run() pins the calling thread to one core, measures what the timing loop
+// costs with an empty body, then warms up each case and calibrates how many
+// iterations make one sample. Samples are taken in rounds, one per case in
+// a shuffled order each round, so frequency and thermal drift spread over
+// every case instead of favouring the first. A case stops once the
+// bootstrap confidence interval of its median is within the target relative
+// error. Everything runs on the calling thread.
+class BenchmarkRunner
+{
+public:
+    explicit BenchmarkRunner (BenchmarkConfig configToUse = {}) : config (configToUse) {}
+
+    // One call of body does unitsPerIteration units of work (e.g. samples);
+    // results are per unit
+    void add (std::string name, double unitsPerIteration, std::function<void()> body);
+
+    // Measure every case. A set cancel stops it after the current sample,
+    // reporting what was measured so far
+    std::vector<BenchmarkResult> run (const std::atomic<bool>* cancel = nullptr);
+
+    // Of the last run: the core it was pinned to (-1 if pinning isn't
+    // supported here or failed) and the subtracted overhead per iteration
+    int getPinnedCpu() const { return pinnedCpu; }
+    double getOverheadNs() const { return overheadNs; }
+
+private:
+    struct Case
+    {
+        std::string name;
+        double units;
+        std::function<void()> body;
+        uint64_t iterations = 1;
+        std::vector<double> nsPerUnit;  // One per sample
+        BenchmarkResult result;
+    };
+
+    double timeIterations (const std::function<void()>& body, uint64_t iterations) const;
+    uint64_t calibrate (const std::function<void()>& body) const;
+    void summarize (Case& benchmark, uint32_t seed) const;
+
+    BenchmarkConfig config;
+    std::vector<Case> cases;
+    int pinnedCpu = -1;
+    double overheadNs = 0.0;
+};
@@ -0,0 +1,928 @@
+#include "DspEngine.h"
+#include "wamr_aot_compiler.h"
+#include "wamr_aot_wrapper.h"
+#include "wasm2c_static.h"
+#include "wasm2c_wrapper.h"
+#include "wasmi_wrapper.h"
+#include "module_aot.h"        // Generated AOT bytecode header
+#include "module_wasm.h"       // Generated WASM bytecode header
+#include "module_simd_aot.h"   // Generated AOT bytecode header, SIMD build
+#include "module_simd_wasm.h"  // Generated WASM bytecode header, SIMD build
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert (DspEngine::maxChannels == WASM_MODULE_MAX_CHANNELS, "DspEngine::maxChannels must match the module ABI");
+static_assert (numKernels == WASM_KERNEL_COUNT, "DspKernel must match WasmModuleKernel");
+static_assert (numModuleParams == WASM_PARAM_COUNT && numModuleParams <= WASM_MODULE_MAX_PARAMS,
+               "ModuleParam must match WasmModuleParam");
+static_assert (DspEngine::maxMidiEvents == WASM_MODULE_MAX_EVENTS, "DspEngine::maxMidiEvents must match the module ABI");
+static_assert (DspEngine::defaultSampleRate == WASM_MODULE_DEFAULT_SAMPLE_RATE,
+               "DspEngine::defaultSampleRate must match the module ABI");
+static_assert (sizeof (MidiEvent) == sizeof (WasmMidiEvent) && offsetof (MidiEvent, status) == offsetof (WasmMidiEvent, status),
+               "MidiEvent must match WasmMidiEvent");
+static_assert (MemoryConfig{}.heapBytes == WAMR_DEFAULT_HEAP_SIZE && MemoryConfig{}.stackBytes == WAMR_DEFAULT_STACK_SIZE,
+               "MemoryConfig defaults must match the WAMR wrapper's");
+
+namespace
+{
+    // Counters have a single writer, so a relaxed load/store pair is enough
+    void increment (std::atomic<uint64_t>& counter, uint64_t amount = 1)
+    {
+        counter.store (counter.load (std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    //==========================================================================
+    // Compiler settings for runtime AOT compilation. SIMD is always enabled:
+    // scalar modules don't use it and SIMD modules need it
+    constexpr WamrCompileOptions compileOptions { 3, 3, true };
+
+    // 64-bit FNV-1a; the cache only needs to tell modules apart, not resist
+    // deliberate collisions
+    uint64_t hashBytes (const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+    {
+        auto* bytes = static_cast<const uint8_t*> (data);
+        for (size_t i = 0; i < size; ++i)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        return hash;
+    }
+
+    std::string toHex (uint64_t value)
+    {
+        char text[17];
+        std::snprintf (text, sizeof (text), "%016llx", (unsigned long long) value);
+        return text;
+    }
+
+    bool isWasmBinary (const uint8_t* bytes, size_t size)
+    {
+        return size >= 4 && std::memcmp (bytes, "\0asm", 4) == 0;
+    }
+
+    std::string defaultAotCacheDirectory()
+    {
+        const char* home = std::getenv ("HOME");
+       #if defined (__APPLE__)
+        return home != nullptr ? std::string (home) + "/Library/Caches/wasm-dsp/aot" : std::string();
+       #else
+        if (const char* cache = std::getenv ("XDG_CACHE_HOME"); cache != nullptr && *cache != '\0')
+            return std::string (cache) + "/wasm-dsp/aot";
+        return home != nullptr ? std::string (home) + "/.cache/wasm-dsp/aot" : std::string();
+       #endif
+    }
+
+    std::mutex aotCacheLock;
+    std::string aotCacheDirectory = defaultAotCacheDirectory();
+
+    // mkdir -p
+    bool createDirectories (const std::string& path)
+    {
+        for (size_t slash = path.find ('/', 1); ; slash = path.find ('/', slash + 1))
+        {
+            auto prefix = path.substr (0, slash);
+            struct stat info;
+            if (mkdir (prefix.c_str(), 0755) != 0 && (stat (prefix.c_str(), &info) != 0 || ! S_ISDIR (info.st_mode)))
+                return false;
+            if (slash == std::string::npos)
+                return true;
+        }
+    }
+
+    // Write through a temporary file and rename it into place, so a reader
+    // (possibly another plugin process) never maps a half-written image
+    void writeCacheFile (const std::string& path, const uint8_t* bytes, uint32_t size)
+    {
+        auto directory = path.substr (0, path.rfind ('/'));
+        if (! createDirectories (directory))
+            return;
+
+        auto temporary = path + ".tmp" + std::to_string ((long) getpid());
+        std::FILE* file = std::fopen (temporary.c_str(), "wb");
+        if (file == nullptr)
+            return;
+
+        bool ok = std::fwrite (bytes, 1, size, file) == size;
+        ok = std::fclose (file) == 0 && ok;
+        if (! ok || std::rename (temporary.c_str(), path.c_str()) != 0)
+            std::remove (temporary.c_str());
+    }
+
+    // WAMR execution tier behind each WAMR engine type
+    WamrTier getWamrTier (EngineType type)
+    {
+        switch (type)
+        {
+            case EngineType::WAMRClassicInterp:
+            case EngineType::WAMRFastInterp:   return WAMR_TIER_INTERP;
+            case EngineType::WAMRFastJit:      return WAMR_TIER_FAST_JIT;
+            case EngineType::WAMRLlvmJit:      return WAMR_TIER_LLVM_JIT;
+            case EngineType::WAMRMultiTierJit: return WAMR_TIER_MULTI_TIER_JIT;
+            default:                           return WAMR_TIER_AOT;
+        }
+    }
+
+    bool isWamrEngine (EngineType type)
+    {
+        return isAotEngine (type) || getWamrTier (type) != WAMR_TIER_AOT;
+    }
+
+    //==========================================================================
+    // Every WAMR tier. For AOT the lean call path is the default; the checked
+    // one keeps the original per-call checks so the benchmark can show what
+    // the wrapper costs
+    class WamrDspEngine final : public DspEngine
+    {
+    public:
+        WamrDspEngine (WamrAotEngine* e, EngineType t) : engine (e), type (t), checked (t == EngineType::WAMRChecked) {}
+        ~WamrDspEngine() override { wamr_aot_engine_delete (engine); }
+
+        EngineType getType() const override { return type; }
+        const char* getName() const override { return getEngineName (getType()); }
+
+        void drainDiagnostics (const std::function<void (const char*)>& log) override
+        {
+            WamrDiagnostic diagnostic;
+            while (wamr_aot_engine_pop_diagnostic (engine, &diagnostic))
+                log (diagnostic.message);
+        }
+
+        AotSource getAotSource() const override { return source; }
+
+    protected:
+        bool loadModule (const uint8_t* bytes, size_t size) override
+        {
+            wamr_aot_engine_set_memory_config (engine, getMemoryConfig().heapBytes, getMemoryConfig().stackBytes);
+
+            // Only the AOT tier compiles bytecode; the others run it as is
+            if (engine->tier == WAMR_TIER_AOT && isWasmBinary (bytes, size))
+                return loadCompiled (bytes, size);
+
+            if (engine->tier == WAMR_TIER_AOT)
+                source = AotSource::Prebuilt;
+            return wamr_aot_engine_load_module (engine, bytes, (uint32_t) size) == WAMR_LOAD_OK;
+        }
+
+        std::unique_ptr<DspEngine> newInstance() override
+        {
+            if (auto* instance = wamr_aot_engine_new_instance (engine))
+                return std::make_unique<WamrDspEngine> (instance, type);
+            return nullptr;
+        }
+
+        bool processBlock (const float* const* input, float* const* output, int numChannels, int numSamples) override
+        {
+            if (checked)
+                return wamr_aot_engine_process_block (engine, input, output, (uint32_t) numChannels, (uint32_t) numSamples);
+
+            return wamr_aot_engine_process_block_lean (engine, input, output, (uint32_t) numChannels, (uint32_t) numSamples);
+        }
+
+        bool processPerSample (const float* const* input, float* const* output, int numChannels, int numSamples) override
+        {
+            if (! wamr_aot_engine_set_num_channels (engine, (uint32_t) numChannels))
+                return false;
+
+            // A trapped call fails the block, as it does on the block path
+            bool trapped = false;
+            for (int i = 0; i < numSamples; ++i)
+            {
+                if (checked)
+                {
+                    for (int ch = 0; ch < numChannels; ++ch)
+                        output[ch][i] = wamr_aot_engine_get_sample (engine, (uint32_t) ch, input[ch][i], &trapped);
+                    continue;
+                }
+
+                for (int ch = 0; ch < numChannels; ++ch)
+                    output[ch][i] = wamr_aot_engine_get_sample_lean (engine, (uint32_t) ch, input[ch][i], &trapped);
+            }
+            return ! trapped;
+        }
+
+        bool resetInstance() override
+        {
+            wamr_aot_engine_set_memory_config (engine, getMemoryConfig().heapBytes, getMemoryConfig().stackBytes);
+            return wamr_aot_engine_reset (engine);
+        }
+
+        ResetKind restoreSnapshot() override
+        {
+            // A new heap or stack size only takes effect through a new instance
+            if (engine->heap_size != getMemoryConfig().heapBytes || engine->stack_size != getMemoryConfig().stackBytes)
+                return ResetKind::None;
+            return (ResetKind) wamr_aot_engine_restore (engine);
+        }
+
+        bool selectKernel (int kernel) override { return wamr_aot_engine_set_kernel (engine, kernel); }
+        bool writeSampleRate (int rate) override { return wamr_aot_engine_set_sample_rate (engine, rate); }
+
+        bool writeParams (const float* values, int count) override
+        {
+            return wamr_aot_engine_set_params (engine, values, (uint32_t) count);
+        }
+
+        bool writeEvents (const MidiEvent* events, int count) override
+        {
+            return wamr_aot_engine_set_events (engine, reinterpret_cast<const WasmMidiEvent*> (events), (uint32_t) count);
+        }
+
+        EngineMemory getRuntimeMemory() override
+        {
+            EngineMemory memory;
+            memory.runtimeBytes = engine->instance_bytes;
+            memory.linearMemoryBytes = wamr_aot_engine_linear_memory_size (engine);
+            memory.heapBytes = engine->instance != nullptr ? engine->heap_size : 0;
+            memory.codeBytes = wamr_aot_engine_code_size (engine);
+            wamr_aot_runtime_allocated_bytes (&memory.poolBytes, &memory.poolPeakBytes);
+            return memory;
+        }
+
+        int queryModuleMemory (int query) override { return wamr_aot_engine_memory_info (engine, query); }
+
+    private:
+        // Map the image an earlier load cached for these bytes, or compile
+        // them and cache the result
+        bool loadCompiled (const uint8_t* bytes, size_t size)
+        {
+            auto path = getAotCachePath (bytes, size);
+            if (! path.empty())
+            {
+                switch (wamr_aot_engine_load_file (engine, path.c_str()))
+                {
+                    case WAMR_LOAD_OK:
+                        source = AotSource::Cached;
+                        return true;
+
+                    // A fresh image of the same bytes would fail just the same
+                    case WAMR_LOAD_INSTANTIATE_FAILED:
+                        return false;
+
+                    case WAMR_LOAD_MODULE_FAILED:
+                        std::remove (path.c_str());  // Missing, or stale/corrupt
+                        break;
+                }
+            }
+
+            uint32_t aotSize = 0;
+            char error[256];
+            uint8_t* aot = wamr_aot_compile (bytes, (uint32_t) size, &compileOptions, &aotSize, error, sizeof (error));
+            if (aot == nullptr)
+            {
+                std::fprintf (stderr, "ERROR: Failed to compile wasm to WAMR AOT: %s\n", error);
+                return false;
+            }
+
+            if (! path.empty())
+                writeCacheFile (path, aot, aotSize);
+
+            source = AotSource::Compiled;
+            bool ok = wamr_aot_engine_load_module (engine, aot, aotSize) == WAMR_LOAD_OK;
+            wamr_aot_compiler_free (aot);
+            return ok;
+        }
+
+        WamrAotEngine* engine;
+        EngineType type;
+        bool checked;
+        AotSource source = AotSource::None;
+    };
+
+    //==========================================================================
+    // Every wasm2c variant but the static one: they differ only in the
+    // generated module they run and where its memory lives
+    class Wasm2cDspEngine final : public DspEngine
+    {
+    public:
+        Wasm2cDspEngine (Wasm2cEngine* e, EngineType t) : engine (e), type (t) {}
+        ~Wasm2cDspEngine() override { wasm2c_engine_delete (engine); }
+
+        EngineType getType() const override { return type; }
+        const char* getName() const override { return getEngineName (type); }
+
+    protected:
+        // The wasm2c module is compiled in and instantiated on creation
+        bool loadModule (const uint8_t*, size_t) override { return true; }
+
+        std::unique_ptr<DspEngine> newInstance() override
+        {
+            if (auto* instance = wasm2c_engine_new (engine->api, engine->guard_pages))
+                return std::make_unique<Wasm2cDspEngine> (instance, type);
+            return nullptr;
+        }
+
+        bool processBlock (const float* const* input, float* const* output, int numChannels, int numSamples) override
+        {
+            return wasm2c_engine_process_block (engine, input, output, (uint32_t) numChannels, (uint32_t) numSamples);
+        }
+
+        bool processPerSample (const float* const* input, float* const* output, int numChannels, int numSamples) override
+        {
+            return wasm2c_engine_process_per_sample (engine, input, output, (uint32_t) numChannels, (uint32_t) numSamples);
+        }
+
+        bool resetInstance() override { return wasm2c_engine_reset (engine); }
+        ResetKind restoreSnapshot() override { return (ResetKind) wasm2c_engine_restore (engine); }
+        bool selectKernel (int kernel) override { return wasm2c_engine_set_kernel (engine, kernel); }
+        bool writeSampleRate (int rate) override { return wasm2c_engine_set_sample_rate (engine, rate); }
+
+        bool writeParams (const float* values, int count) override
+        {
+            return wasm2c_engine_set_params (engine, values, (uint32_t) count);
+        }
+
+        bool writeEvents (const MidiEvent* events, int count) override
+        {
+            return wasm2c_engine_set_events (engine, reinterpret_cast<const WasmMidiEvent*> (events), (uint32_t) count);
+        }
+
+        EngineMemory getRuntimeMemory() override
+        {
+            // The instance struct is all the runtime adds; a guard-page
+            // reservation is address space, not memory
+            EngineMemory memory;
+            memory.runtimeBytes = engine->api->instance_size;
+            memory.linearMemoryBytes = wasm2c_engine_linear_memory_size (engine);
+            return memory;
+        }
+
+        int queryModuleMemory (int query) override { return wasm2c_engine_memory_info (engine, query); }
+
+    private:
+        Wasm2cEngine* engine;
+        EngineType type;
+    };
+
+    //==========================================================================
+    // Holds the process's one static wasm2c instance while it exists
+    class Wasm2cStaticDspEngine final : public DspEngine
+    {
+    public:
+        ~Wasm2cStaticDspEngine() override { wasm2c_static_engine_release(); }
+
+        EngineType getType() const override { return EngineType::Wasm2cStatic; }
+        const char* getName() const override { return getEngineName (EngineType::Wasm2cStatic); }
+
+    protected:
+        bool loadModule (const uint8_t*, size_t) override { return true; }
+
+        // The instance is static, so there can't be another
+        std::unique_ptr<DspEngine> newInstance() override { return nullptr; }
+
+        bool processBlock (const float* const* input, float* const* output, int numChannels, int numSamples) override
+        {
+            return wasm2c_static_engine_process_block (input, output, (uint32_t) numChannels, (uint32_t) numSamples);
+        }
+
+        bool processPerSample (const float* const* input, float* const* output, int numChannels, int numSamples) override
+        {
+            return wasm2c_static_engine_process_per_sample (input, output, (uint32_t) numChannels, (uint32_t) numSamples);
+        }
+
+        bool resetInstance() override { return wasm2c_static_engine_reset(); }
+        ResetKind restoreSnapshot() override { return (ResetKind) wasm2c_static_engine_restore(); }
+        bool selectKernel (int kernel) override { return wasm2c_static_engine_set_kernel (kernel); }
+        bool writeSampleRate (int rate) override { return wasm2c_static_engine_set_sample_rate (rate); }
+
+        bool writeParams (const float* values, int count) override
+        {
+            return wasm2c_static_engine_set_params (values, (uint32_t) count);
+        }
+
+        bool writeEvents (const MidiEvent* events, int count) override
+        {
+            return wasm2c_static_engine_set_events (reinterpret_cast<const WasmMidiEvent*> (events), (uint32_t) count);
+        }
+
+        EngineMemory getRuntimeMemory() override
+        {
+            EngineMemory memory;
+            memory.runtimeBytes = wasm2c_static_engine_instance_size();
+            memory.linearMemoryBytes = wasm2c_static_engine_linear_memory_size();
+            return memory;
+        }
+
+        int queryModuleMemory (int query) override { return wasm2c_static_engine_memory_info (query); }
+    };
+
+    //==========================================================================
+    class WasmiDspEngine final : public DspEngine
+    {
+    public:
+        explicit WasmiDspEngine (WasmiInterpEngine* e) : engine (e) {}
+        ~WasmiDspEngine() override { wasmi_interp_engine_delete (engine); }
+
+        EngineType getType() const override { return EngineType::Wasmi; }
+        const char* getName() const override { return getEngineName (EngineType::Wasmi); }
+
+        void drainDiagnostics (const std::function<void (const char*)>& log) override
+        {
+            const char* lastExport = nullptr;
+            if (auto count = wasmi_interp_engine_take_failures (engine, &lastExport))
+                log ((std::to_string (count) + " wasmi call(s) trapped, last in " + lastExport).c_str());
+        }
+
+    protected:
+        bool loadModule (const uint8_t* bytes, size_t size) override
+        {
+            return wasmi_interp_engine_load_module (engine, bytes, size);
+        }
+
+        std::unique_ptr<DspEngine> newInstance() override
+        {
+            if (auto* instance = wasmi_interp_engine_new_instance (engine))
+                return std::make_unique<WasmiDspEngine> (instance);
+            return nullptr;
+        }
+
+        bool processBlock (const float* const* input, float* const* output, int numChannels, int numSamples) override
+        {
+            return wasmi_interp_engine_process_block (engine, input, output, (uint32_t) numChannels, (uint32_t) numSamples);
+        }
+
+        bool processPerSample (const float* const* input, float* const* output, int numChannels, int numSamples) override
+        {
+            if (! wasmi_interp_engine_set_num_channels (engine, (uint32_t) numChannels))
+                return false;
+
+            bool trapped = false;
+            for (int i = 0; i < numSamples; ++i)
+                for (int ch = 0; ch < numChannels; ++ch)
+                    output[ch][i] = wasmi_interp_engine_get_sample (engine, (uint32_t) ch, input[ch][i], &trapped);
+            return ! trapped;
+        }
+
+        bool resetInstance() override { return wasmi_interp_engine_reset (engine); }
+        ResetKind restoreSnapshot() override { return (ResetKind) wasmi_interp_engine_restore (engine); }
+        bool selectKernel (int kernel) override { return wasmi_interp_engine_set_kernel (engine, kernel); }
+        bool writeSampleRate (int rate) override { return wasmi_interp_engine_set_sample_rate (engine, rate); }
+
+        bool writeParams (const float* values, int count) override
+        {
+            return wasmi_interp_engine_set_params (engine, values, (uint32_t) count);
+        }
+
+        bool writeEvents (const MidiEvent* events, int count) override
+        {
+            return wasmi_interp_engine_set_events (engine, reinterpret_cast<const WasmMidiEvent*> (events), (uint32_t) count);
+        }
+
+        EngineMemory getRuntimeMemory() override
+        {
+            EngineMemory memory;
+            memory.runtimeBytes = engine->instance_bytes;
+            memory.linearMemoryBytes = wasmi_interp_engine_linear_memory_size (engine);
+            memory.codeBytes = wasmi_interp_engine_code_size (engine);
+            wasmi_interp_allocated_bytes (&memory.poolBytes, &memory.poolPeakBytes);
+            return memory;
+        }
+
+        int queryModuleMemory (int query) override { return wasmi_interp_engine_memory_info (engine, query); }
+
+    private:
+        WasmiInterpEngine* engine;
+    };
+}
+
+//==============================================================================
+bool DspEngine::load (const uint8_t* bytes, size_t size)
+{
+    moduleLabel.clear();
+    auto start = std::chrono::steady_clock::now();
+    bool ok = loadModule (bytes, size);
+    auto end = std::chrono::steady_clock::now();
+
+    // A fresh instance starts on the module's defaults
+    if (ok)
+    {
+        writeParams (params.data(), numModuleParams);
+        if (getSampleRate() != defaultSampleRate)
+            writeSampleRate (getSampleRate());
+    }
+
+    loadTimeUs.store (std::chrono::duration_cast<std::chrono::microseconds> (end - start).count(),
+                      std::memory_order_relaxed);
+    return ok;
+}
+
+std::unique_ptr<DspEngine> DspEngine::createInstance (const std::array<float, numModuleParams>& initialParams)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto instance = newInstance();
+    auto end = std::chrono::steady_clock::now();
+
+    if (instance != nullptr)
+    {
+        // Instances share compiled code but not state, so the kernel is
+        // selected afresh
+        if (kernel != DspKernel::Gain && ! instance->setKernel (kernel))
+            return nullptr;
+
+        auto rate = getSampleRate();
+        if (rate != defaultSampleRate && ! instance->setSampleRate (rate))
+            return nullptr;
+
+        instance->variant = variant;
+        instance->moduleLabel = moduleLabel;
+        instance->memoryConfig = memoryConfig;
+        instance->params = initialParams;
+        instance->writeParams (initialParams.data(), numModuleParams);
+        instance->loadTimeUs.store (std::chrono::duration_cast<std::chrono::microseconds> (end - start).count(),
+                                    std::memory_order_relaxed);
+    }
+    return instance;
+}
+
+bool DspEngine::loadBuiltinModule()
+{
+    auto module = getBuiltinModule (getType(), variant);
+    return load (module.data, module.size);
+}
+
+bool DspEngine::loadAotVariant (const std::string& directory, const std::string& label)
+{
+    if (! isAotEngine (getType()))
+        return false;
+
+    auto path = directory + (variant == ModuleVariant::Simd ? "/module_simd-" : "/module-") + label + ".aot";
+    std::ifstream file (path, std::ios::binary);
+    std::vector<uint8_t> bytes { std::istreambuf_iterator<char> (file), std::istreambuf_iterator<char>() };
+    if (bytes.empty() || ! load (bytes.data(), bytes.size()))
+        return false;
+
+    moduleLabel = label;
+    return true;
+}
+
+bool DspEngine::render (const float* const* input, float* const* output, int numChannels, int numSamples,
+                        ProcessMode mode)
+{
+    if (numChannels <= 0 || numChannels > maxChannels)
+        return false;
+
+    return mode == ProcessMode::Block ? processBlock (input, output, numChannels, numSamples)
+                                      : processPerSample (input, output, numChannels, numSamples);
+}
+
+void DspEngine::countBlock (int numChannels, int numSamples, bool ok)
+{
+    increment (blocksProcessed);
+    increment (samplesProcessed, (uint64_t) numSamples * (uint64_t) std::max (numChannels, 0));
+    if (! ok)
+        increment (failedBlocks);
+}
+
+bool DspEngine::process (const float* const* input, float* const* output, int numChannels, int numSamples,
+                         ProcessMode mode)
+{
+    bool ok = render (input, output, numChannels, numSamples, mode);
+    countBlock (numChannels, numSamples, ok);
+    return ok;
+}
+
+void DspEngine::applyChange (const ParamChange& change)
+{
+    if (change.param >= ModuleParam::Gain && (int) change.param < numModuleParams)
+        params[(size_t) change.param] = change.value;
+}
+
+bool DspEngine::process (const float* const* input, float* const* output, int numChannels, int numSamples,
+                         const ParamChange* changes, int numChanges, ParamUpdateMode updateMode, ProcessMode mode)
+{
+    if (updateMode == ParamUpdateMode::PerBlock || numChanges == 0)
+    {
+        for (int i = 0; i < numChanges; ++i)
+            applyChange (changes[i]);
+        if (numChanges > 0)
+            writeParams (params.data(), numModuleParams);
+        return process (input, output, numChannels, numSamples, mode);
+    }
+
+    bool ok = numChannels > 0 && numChannels <= maxChannels;
+    const float* in[maxChannels];
+    float* out[maxChannels];
+    int next = 0;
+    for (int start = 0; ok && start < numSamples; )
+    {
+        // Everything due by this sample goes in with one write
+        if (next < numChanges && changes[next].sampleOffset <= start)
+        {
+            while (next < numChanges && changes[next].sampleOffset <= start)
+                applyChange (changes[next++]);
+            writeParams (params.data(), numModuleParams);
+        }
+
+        int end = next < numChanges ? std::min (changes[next].sampleOffset, numSamples) : numSamples;
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            in[ch] = input[ch] + start;
+            out[ch] = output[ch] + start;
+        }
+        ok = render (in, out, numChannels, end - start, mode);
+        start = end;
+    }
+
+    // Changes past the end of the block apply from the next one
+    if (next < numChanges)
+    {
+        while (next < numChanges)
+            applyChange (changes[next++]);
+        writeParams (params.data(), numModuleParams);
+    }
+
+    countBlock (numChannels, numSamples, ok);
+    return ok;
+}
+
+bool DspEngine::queueMidi (const MidiEvent* events, int numEvents)
+{
+    return writeEvents (events, std::min (numEvents, maxMidiEvents)) && numEvents <= maxMidiEvents;
+}
+
+void DspEngine::setParam (ModuleParam param, float value)
+{
+    applyChange ({ 0, param, value });
+    writeParams (params.data(), numModuleParams);
+}
+
+float DspEngine::getDefaultParam (ModuleParam param)
+{
+    switch (param)
+    {
+        case ModuleParam::Gain: return 0.0f;
+        case ModuleParam::Mix:  return 1.0f;
+        case ModuleParam::Tone: return 20000.0f;
+    }
+    return 0.0f;
+}
+
+bool DspEngine::reset (bool reinstantiate)
+{
+    increment (resets);
+    auto failed = failedBlocks.load (std::memory_order_relaxed);
+    auto kind = reinstantiate || failed != failedBlocksAtReset ? ResetKind::None : restoreSnapshot();
+    failedBlocksAtReset = failed;
+    if (kind == ResetKind::None)
+    {
+        if (! resetInstance())
+            return false;
+        kind = ResetKind::Reinstantiated;
+    }
+    lastReset = kind;
+
+    // The parameters and sample rate outlive the instance
+    writeParams (params.data(), numModuleParams);
+    if (getSampleRate() != defaultSampleRate)
+        writeSampleRate (getSampleRate());
+
+    // A fresh instance starts on the gain kernel
+    return kernel == DspKernel::Gain || selectKernel ((int) kernel);
+}
+
+bool DspEngine::setKernel (DspKernel newKernel)
+{
+    if (! selectKernel ((int) newKernel))
+        return false;
+
+    kernel = newKernel;
+    return true;
+}
+
+bool DspEngine::setSampleRate (int rate)
+{
+    if (rate == getSampleRate())
+        return true;
+    if (! writeSampleRate (rate))
+        return false;
+
+    sampleRate.store (rate, std::memory_order_relaxed);
+    return true;
+}
+
+EngineMemory DspEngine::getMemoryUsage()
+{
+    auto memory = getRuntimeMemory();
+    int stackSize = queryModuleMemory (WASM_MEMORY_STACK_SIZE);
+    int stackHighWater = queryModuleMemory (WASM_MEMORY_STACK_HIGH_WATER);
+    memory.stackBytes = stackSize > 0 ? (size_t) stackSize : 0;
+    memory.stackHighWaterBytes = stackHighWater > 0 ? (size_t) stackHighWater : 0;
+    return memory;
+}
+
+bool DspEngine::canCompileAot()
+{
+    return wamr_aot_compiler_available();
+}
+
+void DspEngine::setAotCacheDirectory (const std::string& directory)
+{
+    std::lock_guard<std::mutex> lock (aotCacheLock);
+    aotCacheDirectory = directory;
+}
+
+std::string DspEngine::getAotCacheDirectory()
+{
+    std::lock_guard<std::mutex> lock (aotCacheLock);
+    return aotCacheDirectory;
+}
+
+std::string DspEngine::getAotCachePath (const uint8_t* wasmBytes, size_t size)
+{
+    auto directory = getAotCacheDirectory();
+    char target[1024];
+    if (directory.empty() || ! wamr_aot_compiler_host_target (target, sizeof (target)))
+        return {};
+
+    // Everything besides the module that changes the generated code
+    auto config = hashBytes (target, std::strlen (target));
+    config = hashBytes (&compileOptions.opt_level, sizeof (compileOptions.opt_level), config);
+    config = hashBytes (&compileOptions.size_level, sizeof (compileOptions.size_level), config);
+    config = hashBytes (&compileOptions.enable_simd, sizeof (compileOptions.enable_simd), config);
+
+    return directory + "/" + toHex (hashBytes (wasmBytes, size)) + "-" + toHex (config) + ".aot";
+}
+
+void DspEngine::attachCurrentThread()
+{
+    wamr_aot_engine_attach_thread();
+    wasm2c_engine_attach_thread();
+}
+
+EngineStats DspEngine::getStats() const
+{
+    EngineStats stats;
+    stats.loadTimeUs = loadTimeUs.load (std::memory_order_relaxed);
+    stats.blocksProcessed = blocksProcessed.load (std::memory_order_relaxed);
+    stats.samplesProcessed = samplesProcessed.load (std::memory_order_relaxed);
+    stats.failedBlocks = failedBlocks.load (std::memory_order_relaxed);
+    stats.resets = resets.load (std::memory_order_relaxed);
+    return stats;
+}
+
+std::unique_ptr<DspEngine> DspEngine::create (EngineType type, ModuleVariant variant)
+{
+    std::unique_ptr<DspEngine> result;
+    switch (type)
+    {
+        case EngineType::WAMR:
+        case EngineType::WAMRChecked:
+        case EngineType::WAMRClassicInterp:
+        case EngineType::WAMRFastInterp:
+        case EngineType::WAMRFastJit:
+        case EngineType::WAMRLlvmJit:
+        case EngineType::WAMRMultiTierJit:
+            if (! isEngineAvailable (type))
+                break;
+            if (auto* engine = wamr_aot_engine_new (getWamrTier (type)))
+                result = std::make_unique<WamrDspEngine> (engine, type);
+            break;
+        case EngineType::Wasm2c:
+        {
+            // wasm2c runs the module compiled into the binary, so the SIMD
+            // variant exists only if its generated C could be built
+           #if WASM2C_SIMD_MODULE
+            const Wasm2cModuleApi* api = variant == ModuleVariant::Simd ? &wasm2c_simd_module : &wasm2c_scalar_module;
+           #else
+            if (variant == ModuleVariant::Simd)
+                break;
+            const Wasm2cModuleApi* api = &wasm2c_scalar_module;
+           #endif
+            if (auto* engine = wasm2c_engine_new (api, false))
+                result = std::make_unique<Wasm2cDspEngine> (engine, type);
+            break;
+        }
+        case EngineType::Wasm2cGuardPages:
+        case EngineType::Wasm2cBoundsChecked:
+        case EngineType::Wasm2cUnchecked:
+        {
+            // Memory-check variants exist for the scalar module only
+            if (variant == ModuleVariant::Simd)
+                break;
+
+            const Wasm2cModuleApi* api = type == EngineType::Wasm2cBoundsChecked ? &wasm2c_bounds_module
+                                                                                : &wasm2c_unchecked_module;
+            if (auto* engine = wasm2c_engine_new (api, type == EngineType::Wasm2cGuardPages))
+                result = std::make_unique<Wasm2cDspEngine> (engine, type);
+            break;
+        }
+        case EngineType::Wasm2cStatic:
+            if (variant == ModuleVariant::Scalar && wasm2c_static_engine_acquire())
+                result = std::make_unique<Wasm2cStaticDspEngine>();
+            break;
+        case EngineType::Wasmi:
+            if (! isEngineAvailable (type))
+                break;
+            if (auto* engine = wasmi_interp_engine_new())
+                result = std::make_unique<WasmiDspEngine> (engine);
+            break;
+        case EngineType::Bypass:
+            break;
+    }
+
+    if (result != nullptr)
+        result->variant = variant;
+    return result;
+}
+
+const char* getEngineName (EngineType type)
+{
+    switch (type)
+    {
+        case EngineType::WAMR:   return "WAMR AOT";
+        case EngineType::Wasm2c: return "wasm2c";
+        case EngineType::Wasmi:  return "Wasmi";
+        case EngineType::WAMRChecked: return "WAMR AOT (checked calls)";
+        case EngineType::Wasm2cGuardPages:    return "wasm2c (guard pages)";
+        case EngineType::Wasm2cBoundsChecked: return "wasm2c (bounds checks)";
+        case EngineType::Wasm2cUnchecked:     return "wasm2c (no checks)";
+        case EngineType::Wasm2cStatic:        return "wasm2c (static instance)";
+        case EngineType::WAMRClassicInterp:   return "WAMR classic interpreter";
+        case EngineType::WAMRFastInterp:      return "WAMR fast interpreter";
+        case EngineType::WAMRFastJit:         return "WAMR Fast JIT";
+        case EngineType::WAMRLlvmJit:         return "WAMR LLVM JIT";
+        case EngineType::WAMRMultiTierJit:    return "WAMR multi-tier JIT";
+        case EngineType::Bypass: return "Bypass";
+    }
+    return "Unknown";
+}
+
+bool isAotEngine (EngineType type)
+{
+    return type == EngineType::WAMR || type == EngineType::WAMRChecked;
+}
+
+bool isEngineAvailable (EngineType type)
+{
+    if (type == EngineType::Bypass)
+        return false;
+    if (type == EngineType::Wasmi)
+        return wasmi_interp_supported();
+    if (! isWamrEngine (type))
+        return true;
+
+   #if WAMR_CLASSIC_INTERP
+    if (type == EngineType::WAMRFastInterp)
+        return false;
+   #else
+    if (type == EngineType::WAMRClassicInterp)
+        return false;
+   #endif
+    return wamr_aot_tier_supported (getWamrTier (type));
+}
+
+const char* getKernelName (DspKernel kernel)
+{
+    switch (kernel)
+    {
+        case DspKernel::Gain:           return "gain";
+        case DspKernel::Biquad:         return "biquad";
+        case DspKernel::Fir:            return "fir";
+        case DspKernel::Fft:            return "fft";
+        case DspKernel::OscillatorBank: return "oscillators";
+        case DspKernel::FdnReverb:      return "fdn";
+        case DspKernel::Waveshaper:     return "waveshaper";
+        case DspKernel::Synth:          return "synth";
+    }
+    return "unknown";
+}
+
+const char* getResetKindName (ResetKind kind)
+{
+    switch (kind)
+    {
+        case ResetKind::None:                return "none";
+        case ResetKind::SnapshotCopy:        return "snapshot-copy";
+        case ResetKind::SnapshotCopyOnWrite: return "snapshot-cow";
+        case ResetKind::Reinstantiated:      return "reinstantiate";
+    }
+    return "none";
+}
+
+const char* getVariantName (ModuleVariant variant)
+{
+    return variant == ModuleVariant::Simd ? "simd" : "scalar";
+}
+
+ModuleBytes getBuiltinModule (EngineType type, ModuleVariant variant)
+{
+    bool simd = variant == ModuleVariant::Simd;
+    if (isAotEngine (type))
+        return simd ? ModuleBytes { module_simd_aot, module_simd_aot_len } : ModuleBytes { module_aot, module_aot_len };
+
+    return getBuiltinWasmModule (variant);
+}
+
+ModuleBytes getBuiltinWasmModule (ModuleVariant variant)
+{
+    if (variant == ModuleVariant::Simd)
+        return { module_simd_wasm, module_simd_wasm_len };
+    return { module_wasm, module_wasm_len };
+}
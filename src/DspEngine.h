@@ -0,0 +1,380 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+enum class EngineType
+{
+    WAMR = 0,
+    Wasm2c,
+    Wasmi,
+    WAMRChecked,  // WAMR through the original checked/printf call path
+    Wasm2cGuardPages,    // wasm2c without inline memory checks, memory in a guard-page reservation
+    Wasm2cBoundsChecked, // wasm2c with an explicit bounds check on every memory access
+    Wasm2cUnchecked,     // wasm2c with neither
+    Wasm2cStatic,        // wasm2c compiled into the engine's translation unit, one static instance
+    WAMRClassicInterp,   // WAMR tiers running wasm bytecode. The runtime has one interpreter,
+    WAMRFastInterp,      // chosen at build time (WAMR_CLASSIC_INTERP), so only one of these two exists
+    WAMRFastJit,
+    WAMRLlvmJit,
+    WAMRMultiTierJit,    // Fast JIT first, tiering up to LLVM JIT in the background
+    Bypass
+};
+
+// Number of real engines (everything in EngineType before Bypass)
+constexpr int numEngineTypes = (int) EngineType::Bypass;
+
+// Build of the DSP module an engine runs: plain wasm, or compiled with
+// 128-bit SIMD (-msimd128). Engines without SIMD support fail to create or
+// load the Simd variant
+enum class ModuleVariant
+{
+    Scalar = 0,
+    Simd
+};
+
+// Benchmark kernel the module runs; values match WasmModuleKernel in
+// module_abi.h
+enum class DspKernel
+{
+    Gain = 0,
+    Biquad,
+    Fir,
+    Fft,
+    OscillatorBank,
+    FdnReverb,
+    Waveshaper,
+    Synth  // Played by MIDI events (see DspEngine::queueMidi); ignores its input
+};
+
+constexpr int numKernels = (int) DspKernel::Synth + 1;
+
+// Parameters the module takes through its parameter block; values match
+// WasmModuleParam in module_abi.h
+enum class ModuleParam
+{
+    Gain = 0,  // Output gain in dB
+    Mix,       // Dry/wet, 0-1
+    Tone       // Low-pass cutoff in Hz; off at 20 kHz
+};
+
+constexpr int numModuleParams = (int) ModuleParam::Tone + 1;
+
+// A parameter value that takes effect at a sample offset within a block
+struct ParamChange
+{
+    int sampleOffset = 0;
+    ModuleParam param = ModuleParam::Gain;
+    float value = 0.0f;
+};
+
+// How process applies a block's parameter changes: all of them before the
+// block, or by splitting the block at each change so it lands on its sample
+enum class ParamUpdateMode
+{
+    PerBlock = 0,
+    SampleAccurate
+};
+
+// A MIDI channel message at a sample offset within a block; same layout as
+// WasmMidiEvent in module_abi.h
+struct MidiEvent
+{
+    int32_t sampleOffset = 0;
+    uint8_t status = 0;  // Message type and MIDI channel
+    uint8_t data1 = 0;
+    uint8_t data2 = 0;
+    uint8_t reserved = 0;
+};
+
+// A module embedded in the binary
+struct ModuleBytes
+{
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+// How the host crosses into an engine: one call per block through the
+// block ABI, or the original one call per sample (kept for comparison),
+// made for every channel of a sample frame before the next frame
+enum class ProcessMode
+{
+    Block = 0,
+    PerSample
+};
+
+// Where an AOT engine's code came from: AOT bytes handed to load, wasm bytes
+// compiled during load, or wasm bytes whose compiled image was in the cache
+enum class AotSource
+{
+    None = 0,  // Not an AOT engine, or nothing loaded
+    Prebuilt,
+    Compiled,
+    Cached
+};
+
+// How DspEngine::reset returned an instance to its initial state: from the
+// snapshot taken at instantiation (a copy, or copy-on-write pages where the
+// engine owns its memory mapping), or by instantiating again. The first
+// three match MemorySnapshotKind
+enum class ResetKind
+{
+    None = 0,             // Not reset yet
+    SnapshotCopy,
+    SnapshotCopyOnWrite,
+    Reinstantiated
+};
+
+// Snapshot of an engine's counters, safe to take from any thread
+struct EngineStats
+{
+    int64_t loadTimeUs = 0;
+    uint64_t blocksProcessed = 0;
+    uint64_t samplesProcessed = 0;  // Summed over channels
+    uint64_t failedBlocks = 0;
+    uint64_t resets = 0;
+};
+
+// Heap and stack the runtime sets aside for each instance. Only the WAMR
+// engines take them; wasm2c and Wasmi size memory from the module alone
+struct MemoryConfig
+{
+    uint32_t heapBytes = 512 * 1024;  // App heap WAMR adds to linear memory for module malloc; 0 for none
+    uint32_t stackBytes = 8 * 1024;   // WAMR exec env stack (interpreter frames and operands)
+};
+
+// What an instance costs in memory, from getMemoryUsage. Whatever an engine
+// can't tell is 0
+struct EngineMemory
+{
+    size_t runtimeBytes = 0;         // Host allocations the runtime made for this instance, linear memory excluded
+    size_t linearMemoryBytes = 0;    // The module's linear memory, WAMR's app heap included
+    size_t heapBytes = 0;            // WAMR's app heap within the linear memory
+    size_t poolBytes = 0;            // Runtime allocations now, process-wide (WAMR and Wasmi)
+    size_t poolPeakBytes = 0;        // Most the runtime had allocated at once: what a fixed pool would need
+    size_t stackBytes = 0;           // The module's own stack in linear memory
+    size_t stackHighWaterBytes = 0;  // Deepest that stack has been since instantiation
+    size_t codeBytes = 0;            // Loaded AOT image or wasm bytecode; wasm2c code is part of the binary
+};
+
+//==============================================================================
+// Common interface over the WAMR, wasm2c and Wasmi wrappers.
+//
+// create/load/reset run on a non-audio thread; process may be called from the
+// audio thread and never allocates, locks or prints. Counters are relaxed
+// atomics written only by the processing thread.
+class DspEngine
+{
+public:
+    virtual ~DspEngine() = default;
+
+    virtual EngineType getType() const = 0;
+    virtual const char* getName() const = 0;
+    ModuleVariant getVariant() const { return variant; }
+
+    // Load and instantiate a module. AOT engines (see isAotEngine) take AOT
+    // bytes, or wasm bytes which they compile for the host CPU when
+    // canCompileAot() (slow the first time, then served from the AOT cache).
+    // The others take wasm bytes (wasm2c ignores them and uses the module
+    // compiled into the binary)
+    bool load (const uint8_t* bytes, size_t size);
+
+    // Load the module variant this engine was created for from the bytes
+    // embedded in the binary
+    bool loadBuiltinModule();
+
+    // Load one build from the AOT option matrix (build-wasm.sh writes it to
+    // wasm-module/build/aot) for this engine's variant, naming the engine's
+    // module after it. AOT engines only
+    bool loadAotVariant (const std::string& directory, const std::string& label);
+
+    // Label of the AOT matrix build loaded; empty for any other module
+    const std::string& getModuleLabel() const { return moduleLabel; }
+
+    // Another instance of the loaded module sharing its runtime and compiled
+    // code, so only per-instance state (memory, stack) is allocated. Its
+    // load time is the instantiation time. nullptr if nothing is loaded
+    std::unique_ptr<DspEngine> createInstance() { return createInstance (params); }
+
+    // Same, starting from the given parameter values instead of this
+    // engine's, so it can run while another thread processes this engine
+    std::unique_ptr<DspEngine> createInstance (const std::array<float, numModuleParams>& initialParams);
+
+    // Process numSamples of each planar input channel into the matching
+    // output channel through the given call path. Channels are independent;
+    // numChannels may be at most maxChannels
+    bool process (const float* const* input, float* const* output, int numChannels, int numSamples,
+                  ProcessMode mode = ProcessMode::Block);
+
+    // Mono shorthand
+    bool process (const float* input, float* output, int numSamples, ProcessMode mode = ProcessMode::Block)
+    {
+        return process (&input, &output, 1, numSamples, mode);
+    }
+
+    // Process a block applying parameter changes, sorted by sampleOffset.
+    // Per-block updates write the parameter block once; sample-accurate ones
+    // call into the module once per stretch between changes. Realtime-safe
+    // like process, and counted as one block
+    bool process (const float* const* input, float* const* output, int numChannels, int numSamples,
+                  const ParamChange* changes, int numChanges, ParamUpdateMode updateMode,
+                  ProcessMode mode = ProcessMode::Block);
+
+    // Set one parameter before the next block. Not for the audio thread while
+    // it processes this engine
+    void setParam (ModuleParam param, float value);
+
+    // Value the module was last given; kept across reset and createInstance
+    float getParam (ModuleParam param) const { return params[(size_t) param]; }
+    static float getDefaultParam (ModuleParam param);
+
+    static constexpr int maxChannels = 16;  // WASM_MODULE_MAX_CHANNELS
+
+    // Hand the module one block's MIDI events, sorted by sampleOffset and
+    // timed from the start of the next process call, replacing any still
+    // queued. However that block is then processed (split at parameter
+    // changes, or per sample) each event reaches the kernel on its sample.
+    // Realtime-safe; false if the module takes no events, or if there were
+    // more than maxMidiEvents and the rest were dropped
+    bool queueMidi (const MidiEvent* events, int numEvents);
+
+    static constexpr int maxMidiEvents = 512;  // WASM_MODULE_MAX_EVENTS
+
+    // Return the module to its freshly instantiated state, running the same
+    // kernel. The engine restores the snapshot it took at instantiation,
+    // which costs a copy of linear memory (or of the pages written since)
+    // instead of a new instance; it instantiates again if asked to, if there
+    // is no usable snapshot, if the heap or stack configuration changed, or
+    // if a block failed since the last reset, since a trap can leave the
+    // module's stack pointer unwound only partway
+    bool reset (bool reinstantiate = false);
+    ResetKind getLastResetKind() const { return lastReset; }
+
+    // Select the kernel the module runs, clearing its state. Call from a
+    // non-audio thread while the engine isn't processing
+    bool setKernel (DspKernel kernel);
+    DspKernel getKernel() const { return kernel; }
+
+    // Rate in Hz the module designs its filters, oscillators and envelopes
+    // for, the host's rate times any oversampling; kept across reset and
+    // createInstance. Only calls into the module when the rate changes, and
+    // is realtime-safe, so the thread processing the engine can follow the
+    // host before each block. False if the module can't take the rate
+    bool setSampleRate (int rate);
+    int getSampleRate() const { return sampleRate.load (std::memory_order_relaxed); }
+
+    static constexpr int defaultSampleRate = 48000;  // WASM_MODULE_DEFAULT_SAMPLE_RATE
+
+    // Per-instance heap and stack, used from the next load or reset and
+    // inherited by createInstance
+    void setMemoryConfig (const MemoryConfig& config) { memoryConfig = config; }
+    const MemoryConfig& getMemoryConfig() const { return memoryConfig; }
+
+    // Measure the instance's memory. Calls into the module for its stack, so
+    // run it from a non-audio thread while the engine isn't processing
+    EngineMemory getMemoryUsage();
+
+    // Hand queued diagnostics to log; call from one non-audio thread
+    virtual void drainDiagnostics (const std::function<void (const char*)>& log) { (void) log; }
+
+    // How the loaded AOT code was obtained
+    virtual AotSource getAotSource() const { return AotSource::None; }
+
+    // Whether AOT engines can compile wasm bytes at load time (the WAMR
+    // compiler is linked in)
+    static bool canCompileAot();
+
+    // Directory compiled AOT images are cached in. Defaults to the user's
+    // cache directory; empty disables the cache. Set it before loading
+    static void setAotCacheDirectory (const std::string& directory);
+    static std::string getAotCacheDirectory();
+
+    // Cache file for a wasm module, named by the module's hash and a hash of
+    // the WAMR version, host CPU and compiler options. Empty if there is no
+    // cache or compiler
+    static std::string getAotCachePath (const uint8_t* wasmBytes, size_t size);
+
+    // Per-thread runtime setup; call once on each thread before it processes
+    static void attachCurrentThread();
+
+    EngineStats getStats() const;
+
+    // Create an engine of the given type for a module variant, or nullptr for
+    // Bypass / on failure / when the engine can't run that variant
+    static std::unique_ptr<DspEngine> create (EngineType type, ModuleVariant variant = ModuleVariant::Scalar);
+
+protected:
+    virtual bool loadModule (const uint8_t* bytes, size_t size) = 0;
+    virtual std::unique_ptr<DspEngine> newInstance() = 0;
+    virtual bool processBlock (const float* const* input, float* const* output, int numChannels, int numSamples) = 0;
+    virtual bool processPerSample (const float* const* input, float* const* output, int numChannels, int numSamples) = 0;
+    virtual bool resetInstance() = 0;
+
+    // Restore the instantiation snapshot; ResetKind::None if there is none usable
+    virtual ResetKind restoreSnapshot() { return ResetKind::None; }
+    virtual bool selectKernel (int kernel) = 0;
+
+    // Hand the module its sample rate; false if it has no set_sample_rate
+    // export or rejects the rate
+    virtual bool writeSampleRate (int rate) = 0;
+
+    // Copy values into the module's parameter block. Modules without one
+    // return false and ignore their parameters
+    virtual bool writeParams (const float* values, int count) = 0;
+
+    // Replace the module's MIDI event queue; false if it has none
+    virtual bool writeEvents (const MidiEvent* events, int count) = 0;
+
+    // The runtime's side of getMemoryUsage, and the module's memory_info
+    // answer to a WasmModuleMemoryQuery (-1 if unavailable)
+    virtual EngineMemory getRuntimeMemory() = 0;
+    virtual int queryModuleMemory (int query) = 0;
+
+private:
+    bool render (const float* const* input, float* const* output, int numChannels, int numSamples, ProcessMode mode);
+    void countBlock (int numChannels, int numSamples, bool ok);
+    void applyChange (const ParamChange& change);
+
+    ModuleVariant variant = ModuleVariant::Scalar;
+    DspKernel kernel = DspKernel::Gain;
+    std::atomic<int> sampleRate { defaultSampleRate };  // Read by createInstance while another thread processes
+    MemoryConfig memoryConfig;
+    std::array<float, numModuleParams> params { 0.0f, 1.0f, 20000.0f };
+    std::string moduleLabel;
+    std::atomic<int64_t> loadTimeUs { 0 };
+    std::atomic<uint64_t> blocksProcessed { 0 };
+    std::atomic<uint64_t> samplesProcessed { 0 };
+    std::atomic<uint64_t> failedBlocks { 0 };
+    std::atomic<uint64_t> resets { 0 };
+    ResetKind lastReset = ResetKind::None;
+    uint64_t failedBlocksAtReset = 0;
+};
+
+// Display name of an engine type
+const char* getEngineName (EngineType type);
+
+// Whether an engine loads AOT-compiled bytes rather than wasm bytes
+bool isAotEngine (EngineType type);
+
+// Whether this build includes an engine; the WAMR tiers depend on how the
+// runtime was built
+bool isEngineAvailable (EngineType type);
+
+const char* getVariantName (ModuleVariant variant);
+
+// Short lowercase name of a kernel, as used on the wasm-bench command line
+const char* getKernelName (DspKernel kernel);
+
+// Short lowercase name of a reset kind, for wasm-bench output
+const char* getResetKindName (ResetKind kind);
+
+// Module bytes embedded for an engine type and variant
+ModuleBytes getBuiltinModule (EngineType type, ModuleVariant variant);
+
+// Wasm bytes embedded for a variant, whatever the engine
+ModuleBytes getBuiltinWasmModule (ModuleVariant variant);
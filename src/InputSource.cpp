@@ -0,0 +1,407 @@
+#include "InputSource.h"
+#include "DspEngine.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+const char* getTestSignalName (TestSignal signal)
+{
+    switch (signal)
+    {
+        case TestSignal::Silence:      return "silence";
+        case TestSignal::SineSweep:    return "sweep";
+        case TestSignal::WhiteNoise:   return "white-noise";
+        case TestSignal::PinkNoise:    return "pink-noise";
+        case TestSignal::Impulse:      return "impulse";
+        case TestSignal::DenormalTail: return "denormal-tail";
+    }
+    return "silence";
+}
+
+namespace
+{
+    // Files up to this size are paged in when prepared, so first-touch page
+    // faults don't land in timed blocks; larger ones fault in as they play
+    constexpr juce::int64 prefaultLimitBytes = 256 * 1024 * 1024;
+
+    // Copy the first sourceChannels channels over the rest in turn
+    void repeatChannels (float* const* channels, int numChannels, int sourceChannels, int offset, int numSamples)
+    {
+        for (int ch = sourceChannels; ch < numChannels; ++ch)
+            std::memcpy (channels[ch] + offset, channels[ch % sourceChannels] + offset, (size_t) numSamples * sizeof (float));
+    }
+
+    //==============================================================================
+    // A source of known length, read in ranges that never cross its end
+    class LoopingSource : public InputSource
+    {
+    public:
+        void read (float* const* channels, int numChannels, int numSamples) override
+        {
+            if (length <= 0)
+            {
+                for (int ch = 0; ch < numChannels; ++ch)
+                    std::fill (channels[ch], channels[ch] + numSamples, 0.0f);
+                return;
+            }
+
+            for (int done = 0; done < numSamples; )
+            {
+                auto count = (int) std::min<juce::int64> (numSamples - done, length - position);
+                readRange (channels, numChannels, done, position, count);
+                done += count;
+                position += count;
+                if (position == length)
+                    position = 0;
+            }
+        }
+
+    protected:
+        // Fill count samples of every channel, from offset, with the source from start
+        virtual void readRange (float* const* channels, int numChannels, int offset, juce::int64 start, int count) = 0;
+
+        juce::int64 length = 0, position = 0;
+    };
+
+    class BufferSource final : public LoopingSource
+    {
+    public:
+        BufferSource (juce::AudioBuffer<float> source, const juce::String& text)
+            : buffer (std::move (source)), description (text)
+        {
+            length = buffer.getNumChannels() > 0 ? buffer.getNumSamples() : 0;
+        }
+
+        void prepare (double, int) override {}
+        juce::String getDescription() const override { return description; }
+
+    private:
+        void readRange (float* const* channels, int numChannels, int offset, juce::int64 start, int count) override
+        {
+            for (int ch = 0; ch < numChannels; ++ch)
+                std::memcpy (channels[ch] + offset, buffer.getReadPointer (ch % buffer.getNumChannels(), (int) start),
+                             (size_t) count * sizeof (float));
+        }
+
+        juce::AudioBuffer<float> buffer;
+        juce::String description;
+    };
+
+    // Uncompressed WAV or AIFF, converted to float straight from the mapping
+    class MappedAudioFileSource final : public LoopingSource
+    {
+    public:
+        MappedAudioFileSource (std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped, const juce::String& text)
+            : reader (std::move (mapped)), description (text)
+        {
+            length = reader->lengthInSamples;
+        }
+
+        void prepare (double, int) override
+        {
+            auto frameBytes = juce::jmax (1, (int) reader->numChannels * (int) reader->bitsPerSample / 8);
+            if (length * frameBytes > prefaultLimitBytes)
+                return;
+            for (juce::int64 sample = 0; sample < length; sample += juce::jmax (1, 4096 / frameBytes))
+                reader->touchSample (sample);
+        }
+
+        juce::String getDescription() const override { return description; }
+
+    private:
+        void readRange (float* const* channels, int numChannels, int offset, juce::int64 start, int count) override
+        {
+            std::array<float*, DspEngine::maxChannels> destination {};
+            int fileChannels = juce::jmin (numChannels, (int) reader->numChannels, DspEngine::maxChannels);
+            for (int ch = 0; ch < fileChannels; ++ch)
+                destination[(size_t) ch] = channels[ch] + offset;
+            reader->read (destination.data(), fileChannels, start, count);
+            repeatChannels (channels, numChannels, fileChannels, offset, count);
+        }
+
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader;
+        juce::String description;
+    };
+
+    // Headerless mono 32-bit float
+    class RawFloatSource final : public LoopingSource
+    {
+    public:
+        explicit RawFloatSource (const juce::File& file)
+            : mapping (file, juce::MemoryMappedFile::readOnly), description (file.getFileName() + " (memory-mapped raw float)")
+        {
+            if (mapping.getData() != nullptr)
+                length = (juce::int64) (mapping.getSize() / sizeof (float));
+        }
+
+        bool isValid() const { return length > 0; }
+
+        void prepare (double, int) override
+        {
+            if ((juce::int64) mapping.getSize() > prefaultLimitBytes)
+                return;
+            auto* bytes = static_cast<const volatile char*> (mapping.getData());
+            for (size_t i = 0; i < mapping.getSize(); i += 4096)
+                (void) bytes[i];
+        }
+
+        juce::String getDescription() const override { return description; }
+
+    private:
+        void readRange (float* const* channels, int numChannels, int offset, juce::int64 start, int count) override
+        {
+            auto* samples = static_cast<const float*> (mapping.getData()) + start;
+            for (int ch = 0; ch < numChannels; ++ch)
+                std::memcpy (channels[ch] + offset, samples, (size_t) count * sizeof (float));
+        }
+
+        juce::MemoryMappedFile mapping;
+        juce::String description;
+    };
+
+    // Compressed formats, decoded ahead of the audio thread on a thread of
+    // their own; a block that isn't decoded yet plays silence
+    class StreamingSource final : public InputSource
+    {
+    public:
+        StreamingSource (std::unique_ptr<juce::AudioFormatReader> reader, const juce::String& text)
+            : fileChannels ((int) reader->numChannels), description (text)
+        {
+            auto* readerSource = new juce::AudioFormatReaderSource (reader.release(), true);
+            readerSource->setLooping (true);
+            buffering = std::make_unique<juce::BufferingAudioSource> (readerSource, decodeThread, true, bufferSamples, fileChannels);
+            decodeThread.startThread();
+        }
+
+        ~StreamingSource() override
+        {
+            buffering = nullptr;
+            decodeThread.stopThread (1000);
+        }
+
+        void prepare (double sampleRate, int maxBlockSize) override
+        {
+            buffering->prepareToPlay (maxBlockSize, sampleRate);
+
+            // Decode the first block before playback starts
+            juce::AudioBuffer<float> first (fileChannels, maxBlockSize);
+            buffering->waitForNextAudioBlockReady (juce::AudioSourceChannelInfo (&first, 0, maxBlockSize), 2000);
+        }
+
+        void read (float* const* channels, int numChannels, int numSamples) override
+        {
+            int count = juce::jmin (numChannels, fileChannels);
+            juce::AudioBuffer<float> block (channels, count, numSamples);  // Refers to channels, no allocation
+            juce::AudioSourceChannelInfo info (&block, 0, numSamples);
+            if (! buffering->waitForNextAudioBlockReady (info, 0))
+                underruns.store (underruns.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            buffering->getNextAudioBlock (info);
+            repeatChannels (channels, numChannels, count, 0, numSamples);
+        }
+
+        juce::String getDescription() const override { return description; }
+        uint64_t getUnderruns() const override { return underruns.load (std::memory_order_relaxed); }
+
+    private:
+        static constexpr int bufferSamples = 1 << 17;  // About 3 s at 44.1 kHz
+
+        juce::TimeSliceThread decodeThread { "Input decoding" };
+        std::unique_ptr<juce::BufferingAudioSource> buffering;
+        int fileChannels;
+        juce::String description;
+        std::atomic<uint64_t> underruns { 0 };
+    };
+
+    //==============================================================================
+    class SignalSource final : public InputSource
+    {
+    public:
+        explicit SignalSource (TestSignal type) : signal (type) {}
+
+        void prepare (double rate, int) override
+        {
+            sampleRate = rate;
+            counter = 0;
+            phase = 0.0;
+            frequency = sweepStart;
+            sweepRatio = std::pow (sweepEnd / sweepStart, 1.0 / (sweepSeconds * sampleRate));
+            pink = {};
+        }
+
+        void read (float* const* channels, int numChannels, int numSamples) override
+        {
+            float* out = channels[0];
+            switch (signal)
+            {
+                case TestSignal::Silence:      std::fill (out, out + numSamples, 0.0f); break;
+                case TestSignal::SineSweep:    sweep (out, numSamples); break;
+                case TestSignal::WhiteNoise:   for (int i = 0; i < numSamples; ++i) out[i] = 0.5f * noise(); break;
+                case TestSignal::PinkNoise:    pinkNoise (out, numSamples); break;
+                case TestSignal::Impulse:      impulses (out, numSamples); break;
+                case TestSignal::DenormalTail: denormalTail (out, numSamples); break;
+            }
+            repeatChannels (channels, numChannels, 1, 0, numSamples);
+        }
+
+        juce::String getDescription() const override
+        {
+            switch (signal)
+            {
+                case TestSignal::Silence:      return "Silence";
+                case TestSignal::SineSweep:    return "Sine sweep, 20 Hz - 20 kHz";
+                case TestSignal::WhiteNoise:   return "White noise";
+                case TestSignal::PinkNoise:    return "Pink noise";
+                case TestSignal::Impulse:      return "Impulse every second";
+                case TestSignal::DenormalTail: return "Noise bursts with subnormal tails";
+            }
+            return {};
+        }
+
+    private:
+        static constexpr double sweepStart = 20.0, sweepEnd = 20000.0, sweepSeconds = 10.0;
+
+        // Uniform in [-1, 1), from a xorshift generator
+        float noise()
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return (float) (state >> 8) * (2.0f / 16777216.0f) - 1.0f;
+        }
+
+        // Whatever a period-based signal does for the next count samples is
+        // handled one period segment at a time
+        template <typename Segment>
+        void segments (float* out, int numSamples, int64_t period, Segment&& segment)
+        {
+            for (int done = 0; done < numSamples; )
+            {
+                auto count = (int) std::min<int64_t> (numSamples - done, period - counter);
+                segment (out + done, count);
+                done += count;
+                counter += count;
+                if (counter == period)
+                    counter = 0;
+            }
+        }
+
+        void sweep (float* out, int numSamples)
+        {
+            segments (out, numSamples, (int64_t) (sweepSeconds * sampleRate), [this] (float* o, int count)
+            {
+                if (counter == 0)
+                    frequency = sweepStart;
+                for (int i = 0; i < count; ++i)
+                {
+                    o[i] = 0.5f * (float) std::sin (phase);
+                    phase += juce::MathConstants<double>::twoPi * frequency / sampleRate;
+                    frequency *= sweepRatio;
+                }
+                phase = std::fmod (phase, juce::MathConstants<double>::twoPi);
+            });
+        }
+
+        // Paul Kellet's economy pink filter over white noise
+        void pinkNoise (float* out, int numSamples)
+        {
+            for (int i = 0; i < numSamples; ++i)
+            {
+                float white = noise();
+                pink[0] = 0.99765f * pink[0] + white * 0.0990460f;
+                pink[1] = 0.96300f * pink[1] + white * 0.2965164f;
+                pink[2] = 0.57000f * pink[2] + white * 1.0526913f;
+                out[i] = 0.125f * (pink[0] + pink[1] + pink[2] + white * 0.1848f);
+            }
+        }
+
+        void impulses (float* out, int numSamples)
+        {
+            segments (out, numSamples, (int64_t) sampleRate, [this] (float* o, int count)
+            {
+                std::fill (o, o + count, 0.0f);
+                if (counter == 0)
+                    o[0] = 1.0f;
+            });
+        }
+
+        // The tail is assembled from bit patterns (zero exponent, decaying
+        // random mantissa) so flush-to-zero on the generating thread, e.g.
+        // ScopedNoDenormals, can't turn it into silence
+        void denormalTail (float* out, int numSamples)
+        {
+            auto period = (int64_t) sampleRate;
+            auto burst = period / 100;
+            segments (out, numSamples, period, [this, burst] (float* o, int count)
+            {
+                for (int i = 0; i < count; ++i)
+                {
+                    auto position = counter + i;
+                    if (position < burst)
+                    {
+                        o[i] = 0.5f * noise();
+                        envelope = 1.0;
+                        continue;
+                    }
+
+                    float random = noise();
+                    auto mantissa = (uint32_t) (envelope * 8388607.0 * std::abs (random));
+                    uint32_t bits = (random < 0.0f ? 0x80000000u : 0u) | mantissa;
+                    std::memcpy (o + i, &bits, sizeof (bits));
+                    envelope *= 0.9999;
+                }
+            });
+        }
+
+        TestSignal signal;
+        double sampleRate = 44100.0;
+        int64_t counter = 0;  // Position in the current period
+        double phase = 0.0, frequency = sweepStart, sweepRatio = 1.0, envelope = 1.0;
+        std::array<float, 3> pink {};
+        uint32_t state = 0x9e3779b9u;
+    };
+}
+
+std::unique_ptr<InputSource> InputSource::createSignal (TestSignal signal)
+{
+    return std::make_unique<SignalSource> (signal);
+}
+
+std::unique_ptr<InputSource> InputSource::createFromBuffer (juce::AudioBuffer<float> buffer, const juce::String& description)
+{
+    return std::make_unique<BufferSource> (std::move (buffer), description);
+}
+
+std::unique_ptr<InputSource> InputSource::openFile (const juce::File& file, juce::String& error)
+{
+    if (file.hasFileExtension ("f32;raw"))
+    {
+        auto source = std::make_unique<RawFloatSource> (file);
+        if (source->isValid())
+            return source;
+        error = "cannot map " + file.getFullPathName();
+        return nullptr;
+    }
+
+    juce::WavAudioFormat wav;
+    juce::AiffAudioFormat aiff;
+    for (juce::AudioFormat* format : { static_cast<juce::AudioFormat*> (&wav), static_cast<juce::AudioFormat*> (&aiff) })
+    {
+        if (! format->canHandleFile (file))
+            continue;
+
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> reader (format->createMemoryMappedReader (file));
+        if (reader != nullptr && reader->lengthInSamples > 0 && reader->mapEntireFile())
+            return std::make_unique<MappedAudioFileSource> (std::move (reader), file.getFileName() + " (memory-mapped)");
+    }
+
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+    std::unique_ptr<juce::AudioFormatReader> reader (formats.createReaderFor (file));
+    if (reader == nullptr || reader->lengthInSamples <= 0)
+    {
+        error = "cannot read " + file.getFullPathName();
+        return nullptr;
+    }
+    return std::make_unique<StreamingSource> (std::move (reader), file.getFileName() + " (streamed)");
+}
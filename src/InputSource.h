@@ -0,0 +1,55 @@
+#pragma once
+
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <cstdint>
+#include <memory>
+
+// Built-in test signals
+enum class TestSignal
+{
+    Silence,
+    SineSweep,     // Logarithmic 20 Hz - 20 kHz over 10 s, repeating
+    WhiteNoise,
+    PinkNoise,
+    Impulse,       // One full-scale sample per second
+    DenormalTail   // 10 ms noise bursts, each followed by a second of subnormal noise
+};
+constexpr int numTestSignals = 6;
+
+const char* getTestSignalName (TestSignal signal);  // For --input gen:<name> and the plugin's menu
+
+//==============================================================================
+// Where an engine's input comes from: a file or a generator, read a block at
+// a time. Every source loops, and handles the wrap at most once per block
+// rather than per sample.
+//
+// prepare() runs off the audio thread; read() runs on it and must not
+// allocate or block. A source with fewer channels than asked for repeats its
+// channels in turn.
+class InputSource
+{
+public:
+    virtual ~InputSource() = default;
+
+    virtual void prepare (double sampleRate, int maxBlockSize) = 0;
+    virtual void read (float* const* channels, int numChannels, int numSamples) = 0;
+
+    // What it plays, for logs and the editor
+    virtual juce::String getDescription() const = 0;
+
+    // Blocks that came out silent because streamed data wasn't decoded in
+    // time; always 0 for sources that don't stream
+    virtual uint64_t getUnderruns() const { return 0; }
+
+    static std::unique_ptr<InputSource> createSignal (TestSignal signal);
+
+    // Plays a fully decoded buffer
+    static std::unique_ptr<InputSource> createFromBuffer (juce::AudioBuffer<float> buffer, const juce::String& description);
+
+    // A raw .f32/.raw file (mono 32-bit float, native byte order) or an
+    // uncompressed WAV/AIFF is memory-mapped, so any length plays without
+    // being loaded; anything else JUCE decodes (FLAC, Ogg, MP3...) is
+    // streamed through a background decoding thread. nullptr with error set
+    // if the file can't be opened
+    static std::unique_ptr<InputSource> openFile (const juce::File& file, juce::String& error);
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Percentiles and counters read from a LatencyHistogram
+struct LatencySummary
+{
+    uint64_t count = 0;
+    uint64_t deadlineMisses = 0;
+    double meanNs = 0.0;
+    uint64_t p50Ns = 0;
+    uint64_t p99Ns = 0;
+    uint64_t p999Ns = 0;
+    uint64_t maxNs = 0;
+};
+
+//==============================================================================
+// Lock-free log-linear (HDR-style) histogram of per-block latencies in ns.
+//
+// Values below 32 ns get exact buckets; above that every power of two is split
+// into 16 linear sub-buckets, so a reported percentile is within ~6% of the
+// true value. There must be a single writer (the audio thread); any number of
+// threads may read concurrently. Counters are relaxed atomics, so a summary
+// taken mid-block may be off by that one block.
+class LatencyHistogram
+{
+public:
+    static constexpr int linearBuckets = 32;
+    static constexpr int subBuckets = 16;
+    static constexpr int numBuckets = linearBuckets + (64 - 5) * subBuckets;
+
+    // Record one block's latency; missedDeadline counts it as an overrun.
+    // Called only by the writer thread.
+    void record (uint64_t ns, bool missedDeadline)
+    {
+        if (resetRequested.load (std::memory_order_acquire))
+        {
+            for (auto& bucket : buckets)
+                bucket.store (0, std::memory_order_relaxed);
+            count.store (0, std::memory_order_relaxed);
+            sumNs.store (0, std::memory_order_relaxed);
+            maxNs.store (0, std::memory_order_relaxed);
+            misses.store (0, std::memory_order_relaxed);
+            resetRequested.store (false, std::memory_order_release);
+        }
+
+        increment (buckets[(size_t) bucketIndex (ns)], 1);
+        increment (count, 1);
+        increment (sumNs, ns);
+        if (ns > maxNs.load (std::memory_order_relaxed))
+            maxNs.store (ns, std::memory_order_relaxed);
+        if (missedDeadline)
+            increment (misses, 1);
+    }
+
+    // Ask the writer to clear everything before its next record
+    void reset() { resetRequested.store (true, std::memory_order_release); }
+
+    // Safe from any thread
+    LatencySummary getSummary() const
+    {
+        LatencySummary summary;
+        summary.count = count.load (std::memory_order_relaxed);
+        summary.deadlineMisses = misses.load (std::memory_order_relaxed);
+        summary.maxNs = maxNs.load (std::memory_order_relaxed);
+        if (summary.count == 0)
+            return summary;
+
+        summary.meanNs = (double) sumNs.load (std::memory_order_relaxed) / (double) summary.count;
+
+        // Snapshot the buckets once so all percentiles come from the same data
+        std::array<uint64_t, numBuckets> snapshot;
+        uint64_t total = 0;
+        for (size_t i = 0; i < snapshot.size(); ++i)
+            total += snapshot[i] = buckets[i].load (std::memory_order_relaxed);
+
+        summary.p50Ns = percentile (snapshot, total, 0.5);
+        summary.p99Ns = percentile (snapshot, total, 0.99);
+        summary.p999Ns = percentile (snapshot, total, 0.999);
+        return summary;
+    }
+
+    static int bucketIndex (uint64_t ns)
+    {
+        if (ns < (uint64_t) linearBuckets)
+            return (int) ns;
+
+        int msb = highestBit (ns);
+        int shift = msb - 4;  // Leaves the top 5 bits: 16..31
+        return linearBuckets + (msb - 5) * subBuckets + (int) ((ns >> shift) - subBuckets);
+    }
+
+    // Largest value that falls into a bucket
+    static uint64_t bucketUpperBound (int index)
+    {
+        if (index < linearBuckets)
+            return (uint64_t) index;
+
+        int octave = (index - linearBuckets) / subBuckets;
+        uint64_t mantissa = (uint64_t) ((index - linearBuckets) % subBuckets + subBuckets);
+        int shift = octave + 1;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+private:
+    static int highestBit (uint64_t value)
+    {
+       #if defined (__GNUC__) || defined (__clang__)
+        return 63 - __builtin_clzll (value);
+       #else
+        int bit = 0;
+        while (value >>= 1)
+            ++bit;
+        return bit;
+       #endif
+    }
+
+    static void increment (std::atomic<uint64_t>& counter, uint64_t amount)
+    {
+        counter.store (counter.load (std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    static uint64_t percentile (const std::array<uint64_t, numBuckets>& snapshot, uint64_t total, double fraction)
+    {
+        if (total == 0)
+            return 0;
+
+        uint64_t rank = (uint64_t) (fraction * (double) total);
+        if (rank >= total)
+            rank = total - 1;
+
+        uint64_t seen = 0;
+        for (int i = 0; i < numBuckets; ++i)
+        {
+            seen += snapshot[(size_t) i];
+            if (seen > rank)
+                return bucketUpperBound (i);
+        }
+        return bucketUpperBound (numBuckets - 1);
+    }
+
+    std::array<std::atomic<uint64_t>, numBuckets> buckets {};
+    std::atomic<uint64_t> count { 0 };
+    std::atomic<uint64_t> sumNs { 0 };
+    std::atomic<uint64_t> maxNs { 0 };
+    std::atomic<uint64_t> misses { 0 };
+    std::atomic<bool> resetRequested { false };
+};
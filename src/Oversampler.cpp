@@ -0,0 +1,236 @@
+#include "Oversampler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined (__SSE__) || defined (_M_X64) || defined (_M_AMD64)
+ #include <xmmintrin.h>
+ #define OVERSAMPLER_SSE 1
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+ #include <arm_neon.h>
+ #define OVERSAMPLER_NEON 1
+#endif
+
+namespace
+{
+    // Half-band taps per octave: the first stage's transition band sits right
+    // at the base Nyquist, later ones only have to clear images an octave away
+    constexpr int stageHalfLengths[] = { 16, 8, 6, 4 };
+    constexpr int maxStages = 4;
+    static_assert (Oversampler::maxFactor == 1 << maxStages, "One stage per octave up to maxFactor");
+
+    // n is a multiple of 4
+    float dot (const float* a, const float* b, int n)
+    {
+       #if defined (OVERSAMPLER_SSE)
+        __m128 sum = _mm_setzero_ps();
+        for (int i = 0; i < n; i += 4)
+            sum = _mm_add_ps (sum, _mm_mul_ps (_mm_loadu_ps (a + i), _mm_loadu_ps (b + i)));
+        sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+        sum = _mm_add_ss (sum, _mm_shuffle_ps (sum, sum, 1));
+        return _mm_cvtss_f32 (sum);
+       #elif defined (OVERSAMPLER_NEON)
+        float32x4_t sum = vdupq_n_f32 (0.0f);
+        for (int i = 0; i < n; i += 4)
+            sum = vmlaq_f32 (sum, vld1q_f32 (a + i), vld1q_f32 (b + i));
+        #if defined (__aarch64__)
+        return vaddvq_f32 (sum);
+        #else
+        float32x2_t pair = vadd_f32 (vget_low_f32 (sum), vget_high_f32 (sum));
+        return vget_lane_f32 (vpadd_f32 (pair, pair), 0);
+        #endif
+       #else
+        float sum[4] = {};
+        for (int i = 0; i < n; i += 4)
+            for (int j = 0; j < 4; ++j)
+                sum[j] += a[i + j] * b[i + j];
+        return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+       #endif
+    }
+
+    // The nonzero off-centre coefficients of a windowed-sinc half-band of
+    // 4 * halfLength - 1 taps; the centre tap is 0.5 and implied
+    std::vector<float> designHalfBand (int halfLength)
+    {
+        const int length = 4 * halfLength - 1;
+        const int centre = 2 * halfLength - 1;
+        const double pi = 3.14159265358979323846;
+
+        std::vector<double> taps ((size_t) (2 * halfLength));
+        double sum = 0.0;
+        for (int m = 0; m < 2 * halfLength; ++m)
+        {
+            const int j = 2 * m;
+            const double x = 0.5 * (j - centre);
+            const double phase = 2.0 * pi * j / (length - 1);
+            const double window = 0.35875 - 0.48829 * std::cos (phase)      // Blackman-Harris
+                                + 0.14128 * std::cos (2.0 * phase) - 0.01168 * std::cos (3.0 * phase);
+            taps[(size_t) m] = 0.5 * std::sin (pi * x) / (pi * x) * window;
+            sum += taps[(size_t) m];
+        }
+
+        // Unity gain at DC: these and the centre tap each sum to one half
+        std::vector<float> result (taps.size());
+        for (size_t m = 0; m < taps.size(); ++m)
+            result[m] = (float) (taps[m] * 0.5 / sum);
+        return result;
+    }
+
+    void clear (std::vector<std::vector<float>>& buffers)
+    {
+        for (auto& buffer : buffers)
+            std::fill (buffer.begin(), buffer.end(), 0.0f);
+    }
+}
+
+void Oversampler::prepare (int channels, int blockSize)
+{
+    numChannels = channels;
+    const size_t topSize = (size_t) (blockSize * maxFactor);
+
+    stages.assign ((size_t) maxStages, Stage{});
+    for (int s = 0; s < maxStages; ++s)
+    {
+        auto& stage = stages[(size_t) s];
+        const int halfLength = stageHalfLengths[s];
+        stage.taps = designHalfBand (halfLength);
+        stage.numTaps = (int) stage.taps.size();
+
+        // Samples entering this octave's filters per block, at its lower rate
+        const size_t stageSize = (size_t) (blockSize << s);
+        stage.upWork.assign ((size_t) channels, std::vector<float> ((size_t) stage.numTaps - 1 + stageSize));
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            stage.evenWork[(size_t) lane].assign ((size_t) channels, std::vector<float> ((size_t) stage.numTaps - 1 + stageSize));
+            stage.oddWork[(size_t) lane].assign ((size_t) channels, std::vector<float> ((size_t) halfLength + stageSize));
+        }
+    }
+
+    upBuffers.assign ((size_t) channels, std::vector<float> (topSize));
+    upPointers.assign ((size_t) channels, nullptr);
+    for (int lane = 0; lane < numLanes; ++lane)
+    {
+        auto& buffers = laneBuffers[(size_t) lane];
+        buffers.assign ((size_t) channels, std::vector<float> (topSize));
+        laneOutputs[(size_t) lane].resize ((size_t) channels);
+        for (int ch = 0; ch < channels; ++ch)
+            laneOutputs[(size_t) lane][(size_t) ch] = buffers[(size_t) ch].data();
+    }
+}
+
+void Oversampler::setFactor (int factor)
+{
+    int newStages = 0;
+    while ((1 << newStages) < factor && newStages < maxStages)
+        ++newStages;
+
+    if (newStages != numStages)
+    {
+        numStages = newStages;
+        reset();
+    }
+}
+
+int Oversampler::getLatencySamples (int factor)
+{
+    // Each octave's filters are linear phase, delayed by their centre tap at
+    // the higher rate going up and again coming down
+    double latency = 0.0;
+    for (int s = 0; s < maxStages && (1 << s) < factor; ++s)
+        latency += (4.0 * stageHalfLengths[s] - 2.0) / (2 << s);
+    return (int) std::lround (latency);
+}
+
+void Oversampler::reset()
+{
+    for (auto& stage : stages)
+        clear (stage.upWork);
+    for (int lane = 0; lane < numLanes; ++lane)
+        resetLane (lane);
+}
+
+void Oversampler::resetLane (int lane)
+{
+    for (auto& stage : stages)
+    {
+        clear (stage.evenWork[(size_t) lane]);
+        clear (stage.oddWork[(size_t) lane]);
+    }
+}
+
+const float* const* Oversampler::upsample (const float* const* input, int channels, int numSamples)
+{
+    if (numStages == 0)
+        return input;
+
+    for (int ch = 0; ch < std::min (channels, numChannels); ++ch)
+    {
+        // Every stage after the first works in place in the channel's buffer
+        float* buffer = upBuffers[(size_t) ch].data();
+        const float* source = input[ch];
+        for (int s = 0; s < numStages; ++s)
+        {
+            upsampleStage (stages[(size_t) s], source, buffer, ch, numSamples << s);
+            source = buffer;
+        }
+        upPointers[(size_t) ch] = buffer;
+    }
+    return upPointers.data();
+}
+
+void Oversampler::downsample (int lane, float* const* output, int channels, int numSamples)
+{
+    for (int ch = 0; ch < std::min (channels, numChannels); ++ch)
+    {
+        float* buffer = laneBuffers[(size_t) lane][(size_t) ch].data();
+        if (numStages == 0)
+        {
+            std::memcpy (output[ch], buffer, (size_t) numSamples * sizeof (float));
+            continue;
+        }
+
+        for (int s = numStages - 1; s >= 0; --s)
+            downsampleStage (stages[(size_t) s], lane, buffer, s == 0 ? output[ch] : buffer, ch, numSamples << s);
+    }
+}
+
+// numSamples in, 2 * numSamples out. The input is copied into the work
+// buffer before any output is written, so the two may overlap
+void Oversampler::upsampleStage (Stage& stage, const float* input, float* output, int channel, int numSamples)
+{
+    const int history = stage.numTaps - 1;
+    const int halfLength = stage.numTaps / 2;
+    float* work = stage.upWork[(size_t) channel].data();
+    std::memmove (work + history, input, (size_t) numSamples * sizeof (float));
+
+    // Zero stuffing doubles the gain needed from the dense phase; the other
+    // phase only meets the centre tap, so it is the input delayed
+    for (int i = 0; i < numSamples; ++i)
+    {
+        output[2 * i] = 2.0f * dot (stage.taps.data(), work + i, stage.numTaps);
+        output[2 * i + 1] = work[i + halfLength];
+    }
+
+    std::memmove (work, work + numSamples, (size_t) history * sizeof (float));
+}
+
+// 2 * numSamples in, numSamples out, and likewise safe in place
+void Oversampler::downsampleStage (Stage& stage, int lane, const float* input, float* output, int channel, int numSamples)
+{
+    const int evenHistory = stage.numTaps - 1;
+    const int oddHistory = stage.numTaps / 2;
+    float* even = stage.evenWork[(size_t) lane][(size_t) channel].data();
+    float* odd = stage.oddWork[(size_t) lane][(size_t) channel].data();
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        even[evenHistory + i] = input[2 * i];
+        odd[oddHistory + i] = input[2 * i + 1];
+    }
+
+    for (int i = 0; i < numSamples; ++i)
+        output[i] = dot (stage.taps.data(), even + i, stage.numTaps) + 0.5f * odd[i];
+
+    std::memmove (even, even + numSamples, (size_t) evenHistory * sizeof (float));
+    std::memmove (odd, odd + numSamples, (size_t) oddHistory * sizeof (float));
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+//==============================================================================
+// Runs a block at 2, 4, 8 or 16 times its rate: upsample() turns planar input
+// into oversampled buffers for the engine, downsample() brings the engine's
+// output back. Each octave is a polyphase half-band FIR (every other tap of
+// a half-band filter is zero, so each phase is either a plain delay or one
+// dense dot product), the first stage steepest and the later ones shorter
+// since they have more room to roll off. The dot products use SSE or NEON.
+//
+// prepare() allocates for the largest factor, so setFactor() and the
+// processing calls are realtime-safe. Output is delayed by
+// getLatencySamples() at the base rate.
+//
+// There are two downsampling lanes with their own filter state, so while
+// one engine crossfades into another each output stream stays continuous
+class Oversampler
+{
+public:
+    static constexpr int maxFactor = 16;
+    static constexpr int numLanes = 2;
+
+    void prepare (int numChannels, int maxBlockSize);
+
+    // 1 (off), 2, 4, 8 or 16; clears the filters when it changes
+    void setFactor (int factor);
+    int getFactor() const { return 1 << numStages; }
+
+    // Base-rate samples the round trip delays by at a factor, rounded; safe
+    // from any thread
+    static int getLatencySamples (int factor);
+    int getLatencySamples() const { return getLatencySamples (getFactor()); }
+
+    void reset();
+    void resetLane (int lane);
+
+    // numSamples * getFactor() samples of each channel, valid until the next call
+    const float* const* upsample (const float* const* input, int numChannels, int numSamples);
+
+    // Where the engine writes its oversampled output for a lane
+    float* const* getOversampledOutput (int lane) { return laneOutputs[(size_t) lane].data(); }
+
+    // Filter and decimate that lane's oversampled output into numSamples of output
+    void downsample (int lane, float* const* output, int numChannels, int numSamples);
+
+private:
+    // One octave's filter state per channel: the inputs still in the taps,
+    // kept in front of each block's samples so every dot product reads
+    // contiguous memory
+    struct Stage
+    {
+        int numTaps = 0;          // Dense taps, a multiple of 4
+        std::vector<float> taps;  // Every other coefficient of the half-band
+        std::vector<std::vector<float>> upWork;                                  // [channel] history + input
+        std::array<std::vector<std::vector<float>>, numLanes> evenWork, oddWork;  // [lane][channel]
+    };
+
+    void upsampleStage (Stage& stage, const float* input, float* output, int channel, int numSamples);
+    void downsampleStage (Stage& stage, int lane, const float* input, float* output, int channel, int numSamples);
+
+    std::vector<Stage> stages;  // Octave 0 runs between the base rate and 2x
+    int numStages = 0;
+    int numChannels = 0;
+
+    // Both directions run in place through one buffer per channel at the top rate
+    std::vector<std::vector<float>> upBuffers;                           // [channel]
+    std::array<std::vector<std::vector<float>>, numLanes> laneBuffers;  // [lane][channel]
+    std::vector<const float*> upPointers;
+    std::array<std::vector<float*>, numLanes> laneOutputs;
+};
@@ -0,0 +1,220 @@
+#include "PerfCounters.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+#if defined (__linux__)
+ #include <linux/perf_event.h>
+ #include <sys/ioctl.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+#endif
+
+const char* getPerfEventName (PerfEvent event)
+{
+    switch (event)
+    {
+        case PerfEvent::Cycles:       return "cycles";
+        case PerfEvent::Instructions: return "instructions";
+        case PerfEvent::L1dMisses:    return "l1d_misses";
+        case PerfEvent::LlcMisses:    return "llc_misses";
+        case PerfEvent::BranchMisses: return "branch_misses";
+        case PerfEvent::DtlbMisses:   return "dtlb_misses";
+    }
+    return "unknown";
+}
+
+PerfCounts PerfCounters::difference (const PerfCounts& before, const PerfCounts& after)
+{
+    PerfCounts counts;
+    counts.available = before.available & after.available;
+    for (size_t i = 0; i < counts.values.size(); ++i)
+        counts.values[i] = after.values[i] >= before.values[i] ? after.values[i] - before.values[i] : 0;
+    return counts;
+}
+
+#if defined (__linux__)
+
+namespace
+{
+    perf_event_attr attributesFor (PerfEvent event)
+    {
+        auto cacheMiss = [] (uint64_t cache)
+        {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        };
+
+        perf_event_attr attr;
+        std::memset (&attr, 0, sizeof (attr));
+        attr.size = sizeof (attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        switch (event)
+        {
+            case PerfEvent::Cycles:       attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+            case PerfEvent::Instructions: attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+            case PerfEvent::BranchMisses: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+            case PerfEvent::L1dMisses:    attr.type = PERF_TYPE_HW_CACHE; attr.config = cacheMiss (PERF_COUNT_HW_CACHE_L1D); break;
+            case PerfEvent::LlcMisses:    attr.type = PERF_TYPE_HW_CACHE; attr.config = cacheMiss (PERF_COUNT_HW_CACHE_LL); break;
+            case PerfEvent::DtlbMisses:   attr.type = PERF_TYPE_HW_CACHE; attr.config = cacheMiss (PERF_COUNT_HW_CACHE_DTLB); break;
+        }
+
+        // User space only, which perf_event_paranoid up to 2 allows
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return attr;
+    }
+
+    std::string describeError (int code)
+    {
+        if (code == EACCES || code == EPERM)
+        {
+            std::string level = "?";
+            std::ifstream ("/proc/sys/kernel/perf_event_paranoid") >> level;
+            return "not permitted (kernel.perf_event_paranoid = " + level + ")";
+        }
+        if (code == ENOENT || code == EOPNOTSUPP || code == EINVAL)
+            return "not supported by this CPU or VM";
+        if (code == ENOSYS)
+            return "perf_event_open unavailable (container or seccomp)";
+        return std::strerror (code);
+    }
+}
+
+int PerfCounters::getCurrentThreadId()
+{
+    return (int) syscall (SYS_gettid);
+}
+
+// The first numEvents events that open, for the thread (0 for the calling one)
+bool PerfCounters::openGroup (int thread, int numEvents, int& firstError)
+{
+    close();
+    for (int i = 0; i < numEvents; ++i)
+    {
+        auto attr = attributesFor ((PerfEvent) i);
+        int fd = (int) syscall (SYS_perf_event_open, &attr, thread, -1, leader, 0);
+        if (fd < 0)
+        {
+            if (firstError == 0)
+                firstError = errno;
+            continue;
+        }
+
+        if (leader < 0)
+            leader = fd;
+        fds[(size_t) i] = fd;
+        slots[(size_t) i] = numOpen++;
+        available |= 1u << i;
+    }
+    return leader >= 0;
+}
+
+// Whether a group counting the calling thread gets onto the PMU: after a
+// little work it has run for some of the time it has been enabled
+bool PerfCounters::groupRuns() const
+{
+    volatile uint64_t sink = 0;
+    for (uint64_t i = 0; i < 200000; ++i)
+        sink = sink + i;
+
+    uint64_t buffer[3 + numPerfEvents];
+    return ::read (leader, buffer, sizeof (buffer)) >= (ssize_t) (3 * sizeof (uint64_t)) && buffer[2] > 0;
+}
+
+bool PerfCounters::open (int thread)
+{
+    // Six events fit one group on most cores: cycles and instructions have
+    // fixed counters, the misses take four general ones. Where fewer are
+    // free (a VM, or another profiler holding some), events are dropped
+    // from the end of the list until the group runs
+    int firstError = 0;
+    int numEvents = numPerfEvents;
+    bool opened = false, fits = false;
+    for (; numEvents > 0; --numEvents)
+    {
+        if (! openGroup (0, numEvents, firstError))
+            break;
+        opened = true;
+        if ((fits = groupRuns()))
+            break;
+    }
+
+    if (! fits)
+    {
+        close();
+        error = opened ? "no room on the PMU (another profiler, or a VM with fewer counters)" : describeError (firstError);
+        return false;
+    }
+
+    // The events that fit, now for the thread asked for
+    int self = getCurrentThreadId();
+    if (thread != 0 && thread != self && ! openGroup (thread, numEvents, firstError))
+    {
+        error = describeError (firstError);
+        return false;
+    }
+    threadId = thread != 0 ? thread : self;
+    error.clear();
+    return true;
+}
+
+void PerfCounters::close()
+{
+    for (auto& fd : fds)
+    {
+        if (fd >= 0 && fd != leader)
+            ::close (fd);
+        fd = -1;
+    }
+    if (leader >= 0)
+        ::close (leader);
+    leader = -1;
+    threadId = 0;
+    numOpen = 0;
+    available = 0;
+}
+
+bool PerfCounters::read (PerfCounts& counts) const
+{
+    if (leader < 0)
+        return false;
+
+    // nr, time enabled, time running, then one value per open event
+    uint64_t buffer[3 + numPerfEvents];
+    auto expected = (ssize_t) ((3 + numOpen) * sizeof (uint64_t));
+    if (::read (leader, buffer, sizeof (buffer)) < expected || buffer[2] == 0)
+        return false;
+
+    // Scale up for the share of time the group was actually on the PMU
+    double scale = (double) buffer[1] / (double) buffer[2];
+    counts.available = available;
+    for (int i = 0; i < numPerfEvents; ++i)
+        counts.values[(size_t) i] = fds[(size_t) i] >= 0 ? (uint64_t) ((double) buffer[3 + slots[(size_t) i]] * scale) : 0;
+    return true;
+}
+
+#else
+
+int PerfCounters::getCurrentThreadId()
+{
+    return 0;
+}
+
+bool PerfCounters::open (int)
+{
+    error = "hardware counters need Linux (perf_event_open)";
+    return false;
+}
+
+void PerfCounters::close()
+{
+    leader = -1;
+}
+
+bool PerfCounters::read (PerfCounts&) const
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+enum class PerfEvent
+{
+    Cycles,
+    Instructions,
+    L1dMisses,     // L1 data cache read misses
+    LlcMisses,     // Last-level cache read misses
+    BranchMisses,
+    DtlbMisses     // Data TLB read misses
+};
+constexpr int numPerfEvents = 6;
+
+const char* getPerfEventName (PerfEvent event);  // snake_case, for output keys
+
+// Counter values; an event the CPU or kernel doesn't provide has its bit
+// clear in available and reads 0
+struct PerfCounts
+{
+    std::array<uint64_t, numPerfEvents> values {};
+    uint32_t available = 0;
+
+    bool has (PerfEvent event) const { return (available & (1u << (int) event)) != 0; }
+};
+
+// Totals per processed sample (counted over every channel)
+struct PerfSummary
+{
+    uint64_t samples = 0;
+    uint32_t available = 0;
+    std::array<double, numPerfEvents> perSample {};
+    double ipc = 0.0;  // Instructions per cycle, 0 without both
+
+    bool has (PerfEvent event) const { return samples > 0 && (available & (1u << (int) event)) != 0; }
+};
+
+//==============================================================================
+// Hardware performance counters of one thread, through one perf_event_open
+// group so every event covers the same instructions.
+//
+// The counters run from open() on, in user space only; read() returns their
+// totals so far (scaled if the kernel had to multiplex them) and the caller
+// takes the difference around what it measures. Events the CPU, a VM or the
+// kernel's perf_event_paranoid setting don't allow are left out, and so are
+// events the PMU has no room for, since a group that doesn't fit is never
+// counted at all. If nothing is left, open() fails with a reason. Elsewhere
+// than Linux it always fails.
+class PerfCounters
+{
+public:
+    PerfCounters() = default;
+    ~PerfCounters() { close(); }
+    PerfCounters (const PerfCounters&) = delete;
+    PerfCounters& operator= (const PerfCounters&) = delete;
+
+    // Count the thread with the given Linux thread ID (see
+    // getCurrentThreadId), or the calling thread by default. The group is
+    // first tried on the calling thread to see that it fits, so open from a
+    // thread that can spare a moment of spinning
+    bool open (int threadId = 0);
+    void close();
+    bool isOpen() const { return leader >= 0; }
+    int getThreadId() const { return threadId; }
+
+    // The calling thread's ID for open; 0 elsewhere than Linux
+    static int getCurrentThreadId();
+    const std::string& getError() const { return error; }
+
+    // One read() system call; no allocation, so usable on the audio thread
+    bool read (PerfCounts& counts) const;
+
+    static PerfCounts difference (const PerfCounts& before, const PerfCounts& after);
+
+private:
+    bool openGroup (int thread, int numEvents, int& firstError);
+    bool groupRuns() const;
+
+    int leader = -1;
+    int threadId = 0;
+    std::array<int, numPerfEvents> fds { -1, -1, -1, -1, -1, -1 };
+    std::array<int, numPerfEvents> slots {};  // Position of each event in the group's read
+    int numOpen = 0;
+    uint32_t available = 0;
+    std::string error;
+};
+
+//==============================================================================
+// Counter totals over many blocks: one writer, any number of readers, and a
+// reset the writer carries out, as in LatencyHistogram
+class PerfAccumulator
+{
+public:
+    void add (const PerfCounts& counts, uint64_t samples)
+    {
+        if (resetRequested.load (std::memory_order_acquire))
+        {
+            for (auto& total : totals)
+                total.store (0, std::memory_order_relaxed);
+            numSamples.store (0, std::memory_order_relaxed);
+            resetRequested.store (false, std::memory_order_release);
+        }
+
+        for (int i = 0; i < numPerfEvents; ++i)
+            increment (totals[(size_t) i], counts.values[(size_t) i]);
+        increment (numSamples, samples);
+        available.store (counts.available, std::memory_order_relaxed);
+    }
+
+    void reset() { resetRequested.store (true, std::memory_order_release); }
+
+    PerfSummary getSummary() const
+    {
+        PerfSummary summary;
+        summary.samples = numSamples.load (std::memory_order_relaxed);
+        summary.available = available.load (std::memory_order_relaxed);
+        if (summary.samples == 0)
+            return summary;
+
+        for (int i = 0; i < numPerfEvents; ++i)
+            summary.perSample[(size_t) i] = (double) totals[(size_t) i].load (std::memory_order_relaxed) / (double) summary.samples;
+        if (summary.has (PerfEvent::Cycles) && summary.has (PerfEvent::Instructions) && summary.perSample[0] > 0.0)
+            summary.ipc = summary.perSample[(size_t) PerfEvent::Instructions] / summary.perSample[(size_t) PerfEvent::Cycles];
+        return summary;
+    }
+
+private:
+    static void increment (std::atomic<uint64_t>& counter, uint64_t amount)
+    {
+        counter.store (counter.load (std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, numPerfEvents> totals {};
+    std::atomic<uint64_t> numSamples { 0 };
+    std::atomic<uint32_t> available { 0 };
+    std::atomic<bool> resetRequested { false };
+};
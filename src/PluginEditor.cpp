@@ -11,36 +11,81 @@ AudioPluginAudioProcessorEditor::AudioPluginAudioProcessorEditor (AudioPluginAud
     titleLabel.setJustificationType (juce::Justification::centred);
     addAndMakeVisible (titleLabel);
     
-    // Setup Bypass button (first and default)
-    bypassButton.setButtonText ("Bypass");
-    bypassButton.setClickingTogglesState (true);
-    bypassButton.setRadioGroupId (1001);
-    bypassButton.setToggleState (true, juce::dontSendNotification);
-    bypassButton.addListener (this);
-    addAndMakeVisible (bypassButton);
-    
-    // Setup Wasmi button
-    wasmiButton.setButtonText ("Wasmi interpreter");
-    wasmiButton.setClickingTogglesState (true);
-    wasmiButton.setRadioGroupId (1001);
-    wasmiButton.addListener (this);
-    addAndMakeVisible (wasmiButton);
+    // Engines to choose from; item ids are the EngineType plus one, Bypass first
+    engineBox.addItem (getEngineName (EngineType::Bypass), (int) EngineType::Bypass + 1);
+    for (int i = 0; i < numEngineTypes; ++i)
+        if (isEngineAvailable ((EngineType) i))
+            engineBox.addItem (getEngineName ((EngineType) i), i + 1);
+    engineBox.setSelectedId ((int) processorRef.getSelectedEngine() + 1, juce::dontSendNotification);
+    engineBox.onChange = [this]
+    {
+        if (auto id = engineBox.getSelectedId(); id > 0)
+            processorRef.setSelectedEngine ((EngineType) (id - 1));
+        timerCallback();
+    };
+    addAndMakeVisible (engineBox);
     
-    // Setup WAMR button
-    wamrButton.setButtonText ("Wamr AOT engine");
-    wamrButton.setClickingTogglesState (true);
-    wamrButton.setRadioGroupId (1001);
-    wamrButton.addListener (this);
-    addAndMakeVisible (wamrButton);
+    // Pick a module file for the processor to watch and hot-reload
+    loadModuleButton.setButtonText ("Load module...");
+    loadModuleButton.addListener (this);
+    addAndMakeVisible (loadModuleButton);
     
-    // Setup wasm2c button
-    wasm2cButton.setButtonText ("wasm2c runtime");
-    wasm2cButton.setClickingTogglesState (true);
-    wasm2cButton.setRadioGroupId (1001);
-    wasm2cButton.addListener (this);
-    addAndMakeVisible (wasm2cButton);
+    // What the engines process; item ids are 1 for the embedded sample, then
+    // the test signals in order, then a file
+    inputBox.addItem ("RawGTR.wav (embedded)", 1);
+    for (int i = 0; i < numTestSignals; ++i)
+        inputBox.addItem (InputSource::createSignal ((TestSignal) i)->getDescription(), i + 2);
+    inputBox.addItem ("File...", numTestSignals + 2);
+    inputBox.setText (processorRef.getInputDescription(), juce::dontSendNotification);
+    inputBox.onChange = [this] { chooseInput(); };
+    addAndMakeVisible (inputBox);
+
+    // Run every engine in the background and compare it with the one playing
+    shadowButton.setButtonText ("Shadow mode (compare all engines)");
+    shadowButton.setToggleState (processorRef.isShadowMode(), juce::dontSendNotification);
+    shadowButton.addListener (this);
+    addAndMakeVisible (shadowButton);
+
+    // Cycles, instructions and misses per sample for the selected engine
+    countersButton.setButtonText ("Hardware counters (Linux perf)");
+    countersButton.setToggleState (processorRef.arePerfCountersEnabled(), juce::dontSendNotification);
+    countersButton.addListener (this);
+    addAndMakeVisible (countersButton);
+
+    // Parameters forwarded to the module
+    auto& parameters = processorRef.getParameters();
+    auto setUpSlider = [this, &parameters] (juce::Slider& slider, juce::Label& label, const char* text, const char* id,
+                                            std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment>& attachment)
+    {
+        slider.setSliderStyle (juce::Slider::LinearHorizontal);
+        slider.setTextBoxStyle (juce::Slider::TextBoxRight, false, 70, 20);
+        addAndMakeVisible (slider);
+        label.setText (text, juce::dontSendNotification);
+        addAndMakeVisible (label);
+        attachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment> (parameters, id, slider);
+    };
+    setUpSlider (gainSlider, gainLabel, "Gain", "gain", gainAttachment);
+    setUpSlider (mixSlider, mixLabel, "Mix", "mix", mixAttachment);
+    setUpSlider (toneSlider, toneLabel, "Tone", "tone", toneAttachment);
+
+    paramUpdatesBox.addItemList ({ "Per block", "Sample accurate" }, 1);
+    addAndMakeVisible (paramUpdatesBox);
+    paramUpdatesAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment> (
+        parameters, "paramUpdates", paramUpdatesBox);
+
+    oversamplingBox.addItemList ({ "No oversampling", "2x oversampling", "4x oversampling", "8x oversampling",
+                                   "16x oversampling" }, 1);
+    addAndMakeVisible (oversamplingBox);
+    oversamplingAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment> (
+        parameters, "oversampling", oversamplingBox);
+
+    // Block latency of the selected engine, refreshed from the processor's histograms
+    statsLabel.setJustificationType (juce::Justification::centredLeft);
+    statsLabel.setFont (juce::Font (juce::Font::getDefaultMonospacedFontName(), 13.0f, juce::Font::plain));
+    addAndMakeVisible (statsLabel);
+    startTimerHz (4);
     
-    setSize (400, 350);
+    setSize (480, 748);
 }
 
 AudioPluginAudioProcessorEditor::~AudioPluginAudioProcessorEditor()
@@ -60,32 +105,150 @@ void AudioPluginAudioProcessorEditor::resized()
     titleLabel.setBounds (area.removeFromTop (40));
     area.removeFromTop (20); // spacing
     
-    auto buttonHeight = 50;
-    bypassButton.setBounds (area.removeFromTop (buttonHeight));
+    engineBox.setBounds (area.removeFromTop (30));
+    area.removeFromTop (10); // spacing
+    loadModuleButton.setBounds (area.removeFromTop (30));
     area.removeFromTop (10); // spacing
-    wasmiButton.setBounds (area.removeFromTop (buttonHeight));
+    inputBox.setBounds (area.removeFromTop (24));
     area.removeFromTop (10); // spacing
-    wamrButton.setBounds (area.removeFromTop (buttonHeight));
+
+    for (auto [slider, label] : { std::pair { &gainSlider, &gainLabel }, std::pair { &mixSlider, &mixLabel },
+                                  std::pair { &toneSlider, &toneLabel } })
+    {
+        auto row = area.removeFromTop (24);
+        label->setBounds (row.removeFromLeft (50));
+        slider->setBounds (row);
+        area.removeFromTop (6); // spacing
+    }
+    paramUpdatesBox.setBounds (area.removeFromTop (24));
+    area.removeFromTop (10); // spacing
+    oversamplingBox.setBounds (area.removeFromTop (24));
+    area.removeFromTop (10); // spacing
+    shadowButton.setBounds (area.removeFromTop (24));
     area.removeFromTop (10); // spacing
-    wasm2cButton.setBounds (area.removeFromTop (buttonHeight));
+    countersButton.setBounds (area.removeFromTop (24));
+    area.removeFromTop (10); // spacing
+    statsLabel.setBounds (area);
+}
+
+void AudioPluginAudioProcessorEditor::timerCallback()
+{
+    auto engine = processorRef.getSelectedEngine();
+    auto summary = processorRef.getLatencySummary (engine);
+
+    auto toUs = [] (double ns) { return juce::String (ns / 1000.0, 1); };
+    auto text = juce::String (getEngineName (engine)) + " block latency (us)\n"
+                + "p50 " + toUs ((double) summary.p50Ns)
+                + "  p99 " + toUs ((double) summary.p99Ns)
+                + "  p99.9 " + toUs ((double) summary.p999Ns)
+                + "  max " + toUs ((double) summary.maxNs) + "\n"
+                + "blocks " + juce::String ((juce::int64) summary.count)
+                + "  deadline misses " + juce::String ((juce::int64) summary.deadlineMisses);
+
+    if (auto factor = processorRef.getOversamplingFactor(); factor > 1)
+    {
+        auto resampler = processorRef.getResamplerLatencySummary();
+        text << "\n" << factor << "x resampling p50 " << toUs ((double) resampler.p50Ns)
+             << "  p99 " << toUs ((double) resampler.p99Ns) << ", " << processorRef.getLatencySamples() << " samples latency";
+    }
+
+    if (auto underruns = processorRef.getInputUnderruns())
+        text << "\nInput underruns " << (juce::int64) underruns;
+
+    // The processor turns the counters off if it can't reopen them for a new audio thread
+    countersButton.setToggleState (processorRef.arePerfCountersEnabled(), juce::dontSendNotification);
+    if (processorRef.arePerfCountersEnabled())
+    {
+        auto perf = processorRef.getPerfSummary (engine);
+        auto perSample = [&perf] (PerfEvent event, const char* name)
+        {
+            return perf.has (event) ? juce::String (name) + " " + juce::String (perf.perSample[(size_t) event], 3) + "  "
+                                    : juce::String();
+        };
+        text << "\nper sample: " << perSample (PerfEvent::Cycles, "cycles") << perSample (PerfEvent::Instructions, "instr")
+             << (perf.ipc > 0.0 ? "IPC " + juce::String (perf.ipc, 2) : juce::String()) << "\n"
+             << "misses/sample: " << perSample (PerfEvent::L1dMisses, "L1d") << perSample (PerfEvent::LlcMisses, "LLC")
+             << perSample (PerfEvent::BranchMisses, "br") << perSample (PerfEvent::DtlbMisses, "dTLB");
+    }
+    else if (! processorRef.getPerfCountersError().empty())
+    {
+        text << "\nHardware counters: " << juce::String (processorRef.getPerfCountersError());
+    }
+
+    if (processorRef.isShadowMode())
+    {
+        auto shadow = processorRef.getShadowReport();
+        text << "\n\nShadow vs " << getEngineName (shadow.reference) << ": "
+             << (juce::int64) shadow.blocksQueued << " blocks, " << (juce::int64) shadow.blocksDropped << " dropped";
+        for (auto& r : shadow.engines)
+        {
+            if (r.engine == shadow.reference || r.blocks == 0)
+                continue;
+            text << "\n" << juce::String (getEngineName (r.engine)).paddedRight (' ', 20)
+                 << juce::String (r.maxAbsError, 0, true) << "  "
+                 << (r.maxUlps == UINT64_MAX ? juce::String ("NaN") : juce::String ((juce::int64) r.maxUlps) + " ulp")
+                 << (r.divergentBlocks > 0 ? "  DIVERGED x" + juce::String ((juce::int64) r.divergentBlocks) : juce::String());
+        }
+    }
+    statsLabel.setText (text, juce::dontSendNotification);
 }
 
 void AudioPluginAudioProcessorEditor::buttonClicked (juce::Button* button)
 {
-    if (button == &bypassButton)
+    if (button == &shadowButton)
     {
-        processorRef.setSelectedEngine (EngineType::Bypass);
+        processorRef.setShadowMode (shadowButton.getToggleState());
     }
-    else if (button == &wasmiButton)
+    else if (button == &countersButton)
+    {
+        if (! processorRef.setPerfCountersEnabled (countersButton.getToggleState()))
+            countersButton.setToggleState (false, juce::dontSendNotification);
+    }
+    else if (button == &loadModuleButton)
+    {
+        moduleChooser = std::make_unique<juce::FileChooser> ("Load a wasm or AOT module",
+                                                             processorRef.getModuleFile(), "*.wasm;*.aot");
+        moduleChooser->launchAsync (juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
+                                    [this] (const juce::FileChooser& chooser)
+                                    {
+                                        auto file = chooser.getResult();
+                                        if (file != juce::File())
+                                            processorRef.setModuleFile (file);
+                                    });
+        return;
+    }
+    timerCallback();
+}
+
+void AudioPluginAudioProcessorEditor::chooseInput()
+{
+    auto id = inputBox.getSelectedId();
+    if (id == 1)
     {
-        processorRef.setSelectedEngine (EngineType::Wasmi);
+        processorRef.setInputSource (nullptr);
     }
-    else if (button == &wamrButton)
+    else if (id >= 2 && id < numTestSignals + 2)
     {
-        processorRef.setSelectedEngine (EngineType::WAMR);
+        processorRef.setInputSource (InputSource::createSignal ((TestSignal) (id - 2)));
     }
-    else if (button == &wasm2cButton)
+    else if (id == numTestSignals + 2)
     {
-        processorRef.setSelectedEngine (EngineType::Wasm2c);
+        inputChooser = std::make_unique<juce::FileChooser> ("Choose an input file", juce::File(),
+                                                            "*.wav;*.aif;*.aiff;*.flac;*.ogg;*.mp3;*.f32;*.raw");
+        inputChooser->launchAsync (juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
+                                   [this] (const juce::FileChooser& chooser)
+                                   {
+                                       juce::String error;
+                                       auto file = chooser.getResult();
+                                       if (file != juce::File())
+                                       {
+                                           if (auto source = InputSource::openFile (file, error))
+                                               processorRef.setInputSource (std::move (source));
+                                       }
+                                       inputBox.setText (error.isNotEmpty() ? "Error: " + error : processorRef.getInputDescription(),
+                                                         juce::dontSendNotification);
+                                   });
+        return;
     }
+    inputBox.setText (processorRef.getInputDescription(), juce::dontSendNotification);
 }
@@ -4,7 +4,8 @@
 
 //==============================================================================
 class AudioPluginAudioProcessorEditor final : public juce::AudioProcessorEditor,
-                                              private juce::Button::Listener
+                                              private juce::Button::Listener,
+                                              private juce::Timer
 {
 public:
     explicit AudioPluginAudioProcessorEditor (AudioPluginAudioProcessor&);
@@ -16,17 +17,33 @@ public:
 
 private:
     void buttonClicked (juce::Button* button) override;
+    void timerCallback() override;
+    void chooseInput();
     
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     AudioPluginAudioProcessor& processorRef;
     
-    juce::TextButton wamrButton;
-    juce::TextButton wasm2cButton;
-    juce::TextButton wasmiButton;
-    juce::TextButton bypassButton;
+    // Engine the processor plays: Bypass, then every engine this build has
+    juce::ComboBox engineBox;
+    juce::TextButton loadModuleButton;
+    juce::ToggleButton shadowButton;
+    juce::ToggleButton countersButton;
+    std::unique_ptr<juce::FileChooser> moduleChooser;
+
+    // Input: the embedded sample, a test signal or a file
+    juce::ComboBox inputBox;
+    std::unique_ptr<juce::FileChooser> inputChooser;
     
     juce::Label titleLabel;
+    juce::Label statsLabel;
+
+    // Module parameters, attached to the processor's value tree
+    juce::Slider gainSlider, mixSlider, toneSlider;
+    juce::Label gainLabel, mixLabel, toneLabel;
+    juce::ComboBox paramUpdatesBox, oversamplingBox;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> gainAttachment, mixAttachment, toneAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> paramUpdatesAttachment, oversamplingAttachment;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessorEditor)
 };
@@ -1,26 +1,74 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "BenchmarkRunner.h"
 #include <BinaryData.h>
 #include <juce_audio_formats/juce_audio_formats.h>
-#include "wamr_aot_wrapper.h"
-#include "wasm2c_wrapper.h"
-#include "module_aot.h"  // Generated AOT bytecode header
-#include "module_wasm.h"  // Generated WASM bytecode header
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <chrono>
+#include <vector>
 
-// Wasmi C API
-extern "C" {
-    #include "wasmi_daisy.h"
-    
-    // Memory allocation functions required by wasmi-daisy
-    void* jaffx_sdram_malloc(size_t size) {
-        return malloc(size);
-    }
-    
-    void jaffx_sdram_free(void* ptr) {
-        free(ptr);
+// An engine loaded by loadEngines, with its SIMD build if the engine has one
+struct LoadedEngine
+{
+    EngineType type;
+    std::unique_ptr<DspEngine> engine, simd;
+};
+
+// Time both call paths of every engine, and the block path of the SIMD
+// builds, as one interleaved run so drift doesn't favour any of them, and
+// print the cost per sample
+static void benchmarkEngines (const std::vector<LoadedEngine>& loaded, int blockSize, const std::atomic<bool>& cancel)
+{
+    blockSize = juce::jmax (1, blockSize);
+    std::vector<float> input ((size_t) blockSize, 1.0f), output ((size_t) blockSize);
+
+    BenchmarkRunner runner;
+    for (auto& l : loaded)
+    {
+        auto name = std::string (getEngineName (l.type));
+        auto add = [&] (const std::string& label, DspEngine* engine, ProcessMode mode)
+        {
+            runner.add (label, blockSize, [&input, &output, engine, blockSize, mode]
+            {
+                engine->process (input.data(), output.data(), blockSize, mode);
+            });
+        };
+        add (name + ", per-sample calls", l.engine.get(), ProcessMode::PerSample);
+        add (name + ", block", l.engine.get(), ProcessMode::Block);
+        if (l.simd != nullptr)
+            add (name + ", SIMD block", l.simd.get(), ProcessMode::Block);
     }
+
+    auto results = runner.run (&cancel);
+    std::cout << "Benchmark: ns/sample in blocks of " << blockSize << ", median [95% CI]"
+              << (runner.getPinnedCpu() >= 0 ? ", pinned to CPU " + std::to_string (runner.getPinnedCpu()) : std::string())
+              << ", " << runner.getOverheadNs() << " ns/call timing overhead subtracted" << std::endl;
+    for (auto& r : results)
+        std::cout << "  " << (r.converged ? "✓ " : "~ ") << r.name << ": " << r.medianNs << " [" << r.lowNs << ", "
+                  << r.highNs << "] ±" << r.relativeError * 100.0 << "%, " << r.samples << " samples of "
+                  << r.iterationsPerSample << " calls" << std::endl;
+}
+
+// Render one block of planar channels through an engine, applying parameter
+// changes and MIDI, or pass the input through for bypass
+static void renderBlock (DspEngine* engine, const float* const* input, float* const* output,
+                         int numChannels, int numSamples, ProcessMode mode,
+                         const ParamChange* changes, int numChanges, ParamUpdateMode updateMode,
+                         const MidiEvent* events, int numEvents)
+{
+    // Modules without a MIDI queue simply don't get the events
+    if (engine != nullptr && numEvents > 0)
+        engine->queueMidi (events, numEvents);
+
+    if (engine != nullptr
+        && engine->process (input, output, numChannels, numSamples, changes, numChanges, updateMode, mode))
+        return;
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        juce::FloatVectorOperations::copy (output[channel], input[channel], numSamples);
 }
 
 //==============================================================================
@@ -32,24 +80,50 @@ AudioPluginAudioProcessor::AudioPluginAudioProcessor()
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
-                       )
+                       ),
+       parameters (*this, nullptr, "PARAMETERS", createParameterLayout())
 {
+    paramValues[(size_t) ModuleParam::Gain] = parameters.getRawParameterValue ("gain");
+    paramValues[(size_t) ModuleParam::Mix] = parameters.getRawParameterValue ("mix");
+    paramValues[(size_t) ModuleParam::Tone] = parameters.getRawParameterValue ("tone");
+    paramUpdateMode = parameters.getRawParameterValue ("paramUpdates");
+    oversamplingChoice = parameters.getRawParameterValue ("oversampling");
+    parameters.addParameterListener ("oversampling", this);
+    updateLatency();
+
+    startTimer (250);
+}
+
+juce::AudioProcessorValueTreeState::ParameterLayout AudioPluginAudioProcessor::createParameterLayout()
+{
+    juce::AudioProcessorValueTreeState::ParameterLayout layout;
+    layout.add (std::make_unique<juce::AudioParameterFloat> (
+        juce::ParameterID { "gain", 1 }, "Gain", juce::NormalisableRange<float> (-24.0f, 12.0f, 0.1f),
+        DspEngine::getDefaultParam (ModuleParam::Gain), juce::AudioParameterFloatAttributes().withLabel ("dB")));
+    layout.add (std::make_unique<juce::AudioParameterFloat> (
+        juce::ParameterID { "mix", 1 }, "Mix", juce::NormalisableRange<float> (0.0f, 1.0f, 0.01f),
+        DspEngine::getDefaultParam (ModuleParam::Mix)));
+    layout.add (std::make_unique<juce::AudioParameterFloat> (
+        juce::ParameterID { "tone", 1 }, "Tone", juce::NormalisableRange<float> (200.0f, 20000.0f, 1.0f, 0.25f),
+        DspEngine::getDefaultParam (ModuleParam::Tone), juce::AudioParameterFloatAttributes().withLabel ("Hz")));
+    layout.add (std::make_unique<juce::AudioParameterChoice> (
+        juce::ParameterID { "paramUpdates", 1 }, "Parameter updates",
+        juce::StringArray { "Per block", "Sample accurate" }, 0));
+    layout.add (std::make_unique<juce::AudioParameterChoice> (
+        juce::ParameterID { "oversampling", 1 }, "Oversampling",
+        juce::StringArray { "Off", "2x", "4x", "8x", "16x" }, 0));
+    return layout;
 }
 
 AudioPluginAudioProcessor::~AudioPluginAudioProcessor()
 {
-    // Cleanup WAMR
-    if (wamrEngine) wamr_aot_engine_delete(wamrEngine);
-    
-    // Cleanup wasm2c
-    if (wasm2cEngine) wasm2c_engine_delete(wasm2cEngine);
-    
-    // Cleanup wasmi
-    if (wasmiFunc) wasmi_func_delete(wasmiFunc);
-    if (wasmiInstance) wasmi_instance_delete(wasmiInstance);
-    if (wasmiModule) wasmi_module_delete(wasmiModule);
-    if (wasmiStore) wasmi_store_delete(wasmiStore);
-    if (wasmiEngine) wasmi_engine_delete(wasmiEngine);
+    stopTimer();
+    parameters.removeParameterListener ("oversampling", this);
+    cancelPendingUpdate();
+    shadowRunner.stop();
+    shuttingDown.store (true);
+    loaderPool.removeAllJobs (true, 30000);
+    activeEngine.store (nullptr);
 }
 
 //==============================================================================
@@ -127,19 +201,56 @@ void AudioPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPer
     std::cout << "Samples Per Block: " << samplesPerBlock << std::endl;
     std::cout << std::endl;
     
-    juce::ignoreUnused (sampleRate, samplesPerBlock);
+    currentSampleRate = sampleRate;
+    setDeadlineFraction (getDeadlineFraction());
+    updateLatency();
+
+    // Scratch buffers for the block path, sized once here so processBlock never allocates
+    inputBlock.setSize (DspEngine::maxChannels, samplesPerBlock);
+    fadeOutputs.setSize (DspEngine::maxChannels, samplesPerBlock);
+    oversampler.prepare (DspEngine::maxChannels, samplesPerBlock);
+
+    // The embedded WAV plays until another input is chosen
+    {
+        std::lock_guard<std::mutex> lock (selectionLock);
+        preparedBlockSize = samplesPerBlock;
+        if (inputSource == nullptr)
+        {
+            inputSource = createEmbeddedInput();
+            activeInput.store (inputSource.get(), std::memory_order_release);
+        }
+        inputSource->prepare (sampleRate, samplesPerBlock);
+    }
+
+    // Engines that are already loaded keep running (the audio thread is
+    // stopped here, so there is no switch to crossfade); the rest are built
+    // on the loader thread and picked up as each becomes ready, with bypass
+    // output until then
+    previousEngine = activeEngine.load();
+    resetLatencyStats();
+
+    // Shadow slots are sized for the block size, so the worker restarts around it
+    shadowRunner.stop();
+    shadowRunner.prepare (samplesPerBlock);
+    if (shadowMode)
+        startShadowRunner();
+
+    loaderPool.addJob ([this, samplesPerBlock] { loadEngines (samplesPerBlock); });
+}
 
-    // Load the embedded WAV file
+std::unique_ptr<InputSource> AudioPluginAudioProcessor::createEmbeddedInput()
+{
     auto* wavData = BinaryData::RawGTR_wav;
     auto wavSize = BinaryData::RawGTR_wavSize;
 
     juce::WavAudioFormat wavFormat;
     std::unique_ptr<juce::AudioFormatReader> reader(wavFormat.createReaderFor(new juce::MemoryInputStream(wavData, wavSize, false), true));
 
+    juce::AudioBuffer<float> sample;
     if (reader != nullptr)
     {
-        sampleBuffer.setSize(reader->numChannels, (int)reader->lengthInSamples);
-        reader->read(&sampleBuffer, 0, (int)reader->lengthInSamples, 0, true, true);
+        sample.setSize(reader->numChannels, (int)reader->lengthInSamples);
+        reader->read(&sample, 0, (int)reader->lengthInSamples, 0, true, true);
         std::cout << "✓ Audio sample loaded: " << reader->numChannels 
                   << " channels, " << reader->lengthInSamples << " samples" << std::endl;
     }
@@ -147,162 +258,141 @@ void AudioPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPer
     {
         std::cout << "✗ ERROR: Failed to load audio sample!" << std::endl;
     }
+    return InputSource::createFromBuffer (std::move (sample), "RawGTR.wav (embedded)");
+}
 
-    // Get bytecode for all engines
-    const uint8_t* aot_bytes = module_aot;
-    size_t aot_size = module_aot_len;
-    const uint8_t* wasm_bytes = module_wasm;
-    size_t wasm_size = module_wasm_len;
-    
-    std::cout << "\nModule sizes:" << std::endl;
-    std::cout << "  WASM: " << wasm_size << " bytes" << std::endl;
-    std::cout << "  AOT:  " << aot_size << " bytes" << std::endl;
-    std::cout << std::endl;
+void AudioPluginAudioProcessor::setInputSource (std::unique_ptr<InputSource> source)
+{
+    if (source == nullptr)
+        source = createEmbeddedInput();
 
-    // ========================================================================
-    // BENCHMARK 1: WAMR AOT Engine
-    // ========================================================================
-    std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
-    std::cout << "  Engine 1: WAMR AOT (Ahead-of-Time Compilation)" << std::endl;
-    std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
-    
-    auto wamr_start = std::chrono::high_resolution_clock::now();
-    
-    wamrEngine = wamr_aot_engine_new();
-    if (!wamrEngine) {
-        std::cout << "✗ Failed to create WAMR engine" << std::endl;
-    } else if (!wamr_aot_engine_load_module(wamrEngine, aot_bytes, aot_size)) {
-        std::cout << "✗ Failed to load WAMR module" << std::endl;
-        wamr_aot_engine_delete(wamrEngine);
-        wamrEngine = nullptr;
-    } else {
-        auto wamr_load = std::chrono::high_resolution_clock::now();
-        auto wamr_load_time = std::chrono::duration_cast<std::chrono::microseconds>(wamr_load - wamr_start).count();
-        
-        // Test execution with test input
-        float test_input = 1.0f;
-        float wamr_result = wamr_aot_engine_get_sample(wamrEngine, test_input);
-        auto wamr_end = std::chrono::high_resolution_clock::now();
-        auto wamr_exec_time = std::chrono::duration_cast<std::chrono::nanoseconds>(wamr_end - wamr_load).count();
-        
-        std::cout << "  ✓ Load time: " << wamr_load_time << " μs" << std::endl;
-        std::cout << "  ✓ First execution: " << wamr_exec_time << " ns" << std::endl;
-        std::cout << "  ✓ Result (1.0 * 0.5): " << wamr_result << std::endl;
-        
-        // Benchmark multiple calls
-        const int iterations = 10000;
-        auto bench_start = std::chrono::high_resolution_clock::now();
-        for (int i = 0; i < iterations; i++) {
-            wamr_aot_engine_get_sample(wamrEngine, test_input);
-        }
-        auto bench_end = std::chrono::high_resolution_clock::now();
-        auto total_time = std::chrono::duration_cast<std::chrono::microseconds>(bench_end - bench_start).count();
-        std::cout << "  ✓ " << iterations << " calls: " << total_time << " μs (" 
-                  << (total_time * 1000.0 / iterations) << " ns/call)" << std::endl;
-    }
+    // Preparing may wait for a streamed file's first block, so it happens
+    // before the lock; before the first prepareToPlay, that prepares it
+    if (preparedBlockSize > 0)
+        source->prepare (currentSampleRate, preparedBlockSize);
+    std::cout << "Input: " << source->getDescription() << std::endl;
+
+    std::lock_guard<std::mutex> lock (selectionLock);
+    activeInput.store (source.get(), std::memory_order_release);
+    if (inputSource != nullptr)
+        retiredInputs.push_back ({ std::move (inputSource), renderedBlocks.load (std::memory_order_acquire) + 1 });
+    inputSource = std::move (source);
+}
+
+juce::String AudioPluginAudioProcessor::getInputDescription()
+{
+    std::lock_guard<std::mutex> lock (selectionLock);
+    return inputSource != nullptr ? inputSource->getDescription() : juce::String();
+}
+
+uint64_t AudioPluginAudioProcessor::getInputUnderruns()
+{
+    std::lock_guard<std::mutex> lock (selectionLock);
+    return inputSource != nullptr ? inputSource->getUnderruns() : 0;
+}
+
+void AudioPluginAudioProcessor::loadEngines (int samplesPerBlock)
+{
+    // Engines are created, loaded and warmed up on this thread
+    DspEngine::attachCurrentThread();
+
+    std::cout << "\nModule sizes (scalar / SIMD):" << std::endl;
+    std::cout << "  WASM: " << getBuiltinModule (EngineType::Wasmi, ModuleVariant::Scalar).size << " / "
+              << getBuiltinModule (EngineType::Wasmi, ModuleVariant::Simd).size << " bytes" << std::endl;
+    std::cout << "  AOT:  " << getBuiltinModule (EngineType::WAMR, ModuleVariant::Scalar).size << " / "
+              << getBuiltinModule (EngineType::WAMR, ModuleVariant::Simd).size << " bytes" << std::endl;
     std::cout << std::endl;
 
-    // ========================================================================
-    // BENCHMARK 2: wasm2c Engine
-    // ========================================================================
-    std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
-    std::cout << "  Engine 2: wasm2c (WASM to C Transpilation)" << std::endl;
-    std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
-    
-    auto wasm2c_start = std::chrono::high_resolution_clock::now();
-    
-    wasm2cEngine = wasm2c_engine_new();
-    if (!wasm2cEngine) {
-        std::cout << "✗ Failed to create wasm2c engine" << std::endl;
-    } else {
-        auto wasm2c_load = std::chrono::high_resolution_clock::now();
-        auto wasm2c_load_time = std::chrono::duration_cast<std::chrono::microseconds>(wasm2c_load - wasm2c_start).count();
-        
-        // Test execution with test input
-        float test_input = 1.0f;
-        float wasm2c_result = wasm2c_engine_get_sample(wasm2cEngine, test_input);
-        auto wasm2c_end = std::chrono::high_resolution_clock::now();
-        auto wasm2c_exec_time = std::chrono::duration_cast<std::chrono::nanoseconds>(wasm2c_end - wasm2c_load).count();
-        
-        std::cout << "  ✓ Load time: " << wasm2c_load_time << " μs" << std::endl;
-        std::cout << "  ✓ First execution: " << wasm2c_exec_time << " ns" << std::endl;
-        std::cout << "  ✓ Result (1.0 * 0.5): " << wasm2c_result << std::endl;
-        
-        // Benchmark multiple calls
-        const int iterations = 10000;
-        auto bench_start = std::chrono::high_resolution_clock::now();
-        for (int i = 0; i < iterations; i++) {
-            wasm2c_engine_get_sample(wasm2cEngine, test_input);
+    static const char* const descriptions[numEngineTypes] = {
+        "Engine 1: WAMR AOT (Ahead-of-Time Compilation)",
+        "Engine 2: wasm2c (WASM to C Transpilation)",
+        "Engine 3: Wasmi (Stack-based Interpreter)",
+        "Engine 4: WAMR AOT through the checked call path (wrapper overhead)",
+        "Engine 5: wasm2c without inline memory checks, guarded by guard pages",
+        "Engine 6: wasm2c with explicit bounds checks",
+        "Engine 7: wasm2c without any memory checks",
+        "Engine 8: wasm2c compiled into the engine with a static instance",
+        "Engine 9: WAMR classic interpreter",
+        "Engine 10: WAMR fast interpreter",
+        "Engine 11: WAMR Fast JIT",
+        "Engine 12: WAMR LLVM JIT",
+        "Engine 13: WAMR multi-tier JIT (Fast JIT tiering up to LLVM JIT)"
+    };
+
+    std::vector<LoadedEngine> loaded;
+    for (int i = 0; i < numEngineTypes; ++i)
+    {
+        auto type = (EngineType) i;
+        if (shuttingDown.load())
+            return;
+
+        // Only one WAMR interpreter exists per build, and the JIT tiers
+        // depend on how the runtime was built
+        if (! isEngineAvailable (type))
+            continue;
+
+        // Re-preparing keeps engines that are already instantiated
+        if (readyEngines[(size_t) i].load() != nullptr)
+        {
+            std::cout << "  ✓ " << getEngineName (type) << ": reusing loaded engine" << std::endl;
+            continue;
         }
-        auto bench_end = std::chrono::high_resolution_clock::now();
-        auto total_time = std::chrono::duration_cast<std::chrono::microseconds>(bench_end - bench_start).count();
-        std::cout << "  ✓ " << iterations << " calls: " << total_time << " μs (" 
-                  << (total_time * 1000.0 / iterations) << " ns/call)" << std::endl;
-    }
-    std::cout << std::endl;
 
-    // ========================================================================
-    // BENCHMARK 3: Wasmi Engine
-    // ========================================================================
-    std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
-    std::cout << "  Engine 3: Wasmi (Stack-based Interpreter)" << std::endl;
-    std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
-    
-    auto wasmi_start = std::chrono::high_resolution_clock::now();
-    
-    wasmiEngine = wasmi_engine_new();
-    if (!wasmiEngine) {
-        std::cout << "✗ Failed to create Wasmi engine" << std::endl;
-    } else {
-        wasmiStore = wasmi_store_new(wasmiEngine);
-        if (!wasmiStore) {
-            std::cout << "✗ Failed to create Wasmi store" << std::endl;
+        std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
+        std::cout << "  " << descriptions[i] << std::endl;
+        std::cout << "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━" << std::endl;
+
+        auto engine = DspEngine::create (type);
+
+        if (engine == nullptr) {
+            std::cout << "✗ Failed to create " << getEngineName (type) << " engine" << std::endl;
+        } else if (! engine->loadBuiltinModule()) {
+            std::cout << "✗ Failed to load " << getEngineName (type) << " module" << std::endl;
         } else {
-            wasmiModule = wasmi_module_new(wasmiEngine, wasm_bytes, wasm_size);
-            if (!wasmiModule) {
-                std::cout << "✗ Failed to load Wasmi module" << std::endl;
-            } else {
-                wasmiInstance = wasmi_instance_new(wasmiStore, wasmiModule);
-                if (!wasmiInstance) {
-                    std::cout << "✗ Failed to instantiate Wasmi module" << std::endl;
-                } else {
-                    const char* func_name = "get_sample";
-                    wasmiFunc = wasmi_instance_get_func(wasmiStore, wasmiInstance, 
-                                                       (const uint8_t*)func_name, strlen(func_name));
-                    if (!wasmiFunc) {
-                        std::cout << "✗ Failed to get function from Wasmi" << std::endl;
-                    } else {
-                        auto wasmi_load = std::chrono::high_resolution_clock::now();
-                        auto wasmi_load_time = std::chrono::duration_cast<std::chrono::microseconds>(wasmi_load - wasmi_start).count();
-                        
-                        // Test execution with test input
-                        float test_input = 1.0f;
-                        float wasmi_result = wasmi_func_call_f32_to_f32(wasmiStore, wasmiFunc, test_input);
-                        
-                        auto wasmi_end = std::chrono::high_resolution_clock::now();
-                        auto wasmi_exec_time = std::chrono::duration_cast<std::chrono::nanoseconds>(wasmi_end - wasmi_load).count();
-                        
-                        std::cout << "  ✓ Load time: " << wasmi_load_time << " μs" << std::endl;
-                        std::cout << "  ✓ First execution: " << wasmi_exec_time << " ns" << std::endl;
-                        std::cout << "  ✓ Result (1.0 * 0.5): " << wasmi_result << std::endl;
-                        
-                        // Benchmark multiple calls
-                        const int iterations = 10000;
-                        auto bench_start = std::chrono::high_resolution_clock::now();
-                        for (int i = 0; i < iterations; i++) {
-                            wasmi_func_call_f32_to_f32(wasmiStore, wasmiFunc, test_input);
-                        }
-                        auto bench_end = std::chrono::high_resolution_clock::now();
-                        auto total_time = std::chrono::duration_cast<std::chrono::microseconds>(bench_end - bench_start).count();
-                        std::cout << "  ✓ " << iterations << " calls: " << total_time << " μs (" 
-                                  << (total_time * 1000.0 / iterations) << " ns/call)" << std::endl;
-                    }
-                }
+            // Test execution with test input
+            float test_input = 1.0f;
+            float result = 0.0f;
+            auto exec_start = std::chrono::high_resolution_clock::now();
+            engine->process (&test_input, &result, 1, ProcessMode::PerSample);
+            auto exec_end = std::chrono::high_resolution_clock::now();
+            auto exec_time = std::chrono::duration_cast<std::chrono::nanoseconds>(exec_end - exec_start).count();
+
+            std::cout << "  ✓ Load time: " << engine->getStats().loadTimeUs << " μs" << std::endl;
+            std::cout << "  ✓ First execution: " << exec_time << " ns" << std::endl;
+            std::cout << "  ✓ Result (1.0 * 0.2): " << result << std::endl;
+
+            // The SIMD build of the module is benchmarked side by side, block path only
+            auto simd = DspEngine::create (type, ModuleVariant::Simd);
+            if (simd == nullptr || ! simd->loadBuiltinModule()) {
+                std::cout << "  SIMD module: unsupported by " << getEngineName (type) << std::endl;
+                simd = nullptr;
             }
+            loaded.push_back ({ type, std::move (engine), std::move (simd) });
         }
+        std::cout << std::endl;
+    }
+
+    // The engines are benchmarked together, then published: none is in use
+    // by the audio thread while it is being timed
+    if (! loaded.empty() && ! shuttingDown.load())
+        benchmarkEngines (loaded, samplesPerBlock, shuttingDown);
+    if (shuttingDown.load())
+        return;
+
+    for (auto& l : loaded)
+    {
+        auto memory = l.engine->getMemoryUsage();
+        std::cout << "  " << getEngineName (l.type) << " memory: " << memory.linearMemoryBytes / 1024 << " KB linear ("
+                  << memory.heapBytes / 1024 << " KB heap), " << memory.runtimeBytes / 1024 << " KB runtime, stack "
+                  << memory.stackHighWaterBytes << " / " << memory.stackBytes << " bytes used, "
+                  << memory.codeBytes / 1024 << " KB code" << std::endl;
+
+        // The benchmark left state behind; start the audio stream clean
+        l.engine->reset();
+        publishEngine (l.type, std::move (l.engine));
     }
     std::cout << std::endl;
-    
+
     std::cout << "╔══════════════════════════════════════════════════════════════╗" << std::endl;
     std::cout << "║  All engines initialized and benchmarked                     ║" << std::endl;
     std::cout << "║  Ready to process audio!                                     ║" << std::endl;
@@ -312,8 +402,9 @@ void AudioPluginAudioProcessor::prepareToPlay (double sampleRate, int samplesPer
 
 void AudioPluginAudioProcessor::releaseResources()
 {
-    // When playback stops, you can use this as an opportunity to free up any
-    // spare memory, etc.
+    // The audio thread is stopped, so no replaced engine or input is still in use
+    std::lock_guard<std::mutex> lock (selectionLock);
+    freeRetired (true);
 }
 
 bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
@@ -322,12 +413,10 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
     juce::ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Every channel is processed independently, so any layout works up to
+    // the number of planar channels the module ABI provides
+    auto numChannels = layouts.getMainOutputChannelSet().size();
+    if (numChannels < 1 || numChannels > DspEngine::maxChannels)
         return false;
 
     // This checks if the input layout matches the output layout
@@ -343,8 +432,6 @@ bool AudioPluginAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
 void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
                                               juce::MidiBuffer& midiMessages)
 {
-    juce::ignoreUnused (midiMessages);
-
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -353,56 +440,576 @@ void AudioPluginAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
-    int numSamples = buffer.getNumSamples();
+    auto* source = activeInput.load (std::memory_order_acquire);
+    int maxBlock = inputBlock.getNumSamples();
+    if (source == nullptr || maxBlock == 0)
+    {
+        buffer.clear();
+        renderedBlocks.fetch_add (1, std::memory_order_release);
+        return;
+    }
+
+    // Hosts may exceed the block size announced in prepareToPlay, so larger
+    // blocks are rendered in pieces the scratch buffers can hold
+    int hostSamples = buffer.getNumSamples();
+    for (int start = 0; start < hostSamples; start += maxBlock)
+        processSubBlock (*source, buffer, midiMessages, start, juce::jmin (maxBlock, hostSamples - start));
+}
+
+void AudioPluginAudioProcessor::processSubBlock (InputSource& source, juce::AudioBuffer<float>& buffer,
+                                                 const juce::MidiBuffer& midiMessages, int startSample, int numSamples)
+{
     int bufferChannels = buffer.getNumChannels();
-    int sampleChannels = sampleBuffer.getNumChannels();
+    int remainingSamples = buffer.getNumSamples() - startSample;
+
+    // The input source fills the block, cycling through its channels when
+    // the bus has more of them
+    int numChannels = juce::jmin (bufferChannels, DspEngine::maxChannels);
+    source.read (inputBlock.getArrayOfWritePointers(), numChannels, numSamples);
 
-    for (int sample = 0; sample < numSamples; ++sample)
+    const float* const* input = inputBlock.getArrayOfReadPointers();
+    std::array<float*, DspEngine::maxChannels> outputPointers;
+    for (int channel = 0; channel < numChannels; ++channel)
+        outputPointers[(size_t) channel] = buffer.getWritePointer (channel, startSample);
+    float* const* output = outputPointers.data();
+
+    // Set up runtime thread state once per audio thread (and engine rebuild)
+    // rather than checking it on every call
+    thread_local uint32_t attachedGeneration = 0;
+    auto generation = engineGeneration.load (std::memory_order_relaxed);
+    if (attachedGeneration != generation)
     {
-        // Get the audio file sample as input
-        float input_sample = sampleBuffer.getSample(0, currentPosition);
-        
-        // Process with all three engines
-        float wamr_sample = 0.0f;
-        float wasm2c_sample = 0.0f;
-        float wasmi_sample = 0.0f;
-        
-        if (wamrEngine) {
-            wamr_sample = wamr_aot_engine_get_sample(wamrEngine, input_sample);
+        DspEngine::attachCurrentThread();
+        attachedGeneration = generation;
+    }
+
+    // Only the selected engine runs; a switch takes effect at the next block
+    auto* engine = activeEngine.load (std::memory_order_acquire);
+    auto mode = processMode.load (std::memory_order_relaxed);
+    auto updateMode = paramUpdateMode->load (std::memory_order_relaxed) >= 0.5f ? ParamUpdateMode::SampleAccurate
+                                                                                  : ParamUpdateMode::PerBlock;
+    int numChanges = engine != nullptr ? collectParamChanges (*engine, numSamples, remainingSamples, updateMode) : 0;
+    int numEvents = collectMidiEvents (midiMessages, startSample, numSamples, buffer.getNumSamples());
+
+    // Oversampled, the engines render factor times as many samples between an
+    // upsampling and a downsampling pass, with every offset scaled to match
+    int factor = getOversamplingFactor();
+    oversampler.setFactor (factor);
+    int engineSamples = numSamples * factor;
+    int engineRate = getEngineSampleRate (factor);
+    auto scaleChanges = [this, factor] (int count)
+    {
+        for (int i = 0; i < count; ++i)
+            paramChanges[(size_t) i].sampleOffset *= factor;
+    };
+    scaleChanges (numChanges);
+
+    const MidiEvent* events = midiEvents.data();
+    if (factor > 1)
+    {
+        for (int i = 0; i < numEvents; ++i)
+        {
+            oversampledMidi[(size_t) i] = midiEvents[(size_t) i];
+            oversampledMidi[(size_t) i].sampleOffset *= factor;
         }
-        
-        if (wasm2cEngine) {
-            wasm2c_sample = wasm2c_engine_get_sample(wasm2cEngine, input_sample);
+        events = oversampledMidi.data();
+    }
+
+    // A new engine starts its lane from silence
+    bool switching = engine != previousEngine;
+    if (switching && factor > 1)
+    {
+        engineLane ^= 1;
+        oversampler.resetLane (engineLane);
+    }
+
+    // Counters only count the thread they were opened for, which the
+    // message thread learns from here
+    thread_local const int threadId = PerfCounters::getCurrentThreadId();
+    audioThreadId.store (threadId, std::memory_order_relaxed);
+    auto* counters = activeCounters.load (std::memory_order_acquire);
+    PerfCounts countsBefore, countsAfter;
+    bool counting = counters != nullptr && counters->getThreadId() == threadId && counters->read (countsBefore);
+
+    uint64_t resamplerNs = 0;
+    auto timeResampler = [&resamplerNs] (auto&& pass)
+    {
+        auto start = std::chrono::steady_clock::now();
+        pass();
+        resamplerNs += (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds> (
+            std::chrono::steady_clock::now() - start).count();
+    };
+
+    const float* const* engineInput = input;
+    if (factor > 1)
+        timeResampler ([&] { engineInput = oversampler.upsample (input, numChannels, numSamples); });
+
+    // Each channel is rendered straight into the host buffer, or into the
+    // engine's lane when oversampling
+    if (engine != nullptr)
+        engine->setSampleRate (engineRate);
+    auto blockStart = std::chrono::steady_clock::now();
+    renderBlock (engine, engineInput, factor > 1 ? oversampler.getOversampledOutput (engineLane) : output,
+                 numChannels, engineSamples, mode, paramChanges.data(), numChanges, updateMode, events, numEvents);
+    auto blockEnd = std::chrono::steady_clock::now();
+    counting = counting && counters->read (countsAfter);
+
+    if (factor > 1)
+        timeResampler ([&] { oversampler.downsample (engineLane, output, numChannels, numSamples); });
+
+    // The deadline covers the resampling too, since it shares the block period
+    auto elapsedNs = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds> (blockEnd - blockStart).count();
+    auto budgetNs = budgetNsPerSample.load (std::memory_order_relaxed) * numSamples;
+    auto statsIndex = (size_t) (engine != nullptr ? (int) engine->getType() : numEngineTypes);
+    blockLatency[statsIndex].record (elapsedNs, (double) (elapsedNs + resamplerNs) > budgetNs);
+    if (factor > 1)
+        resamplerLatency.record (resamplerNs, false);
+    if (counting)
+        blockCounters[statsIndex].add (PerfCounters::difference (countsBefore, countsAfter),
+                                       (uint64_t) engineSamples * (uint64_t) numChannels);
+
+    // The shadows get a copy of what this block's engine got
+    if (shadowRunner.isRunning())
+    {
+        std::array<float, numModuleParams> params;
+        for (int p = 0; p < numModuleParams; ++p)
+            params[(size_t) p] = paramValues[(size_t) p]->load (std::memory_order_relaxed);
+        shadowRunner.push (input, numChannels, numSamples, engine != nullptr ? engine->getType() : EngineType::Bypass,
+                           params.data(), midiEvents.data(), numEvents);
+    }
+
+    for (int channel = numChannels; channel < bufferChannels; ++channel)
+        buffer.clear (channel, startSample, numSamples);
+
+    // On a switch, crossfade from the previous engine's output over this block
+    if (switching)
+    {
+        float* const* fadeOut = fadeOutputs.getArrayOfWritePointers();
+        numChanges = previousEngine != nullptr ? collectParamChanges (*previousEngine, numSamples, remainingSamples, updateMode)
+                                               : 0;
+        scaleChanges (numChanges);
+        int fadeLane = engineLane ^ 1;
+        if (previousEngine != nullptr)
+            previousEngine->setSampleRate (engineRate);
+        renderBlock (previousEngine, engineInput, factor > 1 ? oversampler.getOversampledOutput (fadeLane) : fadeOut,
+                     numChannels, engineSamples, mode, paramChanges.data(), numChanges, updateMode, events, numEvents);
+        if (factor > 1)
+            oversampler.downsample (fadeLane, fadeOut, numChannels, numSamples);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            buffer.applyGainRamp (channel, startSample, numSamples, 0.0f, 1.0f);
+            buffer.addFromWithRamp (channel, startSample, fadeOut[channel], numSamples, 1.0f, 0.0f);
         }
-        
-        if (wasmiFunc && wasmiStore) {
-            wasmi_sample = wasmi_func_call_f32_to_f32(wasmiStore, wasmiFunc, input_sample);
+        previousEngine = engine;
+    }
+
+    // Lets replaced engines be freed once this block no longer uses them
+    renderedBlocks.fetch_add (1, std::memory_order_release);
+}
+
+int AudioPluginAudioProcessor::collectMidiEvents (const juce::MidiBuffer& midiMessages, int startSample, int numSamples,
+                                                  int hostSamples)
+{
+    // The module only takes channel messages; sysex and system messages are
+    // dropped, as is anything past the queue's capacity. Events outside the
+    // host block are moved to its nearest sample
+    int count = 0;
+    for (const auto metadata : midiMessages)
+    {
+        int position = juce::jlimit (0, hostSamples - 1, metadata.samplePosition);
+        if (position < startSample)
+            continue;
+        if (position >= startSample + numSamples || count == (int) midiEvents.size())
+            break;
+
+        const auto* data = metadata.data;
+        if (metadata.numBytes < 2 || metadata.numBytes > 3 || data[0] < 0x80 || data[0] >= 0xf0)
+            continue;
+
+        midiEvents[(size_t) count++] = { position - startSample, data[0], data[1],
+                                         (uint8_t) (metadata.numBytes == 3 ? data[2] : 0), 0 };
+    }
+    return count;
+}
+
+int AudioPluginAudioProcessor::collectParamChanges (const DspEngine& engine, int numSamples, int rampSamples,
+                                                    ParamUpdateMode mode)
+{
+    // Each engine remembers what it was last given, so one that was idle
+    // catches up when it's next rendered
+    std::array<float, numModuleParams> from, to;
+    bool changed = false;
+    for (int p = 0; p < numModuleParams; ++p)
+    {
+        from[(size_t) p] = engine.getParam ((ModuleParam) p);
+        to[(size_t) p] = paramValues[(size_t) p]->load (std::memory_order_relaxed);
+        changed |= from[(size_t) p] != to[(size_t) p];
+    }
+    if (! changed)
+        return 0;
+
+    int count = 0;
+    if (mode == ParamUpdateMode::PerBlock)
+    {
+        for (int p = 0; p < numModuleParams; ++p)
+            if (from[(size_t) p] != to[(size_t) p])
+                paramChanges[(size_t) count++] = { 0, (ModuleParam) p, to[(size_t) p] };
+        return count;
+    }
+
+    // JUCE hands the plugin one value per parameter per block rather than
+    // the automation points in between, so sample-accurate mode ramps to the
+    // new value in sub-blocks, each step applied on its first sample. A ramp
+    // longer than the block is cut off at its end, and the next block ramps
+    // on from wherever it got to
+    constexpr int changesPerParam = maxParamChanges / numModuleParams;
+    int interval = std::max (paramRampInterval, (rampSamples + changesPerParam - 1) / changesPerParam);
+    int steps = std::max (1, (rampSamples + interval - 1) / interval);
+    for (int step = 0; step < steps && step * interval < numSamples; ++step)
+    {
+        float position = (float) (step + 1) / (float) steps;
+        for (int p = 0; p < numModuleParams; ++p)
+            if (from[(size_t) p] != to[(size_t) p])
+                paramChanges[(size_t) count++] = { step * interval, (ModuleParam) p,
+                                                   from[(size_t) p] + (to[(size_t) p] - from[(size_t) p]) * position };
+    }
+    return count;
+}
+
+void AudioPluginAudioProcessor::setSelectedEngine (EngineType engine)
+{
+    std::lock_guard<std::mutex> lock (selectionLock);
+    selectedEngine.store (engine);
+
+    // Bypass (and engines not loaded yet, or that failed to) map to a null engine
+    DspEngine* target = engine == EngineType::Bypass ? nullptr : readyEngines[(size_t) engine].load();
+    activeEngine.store (target, std::memory_order_release);
+}
+
+void AudioPluginAudioProcessor::publishEngine (EngineType type, std::unique_ptr<DspEngine> engine)
+{
+    // Designed for the rate it will run at, so its first block doesn't redesign it
+    engine->setSampleRate (getEngineSampleRate (getOversamplingFactor()));
+
+    std::lock_guard<std::mutex> lock (selectionLock);
+    auto* published = engine.get();
+    auto& slot = engines[(size_t) type];
+    readyEngines[(size_t) type].store (published, std::memory_order_release);
+
+    // Make the audio thread re-attach before it can call into the new engine
+    engineGeneration.fetch_add (1);
+    if (selectedEngine.load() == type)
+        activeEngine.store (published, std::memory_order_release);
+
+    // A replaced engine may still be rendering, and is rendered once more as
+    // the crossfade source, so it is freed two blocks after the swap
+    if (slot != nullptr)
+        retiredEngines.push_back ({ std::move (slot), renderedBlocks.load (std::memory_order_acquire) + 2 });
+    slot = std::move (engine);
+
+    // The shadows restart together so none carries the replaced module's state
+    shadowRunner.invalidate();
+}
+
+void AudioPluginAudioProcessor::setShadowMode (bool enabled)
+{
+    shadowMode = enabled;
+    if (! enabled)
+        shadowRunner.stop();
+    else if (! shadowRunner.isRunning())
+        startShadowRunner();
+}
+
+void AudioPluginAudioProcessor::startShadowRunner()
+{
+    shadowRunner.resetReport();
+    shadowRunner.start ([this] { return createShadowEngines(); },
+                        [] (const std::string& message) { std::cout << "⚠ Shadow: " << message << std::endl; });
+}
+
+std::vector<std::unique_ptr<DspEngine>> AudioPluginAudioProcessor::createShadowEngines()
+{
+    // The sources are only collected under the lock, so instantiating
+    // doesn't hold up engine selection or publishing. Until the count drops
+    // back, freeRetired keeps any of them that get replaced meanwhile
+    std::vector<DspEngine*> sources;
+    {
+        std::lock_guard<std::mutex> lock (selectionLock);
+        for (auto& slot : readyEngines)
+            if (auto* engine = slot.load (std::memory_order_acquire))
+                sources.push_back (engine);
+        ++shadowInstantiations;
+    }
+
+    // createInstance only reads the loaded module, so the audio thread can
+    // keep rendering the sources. Their parameters are the audio thread's,
+    // so the shadows start from the host's values instead; wasm2c-static has
+    // a single instance and isn't shadowed
+    std::array<float, numModuleParams> params;
+    for (size_t p = 0; p < params.size(); ++p)
+        params[p] = paramValues[p]->load (std::memory_order_relaxed);
+
+    // They render the host's input without oversampling
+    std::vector<std::unique_ptr<DspEngine>> shadows;
+    for (auto* engine : sources)
+        if (auto instance = engine->createInstance (params))
+        {
+            instance->setSampleRate (getEngineSampleRate (1));
+            shadows.push_back (std::move (instance));
+        }
+
+    std::lock_guard<std::mutex> lock (selectionLock);
+    --shadowInstantiations;
+    return shadows;
+}
+
+void AudioPluginAudioProcessor::freeRetired (bool audioStopped)
+{
+    // A shadow may still be instantiating from a retired engine
+    if (shadowInstantiations > 0)
+        return;
+
+    auto rendered = renderedBlocks.load (std::memory_order_acquire);
+    retiredEngines.erase (std::remove_if (retiredEngines.begin(), retiredEngines.end(),
+                                          [rendered, audioStopped] (const RetiredEngine& retired)
+                                          {
+                                              return audioStopped || rendered >= retired.freeAfterBlock;
+                                          }),
+                          retiredEngines.end());
+    retiredInputs.erase (std::remove_if (retiredInputs.begin(), retiredInputs.end(),
+                                         [rendered, audioStopped] (const RetiredInput& retired)
+                                         {
+                                             return audioStopped || rendered >= retired.freeAfterBlock;
+                                         }),
+                         retiredInputs.end());
+    retiredCounters.erase (std::remove_if (retiredCounters.begin(), retiredCounters.end(),
+                                           [rendered, audioStopped] (const RetiredCounters& retired)
+                                           {
+                                               return audioStopped || rendered >= retired.freeAfterBlock;
+                                           }),
+                           retiredCounters.end());
+}
+
+void AudioPluginAudioProcessor::setModuleFile (const juce::File& file)
+{
+    moduleFile = file;
+    moduleFileTime = {};
+    aotFileTime = {};
+    checkModuleFile();
+}
+
+void AudioPluginAudioProcessor::checkModuleFile()
+{
+    if (moduleFile == juce::File())
+        return;
+
+    // The WAMR engines use an .aot next to a .wasm when there is one
+    auto aotFile = moduleFile.withFileExtension ("aot");
+    auto moduleTime = moduleFile.getLastModificationTime();
+    auto aotTime = aotFile.getLastModificationTime();
+    if (moduleTime == moduleFileTime && aotTime == aotFileTime)
+        return;
+
+    moduleFileTime = moduleTime;
+    aotFileTime = aotTime;
+    auto file = moduleFile;
+    loaderPool.addJob ([this, file] { reloadModule (file); });
+}
+
+// Read a module file and check it carries the wasm or WAMR AOT magic
+static bool readModuleFile (const juce::File& file, juce::MemoryBlock& bytes, bool& isAot)
+{
+    if (! file.existsAsFile() || ! file.loadFileAsData (bytes) || bytes.getSize() < 8)
+        return false;
+
+    auto* header = static_cast<const char*> (bytes.getData());
+    isAot = std::memcmp (header, "\0aot", 4) == 0;
+    return isAot || std::memcmp (header, "\0asm", 4) == 0;
+}
+
+void AudioPluginAudioProcessor::reloadModule (const juce::File& file)
+{
+    DspEngine::attachCurrentThread();
+
+    juce::MemoryBlock bytes, wasmBytes, aotBytes;
+    bool isAot = false;
+    if (! readModuleFile (file, bytes, isAot))
+    {
+        std::cout << "✗ Hot reload: " << file.getFullPathName() << " is not a wasm or AOT module" << std::endl;
+        return;
+    }
+    (isAot ? aotBytes : wasmBytes).swapWith (bytes);
+
+    bool siblingIsAot = false;
+    if (! isAot && readModuleFile (file.withFileExtension ("aot"), bytes, siblingIsAot) && siblingIsAot)
+        aotBytes.swapWith (bytes);
+
+    // wasm2c runs generated C compiled into the plugin, so it can't reload
+    for (auto type : { EngineType::Wasmi, EngineType::WAMR, EngineType::WAMRChecked,
+                       EngineType::WAMRClassicInterp, EngineType::WAMRFastInterp, EngineType::WAMRFastJit,
+                       EngineType::WAMRLlvmJit, EngineType::WAMRMultiTierJit })
+    {
+        if (shuttingDown.load())
+            return;
+        if (! isEngineAvailable (type))
+            continue;
+
+        // The WAMR engines prefer a prebuilt .aot; otherwise they compile the
+        // wasm (or map the image cached by an earlier compile)
+        auto& moduleBytes = isAotEngine (type) && (! aotBytes.isEmpty() || ! DspEngine::canCompileAot()) ? aotBytes : wasmBytes;
+        if (moduleBytes.isEmpty())
+            continue;
+
+        // Validate by loading, instantiating and running a test block
+        auto engine = DspEngine::create (type);
+        std::array<float, 256> input, output;
+        for (size_t i = 0; i < input.size(); ++i)
+            input[i] = std::sin ((float) i * 0.1f);
+
+        bool ok = engine != nullptr && engine->load (static_cast<const uint8_t*> (moduleBytes.getData()), moduleBytes.getSize())
+                  && engine->process (input.data(), output.data(), (int) input.size())
+                  && std::all_of (output.begin(), output.end(), [] (float x) { return std::isfinite (x); })
+                  && engine->reset();
+        if (! ok)
+        {
+            std::cout << "✗ Hot reload: " << getEngineName (type) << " rejected " << file.getFileName() << std::endl;
+            continue;
         }
-        
-        // Select which engine output to use based on selectedEngine
-        float selected_sample = 0.0f;
-        switch (selectedEngine) {
-            case EngineType::WAMR:
-                selected_sample = wamr_sample;
-                break;
-            case EngineType::Wasm2c:
-                selected_sample = wasm2c_sample;
-                break;
-            case EngineType::Wasmi:
-                selected_sample = wasmi_sample;
-                break;
-            case EngineType::Bypass:
-                selected_sample = input_sample;
-                break;
+
+        std::cout << "✓ Hot reload: " << getEngineName (type) << " loaded " << file.getFileName() << " in "
+                  << engine->getStats().loadTimeUs << " μs"
+                  << (engine->getAotSource() == AotSource::Compiled ? " (compiled)"
+                      : engine->getAotSource() == AotSource::Cached ? " (from AOT cache)" : "") << std::endl;
+        publishEngine (type, std::move (engine));
+    }
+}
+
+void AudioPluginAudioProcessor::parameterChanged (const juce::String& parameterID, float newValue)
+{
+    juce::ignoreUnused (parameterID, newValue);
+    triggerAsyncUpdate();
+}
+
+void AudioPluginAudioProcessor::handleAsyncUpdate()
+{
+    updateLatency();
+}
+
+void AudioPluginAudioProcessor::updateLatency()
+{
+    auto latency = Oversampler::getLatencySamples (getOversamplingFactor());
+    if (latency != getLatencySamples())
+        setLatencySamples (latency);
+}
+
+void AudioPluginAudioProcessor::timerCallback()
+{
+    checkModuleFile();
+
+    // Counters enabled before any audio, or the host moved processing to another thread
+    auto threadId = audioThreadId.load (std::memory_order_relaxed);
+    if (perfCountersEnabled.load() && threadId != 0 && (perfCounters == nullptr || perfCounters->getThreadId() != threadId))
+    {
+        if (! openPerfCounters())
+            setPerfCountersEnabled (false);
+    }
+
+    std::lock_guard<std::mutex> lock (selectionLock);
+    for (auto& slot : readyEngines)
+        if (auto* engine = slot.load (std::memory_order_acquire))
+            engine->drainDiagnostics ([engine] (const char* message)
+            {
+                std::cout << "[" << engine->getName() << "] " << message << std::endl;
+            });
+
+    freeRetired (false);
+}
+
+LatencySummary AudioPluginAudioProcessor::getLatencySummary (EngineType engine) const
+{
+    return blockLatency[(size_t) engine].getSummary();
+}
+
+void AudioPluginAudioProcessor::resetLatencyStats()
+{
+    for (auto& histogram : blockLatency)
+        histogram.reset();
+    resamplerLatency.reset();
+    for (auto& counters : blockCounters)
+        counters.reset();
+}
+
+bool AudioPluginAudioProcessor::openPerfCounters()
+{
+    std::unique_ptr<PerfCounters> counters;
+    auto threadId = audioThreadId.load (std::memory_order_relaxed);
+    if (threadId != 0)
+    {
+        counters = std::make_unique<PerfCounters>();
+        if (! counters->open (threadId))
+        {
+            perfCountersError = counters->getError();
+            return false;
         }
+    }
+    perfCountersError.clear();
 
-        for (int channel = 0; channel < bufferChannels; ++channel)
+    // Before any audio there is no thread to count; the timer opens them once there is
+    activeCounters.store (counters.get(), std::memory_order_release);
+    std::lock_guard<std::mutex> lock (selectionLock);
+    if (perfCounters != nullptr)
+        retiredCounters.push_back ({ std::move (perfCounters), renderedBlocks.load (std::memory_order_acquire) + 1 });
+    perfCounters = std::move (counters);
+    return true;
+}
+
+bool AudioPluginAudioProcessor::setPerfCountersEnabled (bool enabled)
+{
+    if (enabled)
+    {
+        // Before any audio, a trial open on this thread still reports what's missing
+        PerfCounters probe;
+        if (audioThreadId.load (std::memory_order_relaxed) == 0 && ! probe.open())
         {
-            float* out = buffer.getWritePointer(channel);
-            out[sample] = selected_sample;
+            perfCountersError = probe.getError();
+            return false;
         }
-        currentPosition = (currentPosition + 1) % sampleBuffer.getNumSamples();
+        if (! openPerfCounters())
+            return false;
+        for (auto& counters : blockCounters)
+            counters.reset();
     }
+    else
+    {
+        activeCounters.store (nullptr, std::memory_order_release);
+        std::lock_guard<std::mutex> lock (selectionLock);
+        if (perfCounters != nullptr)
+            retiredCounters.push_back ({ std::move (perfCounters), renderedBlocks.load (std::memory_order_acquire) + 1 });
+    }
+    perfCountersEnabled.store (enabled);
+    return true;
+}
+
+int AudioPluginAudioProcessor::getOversamplingFactor() const
+{
+    return 1 << juce::jlimit (0, 4, (int) oversamplingChoice->load (std::memory_order_relaxed));
+}
+
+int AudioPluginAudioProcessor::getEngineSampleRate (int oversamplingFactor) const
+{
+    return (int) std::lround (currentSampleRate) * oversamplingFactor;
+}
+
+PerfSummary AudioPluginAudioProcessor::getPerfSummary (EngineType engine) const
+{
+    return blockCounters[(size_t) engine].getSummary();
+}
+
+void AudioPluginAudioProcessor::setDeadlineFraction (double fraction)
+{
+    deadlineFraction.store (fraction);
+    budgetNsPerSample.store (fraction * 1.0e9 / currentSampleRate);
 }
 
 //==============================================================================
@@ -419,17 +1026,15 @@ juce::AudioProcessorEditor* AudioPluginAudioProcessor::createEditor()
 //==============================================================================
 void AudioPluginAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
-    juce::ignoreUnused (destData);
+    if (auto xml = parameters.copyState().createXml())
+        copyXmlToBinary (*xml, destData);
 }
 
 void AudioPluginAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
-    juce::ignoreUnused (data, sizeInBytes);
+    auto xml = getXmlFromBinary (data, sizeInBytes);
+    if (xml != nullptr && xml->hasTagName (parameters.state.getType()))
+        parameters.replaceState (juce::ValueTree::fromXml (*xml));
 }
 
 //==============================================================================
@@ -1,28 +1,22 @@
 #pragma once
 
 #include <juce_audio_processors/juce_audio_processors.h>
-#include "wamr_aot_wrapper.h"
-#include "wasm2c_wrapper.h"
-
-// Forward declarations for wasmi
-extern "C" {
-    typedef struct WasmiEngine WasmiEngine;
-    typedef struct WasmiStore WasmiStore;
-    typedef struct WasmiModule WasmiModule;
-    typedef struct WasmiInstance WasmiInstance;
-    typedef struct WasmiFunc WasmiFunc;
-}
-
-enum class EngineType
-{
-    WAMR = 0,
-    Wasm2c,
-    Wasmi,
-    Bypass
-};
+#include "DspEngine.h"
+#include "InputSource.h"
+#include "LatencyHistogram.h"
+#include "Oversampler.h"
+#include "PerfCounters.h"
+#include "ShadowRunner.h"
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
 
 //==============================================================================
-class AudioPluginAudioProcessor final : public juce::AudioProcessor
+class AudioPluginAudioProcessor final : public juce::AudioProcessor,
+                                        private juce::Timer,
+                                        private juce::AudioProcessorValueTreeState::Listener,
+                                        private juce::AsyncUpdater
 {
 public:
     //==============================================================================
@@ -62,29 +56,229 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
 
     //==============================================================================
-    EngineType getSelectedEngine() const { return selectedEngine; }
-    void setSelectedEngine(EngineType engine) { selectedEngine = engine; }
+    EngineType getSelectedEngine() const { return selectedEngine.load(); }
+
+    // Safe to call from any thread; the audio thread picks the engine up at
+    // the next block with a single atomic load. An engine that is still
+    // loading plays as bypass until it is ready
+    void setSelectedEngine (EngineType engine);
+
+    // Per-block latency of an engine as measured in processBlock; readable
+    // from any thread without locking
+    LatencySummary getLatencySummary (EngineType engine) const;
+    void resetLatencyStats();
+
+    // The oversampling parameter as a factor, and the time per block spent
+    // resampling around the engine (not included in the engine's latency)
+    int getOversamplingFactor() const;
+    LatencySummary getResamplerLatencySummary() const { return resamplerLatency.getSummary(); }
+
+    // Hardware counters per engine, per processed sample, counted around
+    // each block on the audio thread. Enabling fails, with the reason in
+    // getPerfCountersError, where perf_event_open isn't available or the
+    // PMU has no room for them; so does the timer, disabling them, if
+    // opening them for a new audio thread fails. Message thread only; the
+    // summaries are readable from any thread
+    bool setPerfCountersEnabled (bool enabled);
+    bool arePerfCountersEnabled() const { return perfCountersEnabled.load(); }
+    const std::string& getPerfCountersError() const { return perfCountersError; }
+    PerfSummary getPerfSummary (EngineType engine) const;
+
+    // A block misses its deadline when it takes longer than this fraction of
+    // the buffer period (block size / sample rate)
+    double getDeadlineFraction() const { return deadlineFraction.load(); }
+    void setDeadlineFraction (double fraction);
+
+    // Watch a module file and hot-reload it whenever it changes: a .wasm
+    // into Wasmi and the WAMR engines (which use the .aot beside it if there
+    // is one, else compile it), or an .aot into the WAMR engines alone. Each reload is validated and swapped in
+    // with a crossfade. Message thread only; an empty File stops watching
+    void setModuleFile (const juce::File& file);
+    juce::File getModuleFile() const { return moduleFile; }
+
+    ProcessMode getProcessMode() const { return processMode.load(); }
+    void setProcessMode(ProcessMode mode) { processMode.store(mode); }
+
+    // Gain, mix and tone (forwarded to the module's parameter block), how
+    // their changes are applied (once per block, or ramped in sub-blocks) and
+    // the oversampling factor the engines run at
+    juce::AudioProcessorValueTreeState& getParameters() { return parameters; }
+
+    // Shadow mode: a worker thread renders every block through fresh
+    // instances of all loaded engines and compares their output with the
+    // playing engine's instance (see ShadowRunner). Message thread only
+    void setShadowMode (bool enabled);
+    bool isShadowMode() const { return shadowMode; }
+    ShadowReport getShadowReport() const { return shadowRunner.getReport(); }
+
+    // What the engines process: a file or a test signal (see InputSource),
+    // nullptr for the embedded RawGTR.wav. Prepared here and swapped in at
+    // the next block; message thread only
+    void setInputSource (std::unique_ptr<InputSource> source);
+    juce::String getInputDescription();
+    uint64_t getInputUnderruns();
 
 private:
     //==============================================================================
-    juce::AudioBuffer<float> sampleBuffer;
-    int currentPosition = 0;
-
-    // WAMR AOT engine components
-    WamrAotEngine* wamrEngine = nullptr;
-    
-    // WASM2C engine components
-    Wasm2cEngine* wasm2cEngine = nullptr;
-    
-    // Wasmi engine components
-    WasmiEngine* wasmiEngine = nullptr;
-    WasmiStore* wasmiStore = nullptr;
-    WasmiModule* wasmiModule = nullptr;
-    WasmiInstance* wasmiInstance = nullptr;
-    WasmiFunc* wasmiFunc = nullptr;
-    
-    // Engine selection
-    EngineType selectedEngine = EngineType::Bypass;
+    // Drains engine diagnostics off the audio thread
+    void timerCallback() override;
+
+    // The oversampling parameter may change on any thread; the host hears
+    // about the new resampling delay from the message thread
+    void parameterChanged (const juce::String& parameterID, float newValue) override;
+    void handleAsyncUpdate() override;
+    void updateLatency();
+
+    // Open counters for the thread the audio thread last reported, and hand
+    // them over; message thread only
+    bool openPerfCounters();
+
+    // Rate the engines run at: the host's, times the oversampling factor
+    int getEngineSampleRate (int oversamplingFactor) const;
+
+    static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
+
+    // Render numSamples of the host block from startSample, at most the
+    // prepared block size
+    void processSubBlock (InputSource& source, juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midiMessages,
+                          int startSample, int numSamples);
+
+    // Fill paramChanges with the first numSamples of what takes an engine's
+    // parameters to their current values over rampSamples; returns how many
+    // there are
+    int collectParamChanges (const DspEngine& engine, int numSamples, int rampSamples, ParamUpdateMode mode);
+
+    // Fill midiEvents with the channel messages of numSamples of a
+    // hostSamples block from startSample, timed from startSample; returns
+    // how many there are
+    int collectMidiEvents (const juce::MidiBuffer& midiMessages, int startSample, int numSamples, int hostSamples);
+
+    static std::unique_ptr<InputSource> createEmbeddedInput();
+
+    // Runs on the loader thread: creates and loads every engine that isn't
+    // ready yet, benchmarks them together, then publishes them
+    void loadEngines (int samplesPerBlock);
+    void reloadModule (const juce::File& file);
+
+    // Make an engine the one used for its type, retiring the one it replaces
+    void publishEngine (EngineType type, std::unique_ptr<DspEngine> engine);
+    void freeRetired (bool audioStopped);
+
+    // Runs on the shadow worker: one new instance of every loaded engine
+    // that can have more than one
+    std::vector<std::unique_ptr<DspEngine>> createShadowEngines();
+    void startShadowRunner();
+    void checkModuleFile();
+
+    // The input, swapped like an engine: owned under selectionLock, read by
+    // the audio thread through activeInput, and a replaced one is freed once
+    // the block that may be reading it has finished
+    std::unique_ptr<InputSource> inputSource;
+    std::atomic<InputSource*> activeInput { nullptr };
+    struct RetiredInput
+    {
+        std::unique_ptr<InputSource> source;
+        uint64_t freeAfterBlock;
+    };
+    std::vector<RetiredInput> retiredInputs;
+    int preparedBlockSize = 0;
+
+    // Per-block scratch: the gathered planar input and the previous engine's
+    // output while crossfading after a switch
+    juce::AudioBuffer<float> inputBlock;
+    juce::AudioBuffer<float> fadeOutputs;
+
+    // All engines, indexed by EngineType. Slots are written by the loader
+    // thread under selectionLock and read elsewhere only through
+    // readyEngines. A replaced engine is retired until the audio thread has
+    // finished two more blocks, then freed off the audio thread
+    std::array<std::unique_ptr<DspEngine>, numEngineTypes> engines;
+    std::array<std::atomic<DspEngine*>, numEngineTypes> readyEngines {};
+
+    struct RetiredEngine
+    {
+        std::unique_ptr<DspEngine> engine;
+        uint64_t freeAfterBlock;
+    };
+    std::vector<RetiredEngine> retiredEngines;
+    std::atomic<uint64_t> renderedBlocks { 0 };
+    int shadowInstantiations = 0;  // Under selectionLock; nothing is freed while nonzero
+
+    // Hot-reload source, message thread only
+    juce::File moduleFile;
+    juce::Time moduleFileTime, aotFileTime;
+
+    // Engine the audio thread runs (nullptr = bypass), and the one it ran last
+    // block, which is only touched by the audio thread
+    std::atomic<DspEngine*> activeEngine { nullptr };
+    DspEngine* previousEngine = nullptr;
+
+    // Bumped whenever the engines are rebuilt so the audio thread re-attaches
+    std::atomic<uint32_t> engineGeneration { 1 };
+
+    // Engine selection; selectionLock orders selection changes against
+    // engines being published (the audio thread never takes it)
+    std::mutex selectionLock;
+    std::atomic<EngineType> selectedEngine { EngineType::Bypass };
+    std::atomic<ProcessMode> processMode { ProcessMode::Block };
+
+    // Parameters, with their values' atomics cached for the audio thread
+    juce::AudioProcessorValueTreeState parameters;
+    std::array<std::atomic<float>*, numModuleParams> paramValues {};
+    std::atomic<float>* paramUpdateMode = nullptr;
+    std::atomic<float>* oversamplingChoice = nullptr;
+
+    // Audio-thread resampling around the engines. The playing engine renders
+    // into engineLane; after a switch the previous one finishes its crossfade
+    // on the other lane so neither filter history is cut
+    Oversampler oversampler;
+    int engineLane = 0;
+
+    // Audio-thread scratch for one block's parameter changes. Sample-accurate
+    // updates step every paramRampInterval samples, or coarser when a block
+    // would need more changes than fit
+    static constexpr int maxParamChanges = 512;
+    static constexpr int paramRampInterval = 32;
+    std::array<ParamChange, maxParamChanges> paramChanges;
+
+    // Audio-thread scratch for one block's MIDI, handed to every engine that
+    // renders the block
+    std::array<MidiEvent, DspEngine::maxMidiEvents> midiEvents;
+    std::array<MidiEvent, DspEngine::maxMidiEvents> oversampledMidi;  // Offsets at the oversampled rate
+
+    // Block latency per engine, indexed by EngineType (Bypass included)
+    std::array<LatencyHistogram, numEngineTypes + 1> blockLatency;
+    LatencyHistogram resamplerLatency;
+
+    // Hardware counters count one thread, and opening them is no job for
+    // the audio thread, so it publishes its thread ID and the message
+    // thread opens them for it. They reach the audio thread through
+    // activeCounters, and a replaced set is retired like an engine. Their
+    // totals are indexed like blockLatency
+    std::unique_ptr<PerfCounters> perfCounters;
+    std::atomic<PerfCounters*> activeCounters { nullptr };
+    std::atomic<int> audioThreadId { 0 };
+    struct RetiredCounters
+    {
+        std::unique_ptr<PerfCounters> counters;
+        uint64_t freeAfterBlock;
+    };
+    std::vector<RetiredCounters> retiredCounters;
+    std::array<PerfAccumulator, numEngineTypes + 1> blockCounters;
+    std::atomic<bool> perfCountersEnabled { false };
+    std::string perfCountersError;
+    double currentSampleRate = 44100.0;
+    std::atomic<double> deadlineFraction { 0.5 };
+    std::atomic<double> budgetNsPerSample { 0.5 * 1.0e9 / 44100.0 };
+
+    // Differential execution of the other engines, fed by the audio thread
+    ShadowRunner shadowRunner;
+    bool shadowMode = false;
+
+    // Engine loading happens off the host's prepareToPlay thread. Declared
+    // last so it is stopped before the engines it fills are destroyed
+    std::atomic<bool> shuttingDown { false };
+    juce::ThreadPool loaderPool { 1 };
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioPluginAudioProcessor)
 };
@@ -0,0 +1,230 @@
+#include "ShadowRunner.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+    // Counters have a single writer, so a relaxed load/store pair is enough
+    void increment (std::atomic<uint64_t>& counter)
+    {
+        counter.store (counter.load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+void ShadowRunner::prepare (int blockSize)
+{
+    maxBlockSize = blockSize;
+    for (auto& slot : slots)
+        slot.input.assign ((size_t) (DspEngine::maxChannels * maxBlockSize), 0.0f);
+    writeIndex.store (0);
+    readIndex.store (0);
+}
+
+void ShadowRunner::start (CreateShadows createShadows, Log log)
+{
+    if (isRunning() || maxBlockSize == 0)
+        return;
+
+    readIndex.store (writeIndex.load());
+    rebuildRequested.store (true);
+    running.store (true, std::memory_order_release);
+    worker = std::thread ([this, createShadows = std::move (createShadows), log = std::move (log)]
+    {
+        run (createShadows, log);
+    });
+}
+
+void ShadowRunner::stop()
+{
+    running.store (false, std::memory_order_release);
+    if (worker.joinable())
+        worker.join();
+}
+
+void ShadowRunner::push (const float* const* input, int numChannels, int numSamples, EngineType reference,
+                         const float* params, const MidiEvent* events, int numEvents)
+{
+    if (! running.load (std::memory_order_relaxed))
+        return;
+
+    auto write = writeIndex.load (std::memory_order_relaxed);
+    if (write - readIndex.load (std::memory_order_acquire) >= (uint32_t) numSlots
+        || numSamples > maxBlockSize || numChannels > DspEngine::maxChannels)
+    {
+        increment (blocksDropped);
+        return;
+    }
+
+    auto& slot = slots[write % numSlots];
+    for (int ch = 0; ch < numChannels; ++ch)
+        std::memcpy (slot.input.data() + (size_t) (ch * maxBlockSize), input[ch], (size_t) numSamples * sizeof (float));
+    slot.numChannels = numChannels;
+    slot.numSamples = numSamples;
+    slot.reference = reference;
+    std::copy (params, params + numModuleParams, slot.params.begin());
+    slot.numEvents = std::min (numEvents, DspEngine::maxMidiEvents);
+    std::copy (events, events + slot.numEvents, slot.events.begin());
+
+    writeIndex.store (write + 1, std::memory_order_release);
+    increment (blocksQueued);
+}
+
+void ShadowRunner::setTolerance (uint64_t ulps, double absolute)
+{
+    ulpTolerance.store (ulps);
+    absTolerance.store (absolute);
+}
+
+ShadowReport ShadowRunner::getReport() const
+{
+    std::lock_guard<std::mutex> lock (reportLock);
+    auto copy = report;
+    copy.blocksQueued = blocksQueued.load (std::memory_order_relaxed);
+    copy.blocksDropped = blocksDropped.load (std::memory_order_relaxed);
+    return copy;
+}
+
+void ShadowRunner::resetReport()
+{
+    std::lock_guard<std::mutex> lock (reportLock);
+    for (auto& engine : report.engines)
+        engine = { engine.engine };
+}
+
+uint64_t ShadowRunner::ulpDistance (float a, float b)
+{
+    if (a == b)
+        return 0;  // Includes +0 and -0
+    if (std::isnan (a) || std::isnan (b))
+        return std::isnan (a) && std::isnan (b) ? 0 : std::numeric_limits<uint64_t>::max();
+
+    // Sign-magnitude bits mapped onto a line where neighbouring floats are
+    // neighbouring integers
+    auto ordered = [] (float x)
+    {
+        int32_t bits;
+        std::memcpy (&bits, &x, sizeof (bits));
+        return bits < 0 ? (int64_t) std::numeric_limits<int32_t>::min() - bits : (int64_t) bits;
+    };
+    auto distance = ordered (a) - ordered (b);
+    return (uint64_t) (distance < 0 ? -distance : distance);
+}
+
+void ShadowRunner::run (CreateShadows createShadows, Log log)
+{
+    DspEngine::attachCurrentThread();
+
+    while (running.load (std::memory_order_acquire))
+    {
+        if (rebuildRequested.exchange (false, std::memory_order_acq_rel))
+        {
+            shadows = createShadows();
+            outputs.assign (shadows.size(), std::vector<float> ((size_t) (DspEngine::maxChannels * maxBlockSize)));
+            blocksSinceRebuild = 0;
+
+            std::lock_guard<std::mutex> lock (reportLock);
+            for (auto& shadow : shadows)
+            {
+                auto type = shadow->getType();
+                if (std::none_of (report.engines.begin(), report.engines.end(),
+                                  [type] (const ShadowEngineReport& r) { return r.engine == type; }))
+                    report.engines.push_back ({ type });
+            }
+        }
+
+        auto read = readIndex.load (std::memory_order_relaxed);
+        if (read == writeIndex.load (std::memory_order_acquire))
+        {
+            std::this_thread::sleep_for (std::chrono::milliseconds (1));
+            continue;
+        }
+
+        compare (slots[read % numSlots], log);
+        readIndex.store (read + 1, std::memory_order_release);
+    }
+
+    shadows.clear();
+}
+
+void ShadowRunner::compare (const Slot& slot, const Log& log)
+{
+    ++blocksSinceRebuild;
+    if (shadows.size() < 2)
+        return;
+
+    const float* in[DspEngine::maxChannels];
+    float* out[DspEngine::maxChannels];
+    for (int ch = 0; ch < slot.numChannels; ++ch)
+        in[ch] = slot.input.data() + (size_t) (ch * maxBlockSize);
+
+    // Every shadow gets the block's parameter values up front and its MIDI
+    std::vector<bool> rendered (shadows.size());
+    for (size_t i = 0; i < shadows.size(); ++i)
+    {
+        auto& shadow = *shadows[i];
+        std::array<ParamChange, numModuleParams> changes;
+        int numChanges = 0;
+        for (int p = 0; p < numModuleParams; ++p)
+            if (shadow.getParam ((ModuleParam) p) != slot.params[(size_t) p])
+                changes[(size_t) numChanges++] = { 0, (ModuleParam) p, slot.params[(size_t) p] };
+
+        if (slot.numEvents > 0)
+            shadow.queueMidi (slot.events.data(), slot.numEvents);
+
+        for (int ch = 0; ch < slot.numChannels; ++ch)
+            out[ch] = outputs[i].data() + (size_t) (ch * maxBlockSize);
+        rendered[i] = shadow.process (in, out, slot.numChannels, slot.numSamples, changes.data(), numChanges,
+                                      ParamUpdateMode::PerBlock);
+    }
+
+    size_t reference = 0;
+    for (size_t i = 0; i < shadows.size(); ++i)
+        if (shadows[i]->getType() == slot.reference)
+            reference = i;
+
+    const auto ulps = ulpTolerance.load (std::memory_order_relaxed);
+    const auto absolute = absTolerance.load (std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock (reportLock);
+    report.reference = shadows[reference]->getType();
+    for (size_t i = 0; i < shadows.size(); ++i)
+    {
+        if (i == reference)
+            continue;
+
+        double maxAbs = 0.0;
+        uint64_t maxUlps = 0;
+        bool divergent = ! rendered[i] || ! rendered[reference];
+        for (int ch = 0; ch < slot.numChannels; ++ch)
+        {
+            const float* expected = outputs[reference].data() + (size_t) (ch * maxBlockSize);
+            const float* actual = outputs[i].data() + (size_t) (ch * maxBlockSize);
+            for (int n = 0; n < slot.numSamples; ++n)
+            {
+                auto distance = ulpDistance (expected[n], actual[n]);
+                auto error = distance == 0 ? 0.0 : std::abs ((double) expected[n] - (double) actual[n]);
+                maxUlps = std::max (maxUlps, distance);
+                maxAbs = std::max (maxAbs, std::isnan (error) ? std::numeric_limits<double>::infinity() : error);
+                divergent |= distance > ulps && ! (error <= absolute);
+            }
+        }
+
+        auto type = shadows[i]->getType();
+        auto entry = std::find_if (report.engines.begin(), report.engines.end(),
+                                   [type] (const ShadowEngineReport& r) { return r.engine == type; });
+        if (entry == report.engines.end())
+            continue;
+
+        entry->blocks++;
+        entry->maxAbsError = std::max (entry->maxAbsError, maxAbs);
+        entry->maxUlps = std::max (entry->maxUlps, maxUlps);
+        if (divergent && entry->divergentBlocks++ == 0 && log)
+            log (std::string (getEngineName (type)) + " diverged from " + getEngineName (report.reference)
+                 + " at block " + std::to_string (blocksSinceRebuild)
+                 + (rendered[i] && rendered[reference]
+                        ? ": max error " + std::to_string (maxAbs) + " (" + std::to_string (maxUlps) + " ULPs)"
+                        : ": a block failed to render"));
+    }
+}
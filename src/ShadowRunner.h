@@ -0,0 +1,116 @@
+#pragma once
+
+#include "DspEngine.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How one shadow engine's output compared with the reference engine's
+struct ShadowEngineReport
+{
+    EngineType engine = EngineType::Bypass;
+    uint64_t blocks = 0;           // Blocks compared
+    uint64_t divergentBlocks = 0;  // Blocks outside the tolerance, or that failed to render
+    double maxAbsError = 0.0;
+    uint64_t maxUlps = 0;          // Largest distance in representable floats; NaN against a number is UINT64_MAX
+};
+
+struct ShadowReport
+{
+    EngineType reference = EngineType::Bypass;  // Engine the others were compared with last
+    uint64_t blocksQueued = 0;
+    uint64_t blocksDropped = 0;  // The worker fell behind and the queue was full
+    std::vector<ShadowEngineReport> engines;
+};
+
+//==============================================================================
+// Differential execution of every engine off the audio thread.
+//
+// The audio thread copies each block's input, parameter values and MIDI into
+// a single-producer/single-consumer ring of preallocated slots; it never
+// waits and never calls into an engine. A worker thread renders each block
+// through its own fresh instance of every engine and compares them all with
+// the instance of the engine the audio thread is playing (or the first
+// shadow, during bypass). The shadows start together, so their states stay
+// comparable whatever the audio thread's engines did before; they are
+// rebuilt together after an engine is replaced.
+class ShadowRunner
+{
+public:
+    using CreateShadows = std::function<std::vector<std::unique_ptr<DspEngine>>()>;
+    using Log = std::function<void (const std::string&)>;
+
+    static constexpr int numSlots = 16;
+
+    ~ShadowRunner() { stop(); }
+
+    // Size the slots for blocks of up to maxBlockSize samples. Not while running
+    void prepare (int maxBlockSize);
+
+    // Start the worker. It calls createShadows for its engine instances, at
+    // the start and after every invalidate, and reports divergence to log.
+    // Both are called on the worker thread
+    void start (CreateShadows createShadows, Log log);
+    void stop();
+    bool isRunning() const { return running.load (std::memory_order_acquire); }
+
+    // Audio thread: queue a block, or count it dropped if the worker is
+    // behind. reference is the engine playing it (Bypass for none); params
+    // holds numModuleParams values
+    void push (const float* const* input, int numChannels, int numSamples, EngineType reference,
+               const float* params, const MidiEvent* events, int numEvents);
+
+    // Have the worker rebuild its shadows before the next block
+    void invalidate() { rebuildRequested.store (true, std::memory_order_release); }
+
+    // A block diverges when some sample is more than ulpTolerance floats and
+    // more than absTolerance apart; the absolute floor keeps near-silent
+    // samples, where a few ULPs are nothing, from counting
+    void setTolerance (uint64_t ulps, double absolute);
+
+    // Safe from any non-audio thread
+    ShadowReport getReport() const;
+    void resetReport();
+
+    // Distance between two floats in representable values; 0 for two NaNs,
+    // since wasm leaves NaN bit patterns to the engine
+    static uint64_t ulpDistance (float a, float b);
+
+private:
+    struct Slot
+    {
+        std::vector<float> input;  // maxChannels planar channels of maxBlockSize
+        int numChannels = 0;
+        int numSamples = 0;
+        EngineType reference = EngineType::Bypass;
+        std::array<float, numModuleParams> params {};
+        std::array<MidiEvent, DspEngine::maxMidiEvents> events;
+        int numEvents = 0;
+    };
+
+    void run (CreateShadows createShadows, Log log);
+    void compare (const Slot& slot, const Log& log);
+
+    std::array<Slot, numSlots> slots;
+    int maxBlockSize = 0;
+    std::atomic<uint32_t> writeIndex { 0 }, readIndex { 0 };
+    std::atomic<bool> running { false }, rebuildRequested { false };
+    std::atomic<uint64_t> blocksQueued { 0 }, blocksDropped { 0 };
+    std::atomic<uint64_t> ulpTolerance { 64 };
+    std::atomic<double> absTolerance { 1.0e-6 };
+    std::thread worker;
+
+    // Worker-only scratch: one output per shadow
+    std::vector<std::unique_ptr<DspEngine>> shadows;
+    std::vector<std::vector<float>> outputs;
+    uint64_t blocksSinceRebuild = 0;
+
+    mutable std::mutex reportLock;
+    ShadowReport report;
+};
@@ -0,0 +1,65 @@
+#include "alloc_counter.h"
+#include <stdlib.h>
+
+// Keeps the pointer handed out aligned like malloc's
+typedef union {
+    size_t size;
+    max_align_t align;
+} Header;
+
+static void add(AllocCounter* counter, size_t size) {
+    size_t current = atomic_fetch_add_explicit(&counter->current, size, memory_order_relaxed) + size;
+    size_t peak = atomic_load_explicit(&counter->peak, memory_order_relaxed);
+    while (current > peak &&
+           !atomic_compare_exchange_weak_explicit(&counter->peak, &peak, current,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static void subtract(AllocCounter* counter, size_t size) {
+    atomic_fetch_sub_explicit(&counter->current, size, memory_order_relaxed);
+}
+
+void* alloc_counter_malloc(AllocCounter* counter, size_t size) {
+    Header* header = malloc(sizeof(Header) + size);
+    if (!header) return NULL;
+
+    header->size = size;
+    add(counter, size);
+    return header + 1;
+}
+
+void* alloc_counter_realloc(AllocCounter* counter, void* ptr, size_t size) {
+    if (!ptr) return alloc_counter_malloc(counter, size);
+
+    Header* header = (Header*)ptr - 1;
+    size_t old_size = header->size;
+    header = realloc(header, sizeof(Header) + size);
+    if (!header) return NULL;
+
+    // Only the change counts, so a block growing in place doesn't briefly
+    // count twice towards the peak
+    header->size = size;
+    if (size > old_size) {
+        add(counter, size - old_size);
+    } else {
+        subtract(counter, old_size - size);
+    }
+    return header + 1;
+}
+
+void alloc_counter_free(AllocCounter* counter, void* ptr) {
+    if (!ptr) return;
+
+    Header* header = (Header*)ptr - 1;
+    subtract(counter, header->size);
+    free(header);
+}
+
+size_t alloc_counter_current(AllocCounter* counter) {
+    return atomic_load_explicit(&counter->current, memory_order_relaxed);
+}
+
+size_t alloc_counter_peak(AllocCounter* counter) {
+    return atomic_load_explicit(&counter->peak, memory_order_relaxed);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Bytes a runtime has allocated through a wrapped allocator, now and at the
+// most. Every allocation carries a small header recording its size, so
+// these are for runtimes that take malloc/realloc/free hooks, not for
+// memory handed out by anything else
+typedef struct {
+    _Atomic size_t current;
+    _Atomic size_t peak;
+} AllocCounter;
+
+void* alloc_counter_malloc(AllocCounter* counter, size_t size);
+void* alloc_counter_realloc(AllocCounter* counter, void* ptr, size_t size);
+void alloc_counter_free(AllocCounter* counter, void* ptr);
+
+size_t alloc_counter_current(AllocCounter* counter);
+size_t alloc_counter_peak(AllocCounter* counter);
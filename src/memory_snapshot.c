@@ -0,0 +1,92 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // memfd_create
+#endif
+
+#include "memory_snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+
+static bool write_all(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written <= 0) return false;
+        data += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+// Back memory with a memfd holding its current contents, mapped private so
+// writes stay in the process and can be dropped again
+static bool map_copy_on_write(MemorySnapshot* snapshot, uint8_t* memory, size_t size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if (size == 0 || (uintptr_t)memory % page != 0 || size % page != 0) return false;
+
+    int fd = memfd_create("wasm-memory-snapshot", MFD_CLOEXEC);
+    if (fd < 0) return false;
+    if (!write_all(fd, memory, size)
+        || mmap(memory, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    snapshot->fd = fd;
+    snapshot->kind = MEMORY_SNAPSHOT_COPY_ON_WRITE;
+    return true;
+}
+
+#else
+
+static bool map_copy_on_write(MemorySnapshot* snapshot, uint8_t* memory, size_t size) {
+    (void)snapshot;
+    (void)memory;
+    (void)size;
+    return false;
+}
+
+#endif
+
+bool memory_snapshot_take(MemorySnapshot* snapshot, uint8_t* memory, size_t size, bool copy_on_write) {
+    memory_snapshot_release(snapshot);
+    snapshot->memory = memory;
+    snapshot->size = size;
+
+    if (copy_on_write && map_copy_on_write(snapshot, memory, size)) return true;
+
+    snapshot->copy = malloc(size > 0 ? size : 1);
+    if (!snapshot->copy) return false;
+    memcpy(snapshot->copy, memory, size);
+    snapshot->kind = MEMORY_SNAPSHOT_COPY;
+    return true;
+}
+
+MemorySnapshotKind memory_snapshot_restore(MemorySnapshot* snapshot, uint8_t* memory, size_t size) {
+    if (snapshot->kind == MEMORY_SNAPSHOT_NONE || memory != snapshot->memory || size != snapshot->size) {
+        return MEMORY_SNAPSHOT_NONE;
+    }
+
+#if defined(__linux__)
+    if (snapshot->kind == MEMORY_SNAPSHOT_COPY_ON_WRITE) {
+        return madvise(memory, size, MADV_DONTNEED) == 0 ? MEMORY_SNAPSHOT_COPY_ON_WRITE : MEMORY_SNAPSHOT_NONE;
+    }
+#endif
+
+    memcpy(memory, snapshot->copy, size);
+    return MEMORY_SNAPSHOT_COPY;
+}
+
+void memory_snapshot_release(MemorySnapshot* snapshot) {
+#if defined(__linux__)
+    // The mapping holds its own reference to the file
+    if (snapshot->kind == MEMORY_SNAPSHOT_COPY_ON_WRITE) close(snapshot->fd);
+#endif
+    free(snapshot->copy);
+    memset(snapshot, 0, sizeof(*snapshot));
+}
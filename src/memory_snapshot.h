@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// How a snapshot puts memory back
+typedef enum {
+    MEMORY_SNAPSHOT_NONE = 0,       // No snapshot, or it no longer matches the memory
+    MEMORY_SNAPSHOT_COPY,           // memcpy of the whole memory
+    MEMORY_SNAPSHOT_COPY_ON_WRITE   // Only the pages written since are dropped
+} MemorySnapshotKind;
+
+// A linear memory as it was right after instantiation, for resetting an
+// instance without instantiating it again.
+//
+// With copy_on_write (Linux, page-aligned memory the caller owns the mapping
+// of) the contents go into a memfd and the memory is remapped privately over
+// it, so the kernel tracks dirty pages: restoring discards just those, and
+// they read back from the snapshot on next touch. Otherwise, or if that
+// fails, the snapshot is a plain copy restored with memcpy
+typedef struct {
+    MemorySnapshotKind kind;
+    uint8_t* memory;  // Memory the snapshot was taken of
+    size_t size;
+    uint8_t* copy;    // MEMORY_SNAPSHOT_COPY only
+    int fd;           // MEMORY_SNAPSHOT_COPY_ON_WRITE only
+} MemorySnapshot;
+
+// Replaces any earlier snapshot; false (and kind NONE) if out of memory
+bool memory_snapshot_take(MemorySnapshot* snapshot, uint8_t* memory, size_t size, bool copy_on_write);
+
+// Put memory back as it was taken. Returns how, or MEMORY_SNAPSHOT_NONE
+// without touching it if memory has moved or changed size since
+MemorySnapshotKind memory_snapshot_restore(MemorySnapshot* snapshot, uint8_t* memory, size_t size);
+
+// Frees the copy. A copy-on-write memory stays mapped, with its contents,
+// until its owner unmaps it
+void memory_snapshot_release(MemorySnapshot* snapshot);
+
+#ifdef __cplusplus
+}
+#endif
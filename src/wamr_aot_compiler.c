@@ -0,0 +1,113 @@
+#include "wamr_aot_compiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if WAMR_RUNTIME_COMPILE
+#include <wasm_export.h>
+#include <aot_export.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/TargetMachine.h>
+
+bool wamr_aot_compiler_available(void) {
+    return true;
+}
+
+bool wamr_aot_compiler_host_target(char* buffer, size_t size) {
+    uint32_t major = 0, minor = 0, patch = 0;
+    wasm_runtime_get_version(&major, &minor, &patch);
+
+    // With no target given the compiler generates code for exactly this CPU
+    char* cpu = LLVMGetHostCPUName();
+    char* features = LLVMGetHostCPUFeatures();
+    int written = snprintf(buffer, size, "wamr-%u.%u.%u;%s;%s", major, minor, patch,
+                           cpu ? cpu : "", features ? features : "");
+    LLVMDisposeMessage(cpu);
+    LLVMDisposeMessage(features);
+    return written > 0 && (size_t)written < size;
+}
+
+static void set_error(char* error_buf, uint32_t error_buf_size, const char* stage, const char* detail) {
+    snprintf(error_buf, error_buf_size, "%s: %s", stage, detail ? detail : "unknown error");
+}
+
+uint8_t* wamr_aot_compile(const uint8_t* wasm_bytes, uint32_t size, const WamrCompileOptions* options,
+                          uint32_t* aot_size, char* error_buf, uint32_t error_buf_size) {
+    // The loader may patch the buffer it parses, so it gets a private copy
+    uint8_t* copy = malloc(size);
+    if (!copy) {
+        set_error(error_buf, error_buf_size, "load", "out of memory");
+        return NULL;
+    }
+    memcpy(copy, wasm_bytes, size);
+
+    uint8_t* aot = NULL;
+    aot_comp_data_t comp_data = NULL;
+    aot_comp_context_t comp_ctx = NULL;
+    wasm_module_t module = wasm_runtime_load(copy, size, error_buf, error_buf_size);
+    if (!module) goto done;
+
+    comp_data = aot_create_comp_data(module, NULL, false);
+    if (!comp_data) {
+        set_error(error_buf, error_buf_size, "compile", aot_get_last_error());
+        goto done;
+    }
+
+    // Matches wamrc's defaults apart from the caller's settings
+    AOTCompOption option = {0};
+    option.opt_level = options->opt_level;
+    option.size_level = options->size_level;
+    option.enable_simd = options->enable_simd;
+    option.enable_bulk_memory = true;
+    option.enable_ref_types = true;
+    option.output_format = AOT_FORMAT_FILE;
+    option.bounds_checks = 2;        // Platform default
+    option.stack_bounds_checks = 2;  // Platform default
+
+    comp_ctx = aot_create_comp_context(comp_data, &option);
+    if (!comp_ctx || !aot_compile_wasm(comp_ctx)) {
+        set_error(error_buf, error_buf_size, "compile", aot_get_last_error());
+        goto done;
+    }
+
+    aot = aot_emit_aot_file_buf(comp_ctx, comp_data, aot_size);
+    if (!aot) set_error(error_buf, error_buf_size, "emit", aot_get_last_error());
+
+done:
+    if (comp_ctx) aot_destroy_comp_context(comp_ctx);
+    if (comp_data) aot_destroy_comp_data(comp_data);
+    if (module) wasm_runtime_unload(module);
+    free(copy);
+    return aot;
+}
+
+void wamr_aot_compiler_free(uint8_t* aot_bytes) {
+    if (aot_bytes) aot_destroy_aot_file(aot_bytes);
+}
+
+#else
+
+bool wamr_aot_compiler_available(void) {
+    return false;
+}
+
+bool wamr_aot_compiler_host_target(char* buffer, size_t size) {
+    if (size > 0) buffer[0] = '\0';
+    return false;
+}
+
+uint8_t* wamr_aot_compile(const uint8_t* wasm_bytes, uint32_t size, const WamrCompileOptions* options,
+                          uint32_t* aot_size, char* error_buf, uint32_t error_buf_size) {
+    (void)wasm_bytes;
+    (void)size;
+    (void)options;
+    *aot_size = 0;
+    snprintf(error_buf, error_buf_size, "built without WAMR_RUNTIME_COMPILE");
+    return NULL;
+}
+
+void wamr_aot_compiler_free(uint8_t* aot_bytes) {
+    (void)aot_bytes;
+}
+
+#endif
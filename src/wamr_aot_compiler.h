@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Settings handed to the WAMR compiler. Every field changes the generated
+// code, so all of them are part of the AOT cache key
+typedef struct {
+    uint32_t opt_level;   // LLVM optimisation level, 0-3
+    uint32_t size_level;  // LLVM code size level, 0-3
+    bool enable_simd;     // Needed by modules built with -msimd128
+} WamrCompileOptions;
+
+// Whether this build links the WAMR compiler (WAMR_RUNTIME_COMPILE). Without
+// it wamr_aot_compile always fails
+bool wamr_aot_compiler_available(void);
+
+// Describe what compiled code depends on besides the module and options:
+// the WAMR version (AOT format) and the host CPU name and features
+bool wamr_aot_compiler_host_target(char* buffer, size_t size);
+
+// Compile wasm bytecode to an AOT image for the host CPU. Slow (LLVM), so
+// never on the audio thread. The WAMR runtime must be initialised, i.e. the
+// caller holds a WamrAotEngine. Free the image with wamr_aot_compiler_free
+uint8_t* wamr_aot_compile(const uint8_t* wasm_bytes, uint32_t size, const WamrCompileOptions* options,
+                          uint32_t* aot_size, char* error_buf, uint32_t error_buf_size);
+void wamr_aot_compiler_free(uint8_t* aot_bytes);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,23 +1,351 @@
 #include "wamr_aot_wrapper.h"
+#include "alloc_counter.h"
+#include "module_abi.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-#define HEAP_SIZE (512 * 1024)
-#define STACK_SIZE 8192
+#define DIAGNOSTIC_RING_SIZE 64  // Must be a power of two
 
-static char global_heap[HEAP_SIZE];
+// The WAMR runtime is process-wide; every engine and module holds a reference
+// so plugin instances (or voices) in one process never tear it down under
+// each other
+static pthread_mutex_t runtime_lock = PTHREAD_MUTEX_INITIALIZER;
+static int runtime_refs = 0;
+
+// Everything the runtime allocates goes through these, so its footprint can
+// be measured
+static AllocCounter runtime_allocations;
+
+static void* runtime_malloc(unsigned int size) {
+    return alloc_counter_malloc(&runtime_allocations, size);
+}
+
+static void* runtime_realloc(void* ptr, unsigned int size) {
+    return alloc_counter_realloc(&runtime_allocations, ptr, size);
+}
+
+static void runtime_free(void* ptr) {
+    alloc_counter_free(&runtime_allocations, ptr);
+}
+
+// A loaded module, shared by every instance created from it
+struct WamrAotModule {
+    _Atomic int refs;
+    wasm_module_t module;
+    uint8_t* bytes;  // WAMR may reference the buffer until the module is unloaded
+    uint32_t size;
+    bool mapped;     // bytes is a file mapping rather than a heap copy
+};
+
+static bool acquire_runtime(void) {
+    bool ok = true;
+    pthread_mutex_lock(&runtime_lock);
+    if (runtime_refs == 0) {
+        // Allocating from the heap gives each instance its own memory instead
+        // of carving every instance out of one fixed pool; counting it shows
+        // how large such a pool would have to be
+        RuntimeInitArgs init_args = {0};
+        init_args.mem_alloc_type = Alloc_With_Allocator;
+        init_args.mem_alloc_option.allocator.malloc_func = (void*)runtime_malloc;
+        init_args.mem_alloc_option.allocator.realloc_func = (void*)runtime_realloc;
+        init_args.mem_alloc_option.allocator.free_func = (void*)runtime_free;
+        ok = wasm_runtime_full_init(&init_args);
+    }
+    if (ok) runtime_refs++;
+    pthread_mutex_unlock(&runtime_lock);
+    return ok;
+}
+
+static void release_runtime(void) {
+    pthread_mutex_lock(&runtime_lock);
+    if (--runtime_refs == 0) {
+        wasm_runtime_destroy();
+    }
+    pthread_mutex_unlock(&runtime_lock);
+}
+
+static void free_bytes(uint8_t* bytes, uint32_t size, bool mapped) {
+    if (mapped) {
+        munmap(bytes, size);
+    } else {
+        free(bytes);
+    }
+}
+
+// Load a module from a buffer the module then owns, freeing it on failure
+static WamrAotModule* load_bytes(uint8_t* bytes, uint32_t size, bool mapped) {
+    if (!acquire_runtime()) {
+        free_bytes(bytes, size, mapped);
+        return NULL;
+    }
+
+    WamrAotModule* module = calloc(1, sizeof(WamrAotModule));
+    if (!module) {
+        free_bytes(bytes, size, mapped);
+        release_runtime();
+        return NULL;
+    }
+
+    module->bytes = bytes;
+    module->size = size;
+    module->mapped = mapped;
+    atomic_init(&module->refs, 1);
+
+    char error_buf[128];
+    module->module = wasm_runtime_load(module->bytes, size, error_buf, sizeof(error_buf));
+    if (!module->module) {
+        fprintf(stderr, "ERROR: Failed to load WAMR module: %s\n", error_buf);
+        free_bytes(bytes, size, mapped);
+        free(module);
+        release_runtime();
+        return NULL;
+    }
+    return module;
+}
+
+WamrAotModule* wamr_aot_module_load(const uint8_t* aot_bytes, uint32_t size) {
+    uint8_t* bytes = malloc(size);
+    if (!bytes) return NULL;
+
+    memcpy(bytes, aot_bytes, size);
+    return load_bytes(bytes, size, false);
+}
+
+WamrAotModule* wamr_aot_module_load_file(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0 || (uint64_t)info.st_size > UINT32_MAX) {
+        close(fd);
+        return NULL;
+    }
+
+    // A private writable mapping: WAMR may patch the buffer, and only the
+    // pages it actually reads are paged in
+    uint32_t size = (uint32_t)info.st_size;
+    void* bytes = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (bytes == MAP_FAILED) return NULL;
+
+    return load_bytes(bytes, size, true);
+}
+
+void wamr_aot_module_retain(WamrAotModule* module) {
+    atomic_fetch_add_explicit(&module->refs, 1, memory_order_relaxed);
+}
+
+void wamr_aot_module_release(WamrAotModule* module) {
+    if (!module) return;
+    if (atomic_fetch_sub_explicit(&module->refs, 1, memory_order_acq_rel) != 1) return;
+
+    wasm_runtime_unload(module->module);
+    free_bytes(module->bytes, module->size, module->mapped);
+    free(module);
+    release_runtime();
+}
+
+// Single-producer (processing thread) / single-consumer (logger) ring
+struct WamrDiagnosticRing {
+    _Atomic uint32_t head;  // Next slot to write, owned by the producer
+    _Atomic uint32_t tail;  // Next slot to read, owned by the consumer
+    _Atomic uint32_t dropped;
+    WamrDiagnostic events[DIAGNOSTIC_RING_SIZE];
+};
+
+// Queue a diagnostic without locking, allocating or blocking
+static void push_diagnostic(WamrAotEngine* engine, WamrDiagnosticCode code, const char* message) {
+    struct WamrDiagnosticRing* ring = engine->diagnostics;
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= DIAGNOSTIC_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    WamrDiagnostic* event = &ring->events[head & (DIAGNOSTIC_RING_SIZE - 1)];
+    event->code = code;
+    strncpy(event->message, message ? message : "", WAMR_DIAGNOSTIC_MESSAGE_SIZE - 1);
+    event->message[WAMR_DIAGNOSTIC_MESSAGE_SIZE - 1] = '\0';
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+bool wamr_aot_engine_pop_diagnostic(WamrAotEngine* engine, WamrDiagnostic* diagnostic) {
+    struct WamrDiagnosticRing* ring = engine->diagnostics;
+
+    uint32_t dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+    if (dropped > 0) {
+        diagnostic->code = WAMR_DIAG_DROPPED;
+        snprintf(diagnostic->message, sizeof(diagnostic->message), "%u diagnostics dropped", dropped);
+        return true;
+    }
+
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail == head) return false;
+
+    *diagnostic = ring->events[tail & (DIAGNOSTIC_RING_SIZE - 1)];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+// Report a failed call and clear the trap so the next call can run
+static void report_call_failure(WamrAotEngine* engine) {
+    push_diagnostic(engine, WAMR_DIAG_CALL_FAILED, wasm_runtime_get_exception(engine->instance));
+    wasm_runtime_clear_exception(engine->instance);
+}
+
+// Initialize WAMR thread environment for the calling thread (e.g., audio thread)
+// This is safe to call multiple times - it will return true if already initialized
+static bool ensure_thread_env(void) {
+    static __thread bool thread_env_initialized = false;
+    if (!thread_env_initialized) {
+        if (!wasm_runtime_init_thread_env()) {
+            fprintf(stderr, "ERROR: Failed to initialize WAMR thread environment!\n");
+            return false;
+        }
+        thread_env_initialized = true;
+        fprintf(stderr, "Initialized WAMR thread environment for audio processing thread\n");
+    }
+    return true;
+}
+
+// Call a buffer accessor export for an index and map the returned guest
+// address to a native pointer covering count floats
+static float* resolve_buffer(WamrAotEngine* engine, wasm_function_inst_t func, uint32_t index, uint32_t count) {
+    uint32_t argv[1] = { index };
+    if (!wasm_runtime_call_wasm(engine->exec_env, func, 1, argv)) return NULL;
+
+    uint64_t app_offset = argv[0];
+    if (!wasm_runtime_validate_app_addr(engine->instance, app_offset, count * sizeof(float))) {
+        return NULL;
+    }
+    return (float*)wasm_runtime_addr_app_to_native(engine->instance, app_offset);
+}
+
+static RunningMode running_mode(WamrTier tier) {
+    switch (tier) {
+        case WAMR_TIER_INTERP: return Mode_Interp;
+        case WAMR_TIER_FAST_JIT: return Mode_Fast_JIT;
+        case WAMR_TIER_LLVM_JIT: return Mode_LLVM_JIT;
+        case WAMR_TIER_MULTI_TIER_JIT: return Mode_Multi_Tier_JIT;
+        case WAMR_TIER_AOT: break;
+    }
+    return Mode_Default;
+}
+
+bool wamr_aot_tier_supported(WamrTier tier) {
+    return tier == WAMR_TIER_AOT || wasm_runtime_is_running_mode_supported(running_mode(tier));
+}
+
+// Create the instance, exec env and function handles from the loaded module
+static bool instantiate(WamrAotEngine* engine) {
+    char error_buf[128];
+
+    // Loads elsewhere in the process at the same time would be counted too
+    size_t allocated_before = alloc_counter_current(&runtime_allocations);
+    engine->instance = wasm_runtime_instantiate(engine->module->module, engine->stack_size, engine->heap_size,
+                                                error_buf, sizeof(error_buf));
+
+    if (!engine->instance) return false;
+
+    // Bytecode modules run in the engine's tier; AOT images are already native
+    if (engine->tier != WAMR_TIER_AOT
+        && !wasm_runtime_set_running_mode(engine->instance, running_mode(engine->tier))) {
+        return false;
+    }
+
+    engine->exec_env = wasm_runtime_create_exec_env(engine->instance, engine->stack_size);
+    if (!engine->exec_env) return false;
+
+    size_t allocated_after = alloc_counter_current(&runtime_allocations);
+    engine->instance_bytes = allocated_after > allocated_before ? allocated_after - allocated_before : 0;
+
+    engine->get_sample_func = wasm_runtime_lookup_function(engine->instance, "get_sample");
+    if (!engine->get_sample_func) return false;
+
+    // Resolve the block ABI; modules without it only support the per-sample path
+    engine->process_block_func = wasm_runtime_lookup_function(engine->instance, "process_block");
+    engine->set_num_channels_func = wasm_runtime_lookup_function(engine->instance, "set_num_channels");
+    engine->memory_info_func = wasm_runtime_lookup_function(engine->instance, "memory_info");
+    engine->set_sample_rate_func = wasm_runtime_lookup_function(engine->instance, "set_sample_rate");
+    wasm_function_inst_t get_input = wasm_runtime_lookup_function(engine->instance, "get_input_buffer");
+    wasm_function_inst_t get_output = wasm_runtime_lookup_function(engine->instance, "get_output_buffer");
+    if (!engine->set_num_channels_func || !get_input || !get_output) {
+        engine->process_block_func = NULL;
+    }
+    for (uint32_t ch = 0; engine->process_block_func && ch < WASM_MODULE_MAX_CHANNELS; ch++) {
+        engine->input_buffers[ch] = resolve_buffer(engine, get_input, ch, WASM_MODULE_MAX_BLOCK_SIZE);
+        engine->output_buffers[ch] = resolve_buffer(engine, get_output, ch, WASM_MODULE_MAX_BLOCK_SIZE);
+        if (!engine->input_buffers[ch] || !engine->output_buffers[ch]) {
+            engine->process_block_func = NULL;
+        }
+    }
+
+    // Modules without parameters or MIDI still run, ignoring set_params and set_events
+    wasm_function_inst_t get_param = wasm_runtime_lookup_function(engine->instance, "get_param_buffer");
+    if (get_param) {
+        engine->param_block = resolve_buffer(engine, get_param, 0, WASM_MODULE_MAX_PARAMS);
+    }
+    wasm_function_inst_t get_events = wasm_runtime_lookup_function(engine->instance, "get_event_buffer");
+    if (get_events) {
+        engine->event_queue = (WasmMidiEventQueue*)resolve_buffer(engine, get_events, 0,
+                                                                  sizeof(WasmMidiEventQueue) / sizeof(float));
+    }
+    engine->num_channels = 1;  // The module starts out mono
+
+    // Nothing has run in the instance yet, so this is what a restore returns to
+    wasm_memory_inst_t memory = wasm_runtime_get_default_memory(engine->instance);
+    if (memory) {
+        memory_snapshot_take(&engine->memory_snapshot, (uint8_t*)wasm_memory_get_base_address(memory),
+                             wamr_aot_engine_linear_memory_size(engine), false);
+    }
+    return true;
+}
+
+
+static void deinstantiate(WamrAotEngine* engine) {
+    memory_snapshot_release(&engine->memory_snapshot);
+    if (engine->exec_env) wasm_runtime_destroy_exec_env(engine->exec_env);
+    if (engine->instance) wasm_runtime_deinstantiate(engine->instance);
+    engine->exec_env = NULL;
+    engine->instance = NULL;
+    engine->get_sample_func = NULL;
+    engine->process_block_func = NULL;
+    engine->set_num_channels_func = NULL;
+    engine->memory_info_func = NULL;
+    engine->set_sample_rate_func = NULL;
+    engine->param_block = NULL;
+    engine->event_queue = NULL;
+    engine->instance_bytes = 0;
+    memset(engine->input_buffers, 0, sizeof(engine->input_buffers));
+    memset(engine->output_buffers, 0, sizeof(engine->output_buffers));
+}
+
+WamrAotEngine* wamr_aot_engine_new(WamrTier tier) {
+    if (!wamr_aot_tier_supported(tier)) return NULL;
 
-WamrAotEngine* wamr_aot_engine_new(void) {
     WamrAotEngine* engine = calloc(1, sizeof(WamrAotEngine));
     if (!engine) return NULL;
+    engine->tier = tier;
+    engine->heap_size = WAMR_DEFAULT_HEAP_SIZE;
+    engine->stack_size = WAMR_DEFAULT_STACK_SIZE;
 
-    RuntimeInitArgs init_args = {0};
-    init_args.mem_alloc_type = Alloc_With_Pool;
-    init_args.mem_alloc_option.pool.heap_buf = global_heap;
-    init_args.mem_alloc_option.pool.heap_size = sizeof(global_heap);
+    engine->diagnostics = calloc(1, sizeof(struct WamrDiagnosticRing));
+    if (!engine->diagnostics) {
+        free(engine);
+        return NULL;
+    }
 
-    if (!wasm_runtime_full_init(&init_args)) {
+    if (!acquire_runtime()) {
+        free(engine->diagnostics);
         free(engine);
         return NULL;
     }
@@ -25,63 +353,168 @@ WamrAotEngine* wamr_aot_engine_new(void) {
     return engine;
 }
 
+WamrAotEngine* wamr_aot_engine_new_instance(WamrAotEngine* source) {
+    if (!source->module) return NULL;
+
+    WamrAotEngine* engine = wamr_aot_engine_new(source->tier);
+    if (!engine) return NULL;
+    engine->heap_size = source->heap_size;
+    engine->stack_size = source->stack_size;
+
+    wamr_aot_module_retain(source->module);
+    engine->module = source->module;
+    if (!instantiate(engine)) {
+        wamr_aot_engine_delete(engine);
+        return NULL;
+    }
+    return engine;
+}
+
 void wamr_aot_engine_delete(WamrAotEngine* engine) {
     if (!engine) return;
-    if (engine->exec_env) wasm_runtime_destroy_exec_env(engine->exec_env);
-    if (engine->instance) wasm_runtime_deinstantiate(engine->instance);
-    if (engine->module) wasm_runtime_unload(engine->module);
-    wasm_runtime_destroy();
+    deinstantiate(engine);
+    wamr_aot_module_release(engine->module);
+    release_runtime();
+    free(engine->diagnostics);
     free(engine);
 }
 
-bool wamr_aot_engine_load_module(WamrAotEngine* engine, const uint8_t* aot_bytes, uint32_t size) {
-    char error_buf[128];
+// Replace the engine's instance and module with an instance of module,
+// which the engine takes ownership of
+static WamrLoadResult adopt_module(WamrAotEngine* engine, WamrAotModule* module) {
+    deinstantiate(engine);
+    wamr_aot_module_release(engine->module);
+    engine->module = module;
+    if (!engine->module) return WAMR_LOAD_MODULE_FAILED;
+    if (instantiate(engine)) return WAMR_LOAD_OK;
+
+    deinstantiate(engine);
+    wamr_aot_module_release(engine->module);
+    engine->module = NULL;
+    return WAMR_LOAD_INSTANTIATE_FAILED;
+}
+
+WamrLoadResult wamr_aot_engine_load_module(WamrAotEngine* engine, const uint8_t* aot_bytes, uint32_t size) {
+    return adopt_module(engine, wamr_aot_module_load(aot_bytes, size));
+}
 
-    engine->module = wasm_runtime_load(aot_bytes, size, error_buf, sizeof(error_buf));
+WamrLoadResult wamr_aot_engine_load_file(WamrAotEngine* engine, const char* path) {
+    return adopt_module(engine, wamr_aot_module_load_file(path));
+}
+
+bool wamr_aot_engine_reset(WamrAotEngine* engine) {
     if (!engine->module) return false;
+    deinstantiate(engine);
+    return instantiate(engine);
+}
 
-    engine->instance = wasm_runtime_instantiate(engine->module, STACK_SIZE, HEAP_SIZE,
-                                                error_buf, sizeof(error_buf));
+MemorySnapshotKind wamr_aot_engine_restore(WamrAotEngine* engine) {
+    if (!engine->instance) return MEMORY_SNAPSHOT_NONE;
+
+    wasm_memory_inst_t memory = wasm_runtime_get_default_memory(engine->instance);
+    if (!memory) return MEMORY_SNAPSHOT_NONE;
+    MemorySnapshotKind kind = memory_snapshot_restore(&engine->memory_snapshot,
+                                                      (uint8_t*)wasm_memory_get_base_address(memory),
+                                                      wamr_aot_engine_linear_memory_size(engine));
+    if (kind == MEMORY_SNAPSHOT_NONE) return kind;
+
+    wasm_runtime_clear_exception(engine->instance);
+    engine->num_channels = 1;
+    return kind;
+}
+
+void wamr_aot_engine_set_memory_config(WamrAotEngine* engine, uint32_t heap_size, uint32_t stack_size) {
+    engine->heap_size = heap_size;
+    engine->stack_size = stack_size;
+}
 
+void wamr_aot_runtime_allocated_bytes(size_t* current, size_t* peak) {
+    *current = alloc_counter_current(&runtime_allocations);
+    *peak = alloc_counter_peak(&runtime_allocations);
+}
+
+size_t wamr_aot_engine_linear_memory_size(WamrAotEngine* engine) {
+    if (!engine->instance) return 0;
+
+    wasm_memory_inst_t memory = wasm_runtime_get_default_memory(engine->instance);
+    if (!memory) return 0;
+    return (size_t)(wasm_memory_get_cur_page_count(memory) * wasm_memory_get_bytes_per_page(memory));
+}
+
+size_t wamr_aot_engine_code_size(WamrAotEngine* engine) {
+    return engine->module ? engine->module->size : 0;
+}
+
+int32_t wamr_aot_engine_memory_info(WamrAotEngine* engine, int32_t query) {
+    if (!engine->memory_info_func) return -1;
+
+    uint32_t argv[1] = { (uint32_t)query };
+    if (!wasm_runtime_call_wasm(engine->exec_env, engine->memory_info_func, 1, argv)) {
+        wasm_runtime_clear_exception(engine->instance);
+        return -1;
+    }
+    return (int32_t)argv[0];
+}
+
+bool wamr_aot_engine_set_kernel(WamrAotEngine* engine, int32_t kernel) {
     if (!engine->instance) return false;
 
-    engine->exec_env = wasm_runtime_create_exec_env(engine->instance, STACK_SIZE);
-    if (!engine->exec_env) return false;
+    wasm_function_inst_t func = wasm_runtime_lookup_function(engine->instance, "set_kernel");
+    if (!func) return false;
 
-    engine->get_sample_func = wasm_runtime_lookup_function(engine->instance, "get_sample");
-    return engine->get_sample_func != NULL;
+    uint32_t argv[1] = { (uint32_t)kernel };
+    if (!wasm_runtime_call_wasm(engine->exec_env, func, 1, argv)) return false;
+    return (int32_t)argv[0] == kernel;
+}
+
+bool wamr_aot_engine_set_sample_rate(WamrAotEngine* engine, int32_t rate) {
+    if (!engine->set_sample_rate_func) return false;
+
+    uint32_t argv[1] = { (uint32_t)rate };
+    if (!wasm_runtime_call_wasm(engine->exec_env, engine->set_sample_rate_func, 1, argv)) {
+        report_call_failure(engine);
+        return false;
+    }
+    return (int32_t)argv[0] == rate;
+}
+
+// Only costs a call when the count changes
+bool wamr_aot_engine_set_num_channels(WamrAotEngine* engine, uint32_t num_channels) {
+    if (num_channels == engine->num_channels) return true;
+    if (!engine->set_num_channels_func) return false;
+
+    uint32_t argv[1] = { num_channels };
+    if (!wasm_runtime_call_wasm(engine->exec_env, engine->set_num_channels_func, 1, argv)) return false;
+    if (argv[0] != num_channels) return false;
+    engine->num_channels = num_channels;
+    return true;
 }
 
-float wamr_aot_engine_get_sample(WamrAotEngine* engine, float input) {
+float wamr_aot_engine_get_sample(WamrAotEngine* engine, uint32_t channel, float input, bool* trapped) {
     if (!engine->get_sample_func) {
-        printf("ERROR: get_sample_func is NULL!\n");
+        fprintf(stderr, "ERROR: get_sample_func is NULL!\n");
+        *trapped = true;
         return 0.0f;
     }
 
-    // Initialize WAMR thread environment for the calling thread (e.g., audio thread)
-    // This is safe to call multiple times - it will return true if already initialized
-    static __thread bool thread_env_initialized = false;
-    if (!thread_env_initialized) {
-        if (!wasm_runtime_init_thread_env()) {
-            printf("ERROR: Failed to initialize WAMR thread environment!\n");
-            return 0.0f;
-        }
-        thread_env_initialized = true;
-        printf("Initialized WAMR thread environment for audio processing thread\n");
+    if (!ensure_thread_env()) {
+        *trapped = true;
+        return 0.0f;
     }
 
     // Use the older argv-based call API instead of wasm_val_t
-    uint32_t argv[2];  // Input arg (float as uint32) + return value slot
-    argv[0] = *(uint32_t*)&input;  // Pass input sample as uint32_t representation
-    
+    uint32_t argv[2];  // Channel, then the input sample as its uint32 representation; the result comes back in argv[0]
+    argv[0] = channel;
+    argv[1] = *(uint32_t*)&input;
+
     // Call the function using the simpler API
-    if (wasm_runtime_call_wasm(engine->exec_env, engine->get_sample_func, 1, argv)) {
+    if (wasm_runtime_call_wasm(engine->exec_env, engine->get_sample_func, 2, argv)) {
         // Result is in argv[0] as uint32_t representation of float
         float result = *(float*)&argv[0];
         
         static int debug_count = 0;
         if (debug_count < 3) {
-            printf("WAMR call succeeded, result = %f\n", result);
+            fprintf(stderr, "WAMR call succeeded, result = %f\n", result);
             debug_count++;
         }
         return result;
@@ -89,9 +522,108 @@ float wamr_aot_engine_get_sample(WamrAotEngine* engine, float input) {
         static int error_count = 0;
         if (error_count < 1) {
             const char* exception = wasm_runtime_get_exception(engine->instance);
-            printf("ERROR: WAMR call failed! Exception: %s\n", exception ? exception : "none");
+            fprintf(stderr, "ERROR: WAMR call failed! Exception: %s\n", exception ? exception : "none");
             error_count++;
         }
+        *trapped = true;
         return 0.0f;
     }
 }
+
+bool wamr_aot_engine_process_block(WamrAotEngine* engine, const float* const* input, float* const* output,
+                                   uint32_t num_channels, uint32_t num_samples) {
+    if (!engine->process_block_func) return false;
+    if (num_channels == 0 || num_channels > WASM_MODULE_MAX_CHANNELS) {
+        fprintf(stderr, "ERROR: %u channels requested, module supports 1-%d\n", num_channels, WASM_MODULE_MAX_CHANNELS);
+        return false;
+    }
+    if (!ensure_thread_env()) return false;
+    if (!wamr_aot_engine_set_num_channels(engine, num_channels)) return false;
+
+    // Feed the module in chunks no larger than its I/O buffers
+    for (uint32_t offset = 0; offset < num_samples; ) {
+        uint32_t chunk = num_samples - offset;
+        if (chunk > WASM_MODULE_MAX_BLOCK_SIZE) chunk = WASM_MODULE_MAX_BLOCK_SIZE;
+        for (uint32_t ch = 0; ch < num_channels; ch++) {
+            memcpy(engine->input_buffers[ch], input[ch] + offset, chunk * sizeof(float));
+        }
+
+        uint32_t argv[1] = { chunk };
+        if (!wasm_runtime_call_wasm(engine->exec_env, engine->process_block_func, 1, argv)) {
+            return false;
+        }
+
+        for (uint32_t ch = 0; ch < num_channels; ch++) {
+            memcpy(output[ch] + offset, engine->output_buffers[ch], chunk * sizeof(float));
+        }
+        offset += chunk;
+    }
+    return true;
+}
+
+bool wamr_aot_engine_set_params(WamrAotEngine* engine, const float* values, uint32_t count) {
+    if (!engine->param_block || count > WASM_MODULE_MAX_PARAMS) return false;
+    memcpy(engine->param_block, values, count * sizeof(float));
+    return true;
+}
+
+bool wamr_aot_engine_set_events(WamrAotEngine* engine, const WasmMidiEvent* events, uint32_t count) {
+    if (!engine->event_queue || count > WASM_MODULE_MAX_EVENTS) return false;
+    memcpy(engine->event_queue->events, events, count * sizeof(WasmMidiEvent));
+    engine->event_queue->next = 0;
+    engine->event_queue->elapsed = 0;
+    engine->event_queue->count = (int32_t)count;
+    return true;
+}
+
+bool wamr_aot_engine_attach_thread(void) {
+    if (wasm_runtime_thread_env_inited()) return true;
+    return wasm_runtime_init_thread_env();
+}
+
+float wamr_aot_engine_get_sample_lean(WamrAotEngine* engine, uint32_t channel, float input, bool* trapped) {
+    // argv-based wasm_runtime_call_wasm is the lightest public entry point;
+    // the typed wasm_val_t variants add argument conversion on every call
+    union { uint32_t bits; float value; } arg;
+    arg.value = input;
+    uint32_t argv[2] = { channel, arg.bits };
+
+    if (!wasm_runtime_call_wasm(engine->exec_env, engine->get_sample_func, 2, argv)) {
+        report_call_failure(engine);
+        *trapped = true;
+        return 0.0f;
+    }
+
+    arg.bits = argv[0];
+    return arg.value;
+}
+
+bool wamr_aot_engine_process_block_lean(WamrAotEngine* engine, const float* const* input, float* const* output,
+                                        uint32_t num_channels, uint32_t num_samples) {
+    if (!engine->process_block_func) return false;
+    if (num_channels == 0 || num_channels > WASM_MODULE_MAX_CHANNELS) return false;
+    if (!wamr_aot_engine_set_num_channels(engine, num_channels)) {
+        report_call_failure(engine);
+        return false;
+    }
+
+    for (uint32_t offset = 0; offset < num_samples; ) {
+        uint32_t chunk = num_samples - offset;
+        if (chunk > WASM_MODULE_MAX_BLOCK_SIZE) chunk = WASM_MODULE_MAX_BLOCK_SIZE;
+        for (uint32_t ch = 0; ch < num_channels; ch++) {
+            memcpy(engine->input_buffers[ch], input[ch] + offset, chunk * sizeof(float));
+        }
+
+        uint32_t argv[1] = { chunk };
+        if (!wasm_runtime_call_wasm(engine->exec_env, engine->process_block_func, 1, argv)) {
+            report_call_failure(engine);
+            return false;
+        }
+
+        for (uint32_t ch = 0; ch < num_channels; ch++) {
+            memcpy(output[ch] + offset, engine->output_buffers[ch], chunk * sizeof(float));
+        }
+        offset += chunk;
+    }
+    return true;
+}
@@ -1,21 +1,166 @@
 #pragma once
 #include <wasm_export.h>
+#include "memory_snapshot.h"
+#include "module_abi.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Maximum length of a diagnostic message, including the terminator
+#define WAMR_DIAGNOSTIC_MESSAGE_SIZE 96
+
+// Per-instance sizes used unless wamr_aot_engine_set_memory_config says otherwise
+#define WAMR_DEFAULT_HEAP_SIZE (512 * 1024)
+#define WAMR_DEFAULT_STACK_SIZE 8192
+
+typedef enum {
+    WAMR_DIAG_CALL_FAILED = 1,  // A call trapped; message holds the exception
+    WAMR_DIAG_DROPPED           // The ring was full; message holds the count
+} WamrDiagnosticCode;
+
+// Diagnostic reported by the lean call path through a lock-free ring
 typedef struct {
-    wasm_module_t module;
+    WamrDiagnosticCode code;
+    char message[WAMR_DIAGNOSTIC_MESSAGE_SIZE];
+} WamrDiagnostic;
+
+struct WamrDiagnosticRing;
+
+// Refcounted loaded module that any number of engines can instantiate
+typedef struct WamrAotModule WamrAotModule;
+
+// How an engine runs its module. AOT engines load AOT images; the other
+// tiers load wasm bytecode and run it through the matching WAMR running
+// mode. The interpreter is classic or fast depending on how the runtime
+// was built (WAMR_BUILD_FAST_INTERP)
+typedef enum {
+    WAMR_TIER_AOT = 0,
+    WAMR_TIER_INTERP,
+    WAMR_TIER_FAST_JIT,
+    WAMR_TIER_LLVM_JIT,
+    WAMR_TIER_MULTI_TIER_JIT
+} WamrTier;
+
+typedef enum {
+    WAMR_LOAD_OK = 0,
+    WAMR_LOAD_MODULE_FAILED,      // The image itself didn't load
+    WAMR_LOAD_INSTANTIATE_FAILED  // It loaded, but couldn't be instantiated
+} WamrLoadResult;
+
+typedef struct {
+    WamrTier tier;
+    uint32_t heap_size;      // App heap given to each instantiation
+    uint32_t stack_size;     // Exec env stack given to each instantiation
+    size_t instance_bytes;   // Runtime allocations the last instantiation made
+    WamrAotModule* module;
     wasm_module_inst_t instance;
     wasm_exec_env_t exec_env;
     wasm_function_inst_t get_sample_func;
+    wasm_function_inst_t process_block_func;
+    wasm_function_inst_t set_num_channels_func;
+    wasm_function_inst_t memory_info_func;
+    wasm_function_inst_t set_sample_rate_func;
+    uint32_t num_channels;  // Channel count the module is currently set to
+    float* input_buffers[WASM_MODULE_MAX_CHANNELS];   // Native views of the module's input buffers
+    float* output_buffers[WASM_MODULE_MAX_CHANNELS];  // Native views of the module's output buffers
+    float* param_block;  // Native view of the module's parameter block, NULL if it has none
+    WasmMidiEventQueue* event_queue;  // Native view of the module's MIDI event queue, NULL if it has none
+    struct WamrDiagnosticRing* diagnostics;
+    MemorySnapshot memory_snapshot;  // Linear memory right after instantiation
 } WamrAotEngine;
 
-WamrAotEngine* wamr_aot_engine_new(void);
+WamrAotModule* wamr_aot_module_load(const uint8_t* aot_bytes, uint32_t size);
+
+// Load an AOT file by memory-mapping it instead of reading it into a copy
+WamrAotModule* wamr_aot_module_load_file(const char* path);
+void wamr_aot_module_retain(WamrAotModule* module);
+void wamr_aot_module_release(WamrAotModule* module);
+
+// Whether the runtime was built with a tier
+bool wamr_aot_tier_supported(WamrTier tier);
+
+// Engines share one refcounted WAMR runtime; the last one deleted destroys it
+WamrAotEngine* wamr_aot_engine_new(WamrTier tier);
+
+// New instance of the module already loaded by source, without reloading it
+WamrAotEngine* wamr_aot_engine_new_instance(WamrAotEngine* source);
 void wamr_aot_engine_delete(WamrAotEngine* engine);
-bool wamr_aot_engine_load_module(WamrAotEngine* engine, const uint8_t* aot_bytes, uint32_t size);
-float wamr_aot_engine_get_sample(WamrAotEngine* engine, float input);
+
+// Load a module and instantiate it, replacing any module loaded before. On
+// failure the engine is left with no module at all
+WamrLoadResult wamr_aot_engine_load_module(WamrAotEngine* engine, const uint8_t* aot_bytes, uint32_t size);
+WamrLoadResult wamr_aot_engine_load_file(WamrAotEngine* engine, const char* path);
+bool wamr_aot_engine_reset(WamrAotEngine* engine);
+
+// Put the instance back as it was instantiated by restoring its linear
+// memory (app heap included) from a copy taken then. WAMR doesn't expose
+// the rest of an instance, but the module keeps all its state in memory:
+// its only mutable global is the stack pointer, which is back at its
+// initial value whenever no call is running or trapped. MEMORY_SNAPSHOT_NONE
+// if the memory has grown since; reset instead
+MemorySnapshotKind wamr_aot_engine_restore(WamrAotEngine* engine);
+
+// Sizes for the engine's instances, taking effect at the next load or reset.
+// heap_size is the app heap WAMR adds to linear memory for modules that
+// don't export their own malloc/free (0 for none); stack_size is the exec
+// env's wasm stack, which holds interpreter frames and operands (AOT and
+// JIT code mostly run on the native stack). New instances inherit both
+void wamr_aot_engine_set_memory_config(WamrAotEngine* engine, uint32_t heap_size, uint32_t stack_size);
+
+// Bytes the WAMR runtime has allocated, process-wide, now and at the most
+void wamr_aot_runtime_allocated_bytes(size_t* current, size_t* peak);
+
+// Current size of the instance's linear memory, app heap included
+size_t wamr_aot_engine_linear_memory_size(WamrAotEngine* engine);
+
+// Size of the loaded AOT image or wasm bytecode
+size_t wamr_aot_engine_code_size(WamrAotEngine* engine);
+
+// Ask the module's memory_info export; -1 if it has none. Not for the audio thread
+int32_t wamr_aot_engine_memory_info(WamrAotEngine* engine, int32_t query);
+
+// Select a WasmModuleKernel; not for the audio thread
+bool wamr_aot_engine_set_kernel(WamrAotEngine* engine, int32_t kernel);
+
+// Set the rate in Hz the module designs its coefficients for; false if it
+// has no set_sample_rate export or rejects the rate. Safe on the audio thread
+bool wamr_aot_engine_set_sample_rate(WamrAotEngine* engine, int32_t rate);
+
+// Write values[0..count) into the module's parameter block (see
+// WasmModuleParam); they apply from the next call. Safe on the audio thread
+bool wamr_aot_engine_set_params(WamrAotEngine* engine, const float* values, uint32_t count);
+
+// Replace the module's MIDI event queue with events[0..count), timed from
+// the next call (see WasmMidiEventQueue). Safe on the audio thread
+bool wamr_aot_engine_set_events(WamrAotEngine* engine, const WasmMidiEvent* events, uint32_t count);
+
+// Set how many channels process_block and a get_sample frame cover; false
+// if the module rejects the count, or has no set_num_channels for one above 1
+bool wamr_aot_engine_set_num_channels(WamrAotEngine* engine, uint32_t num_channels);
+
+// Checked call path: verifies the engine and the calling thread's WAMR
+// environment on every call and prints diagnostics to stderr.
+// process_block takes planar buffers for up to WASM_MODULE_MAX_CHANNELS;
+// get_sample is called channel 0 up for each sample (see module_abi.h) and
+// returns 0 and sets *trapped if the call fails, leaving it alone otherwise
+float wamr_aot_engine_get_sample(WamrAotEngine* engine, uint32_t channel, float input, bool* trapped);
+bool wamr_aot_engine_process_block(WamrAotEngine* engine, const float* const* input, float* const* output,
+                                   uint32_t num_channels, uint32_t num_samples);
+
+// Lean call path for the audio thread: no per-call checks or stdio. The
+// calling thread must have been attached with wamr_aot_engine_attach_thread
+// and failures are queued for wamr_aot_engine_pop_diagnostic
+float wamr_aot_engine_get_sample_lean(WamrAotEngine* engine, uint32_t channel, float input, bool* trapped);
+bool wamr_aot_engine_process_block_lean(WamrAotEngine* engine, const float* const* input, float* const* output,
+                                        uint32_t num_channels, uint32_t num_samples);
+
+// Set up the WAMR thread environment for the calling thread; call once when
+// a processing thread starts. Safe to call repeatedly
+bool wamr_aot_engine_attach_thread(void);
+
+// Pop the oldest queued diagnostic; call from a single non-audio thread
+bool wamr_aot_engine_pop_diagnostic(WamrAotEngine* engine, WamrDiagnostic* diagnostic);
 
 #ifdef __cplusplus
 }
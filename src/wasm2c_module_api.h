@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Entry points of one wasm2c-generated module. Each variant is generated
+// under its own module name so several can link into one binary; the engine
+// wrapper only sees this table and an opaque instance of instance_size bytes
+typedef struct {
+    const char* name;
+    size_t instance_size;
+    void (*instantiate)(void* instance);
+    void (*free)(void* instance);
+    uint8_t* (*memory_data)(void* instance);
+    void* (*memory)(void* instance);  // The instance's wasm_rt_memory_t
+    float (*get_sample)(void* instance, uint32_t channel, float input);
+    uint32_t (*get_input_buffer)(void* instance, uint32_t channel);
+    uint32_t (*get_output_buffer)(void* instance, uint32_t channel);
+    uint32_t (*get_param_buffer)(void* instance, uint32_t param);
+    uint32_t (*get_event_buffer)(void* instance, uint32_t unused);
+    uint32_t (*set_num_channels)(void* instance, uint32_t channels);
+    uint32_t (*set_kernel)(void* instance, uint32_t kernel);
+    uint32_t (*process_block)(void* instance, uint32_t num_samples);
+    uint32_t (*memory_info)(void* instance, uint32_t query);
+    uint32_t (*set_sample_rate)(void* instance, uint32_t rate);
+} Wasm2cModuleApi;
+
+// The scalar build of the module, always available
+extern const Wasm2cModuleApi wasm2c_scalar_module;
+
+// The SIMD build; only linked in when WASM2C_SIMD_MODULE is defined
+extern const Wasm2cModuleApi wasm2c_simd_module;
+
+// The scalar build compiled without inline memory checks, for the guard-page
+// and unchecked engines, and with explicit bounds checks on every access
+extern const Wasm2cModuleApi wasm2c_unchecked_module;
+extern const Wasm2cModuleApi wasm2c_bounds_module;
+
+// Define the table for a generated module; include its header first
+#define WASM2C_DEFINE_MODULE_API(var, name)                                                          \
+    static void name##_instantiate(void* i) { wasm2c_##name##_instantiate((w2c_##name*)i); }      \
+    static void name##_free(void* i) { wasm2c_##name##_free((w2c_##name*)i); }                    \
+    static uint8_t* name##_memory_data(void* i) { return w2c_##name##_memory((w2c_##name*)i)->data; } \
+    static void* name##_memory(void* i) { return w2c_##name##_memory((w2c_##name*)i); }           \
+    static float name##_get_sample(void* i, uint32_t ch, float x) {                               \
+        return w2c_##name##_get_sample((w2c_##name*)i, ch, x);                                     \
+    }                                                                                              \
+    static uint32_t name##_get_input_buffer(void* i, uint32_t ch) {                                \
+        return w2c_##name##_get_input_buffer((w2c_##name*)i, ch);                                  \
+    }                                                                                              \
+    static uint32_t name##_get_output_buffer(void* i, uint32_t ch) {                               \
+        return w2c_##name##_get_output_buffer((w2c_##name*)i, ch);                                 \
+    }                                                                                              \
+    static uint32_t name##_get_param_buffer(void* i, uint32_t p) {                                 \
+        return w2c_##name##_get_param_buffer((w2c_##name*)i, p);                                   \
+    }                                                                                              \
+    static uint32_t name##_get_event_buffer(void* i, uint32_t u) {                                 \
+        return w2c_##name##_get_event_buffer((w2c_##name*)i, u);                                   \
+    }                                                                                              \
+    static uint32_t name##_set_num_channels(void* i, uint32_t n) {                                 \
+        return w2c_##name##_set_num_channels((w2c_##name*)i, n);                                   \
+    }                                                                                              \
+    static uint32_t name##_set_kernel(void* i, uint32_t k) {                                       \
+        return w2c_##name##_set_kernel((w2c_##name*)i, k);                                         \
+    }                                                                                              \
+    static uint32_t name##_process_block(void* i, uint32_t n) {                                    \
+        return w2c_##name##_process_block((w2c_##name*)i, n);                                      \
+    }                                                                                              \
+    static uint32_t name##_memory_info(void* i, uint32_t q) {                                      \
+        return w2c_##name##_memory_info((w2c_##name*)i, q);                                        \
+    }                                                                                              \
+    static uint32_t name##_set_sample_rate(void* i, uint32_t r) {                                  \
+        return w2c_##name##_set_sample_rate((w2c_##name*)i, r);                                    \
+    }                                                                                              \
+    const Wasm2cModuleApi var = {                                                                  \
+        #name, sizeof(w2c_##name), name##_instantiate, name##_free, name##_memory_data, name##_memory, \
+        name##_get_sample, name##_get_input_buffer, name##_get_output_buffer, name##_get_param_buffer, \
+        name##_get_event_buffer, name##_set_num_channels, name##_set_kernel, name##_process_block, name##_memory_info, \
+        name##_set_sample_rate                                                                     \
+    };
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,5 @@
+#include <wasm-rt.h>
+#include "module_bounds.h"  // Generated by wasm2c, built with explicit bounds checks
+#include "wasm2c_module_api.h"
+
+WASM2C_DEFINE_MODULE_API(wasm2c_bounds_module, boundsmodule)
@@ -0,0 +1,5 @@
+#include <wasm-rt.h>
+#include "module.h"  // Generated by wasm2c
+#include "wasm2c_module_api.h"
+
+WASM2C_DEFINE_MODULE_API(wasm2c_scalar_module, module)
@@ -0,0 +1,5 @@
+#include <wasm-rt.h>
+#include "module_simd.h"  // Generated by wasm2c from the -msimd128 build
+#include "wasm2c_module_api.h"
+
+WASM2C_DEFINE_MODULE_API(wasm2c_simd_module, simdmodule)
@@ -0,0 +1,5 @@
+#include <wasm-rt.h>
+#include "module_unchecked.h"  // Generated by wasm2c, built without inline memory checks
+#include "wasm2c_module_api.h"
+
+WASM2C_DEFINE_MODULE_API(wasm2c_unchecked_module, uncheckedmodule)
@@ -0,0 +1,165 @@
+#include "wasm2c_static.h"
+#include "wasm2c_wrapper.h"
+#include <stdatomic.h>
+#include <string.h>
+#include <wasm-rt-impl.h>
+
+// The generated module itself, so its functions are visible to the inliner
+#include "module_static.c"
+
+static w2c_staticmodule instance;
+static atomic_flag in_use = ATOMIC_FLAG_INIT;
+static uint32_t num_channels;
+static uint32_t input_offsets[WASM_MODULE_MAX_CHANNELS];
+static uint32_t output_offsets[WASM_MODULE_MAX_CHANNELS];
+static uint32_t param_offset;
+static uint32_t event_offset;
+static w2c_staticmodule instance_snapshot;
+static MemorySnapshot memory_snapshot;
+
+static void instantiate(void) {
+    wasm2c_staticmodule_instantiate(&instance);
+
+    // Resolve the block ABI buffers once; they are static data in the module
+    for (uint32_t ch = 0; ch < WASM_MODULE_MAX_CHANNELS; ch++) {
+        input_offsets[ch] = w2c_staticmodule_get_input_buffer(&instance, ch);
+        output_offsets[ch] = w2c_staticmodule_get_output_buffer(&instance, ch);
+    }
+    param_offset = w2c_staticmodule_get_param_buffer(&instance, 0);
+    event_offset = w2c_staticmodule_get_event_buffer(&instance, 0);
+    num_channels = 1;  // The module starts out mono
+
+    // What a restore returns to; the memory is the runtime's, so a plain copy
+    wasm_rt_memory_t* memory = w2c_staticmodule_memory(&instance);
+    memory_snapshot_take(&memory_snapshot, memory->data, memory->size, false);
+    instance_snapshot = instance;
+}
+
+bool wasm2c_static_engine_acquire(void) {
+    if (atomic_flag_test_and_set(&in_use)) return false;
+
+    wasm2c_runtime_acquire();
+    instantiate();
+    return true;
+}
+
+void wasm2c_static_engine_release(void) {
+    memory_snapshot_release(&memory_snapshot);
+    wasm2c_staticmodule_free(&instance);
+    memset(&instance, 0, sizeof(instance));
+    wasm2c_runtime_release();
+    atomic_flag_clear(&in_use);
+}
+
+bool wasm2c_static_engine_reset(void) {
+    memory_snapshot_release(&memory_snapshot);
+    wasm2c_staticmodule_free(&instance);
+    memset(&instance, 0, sizeof(instance));
+    instantiate();
+    return true;
+}
+
+MemorySnapshotKind wasm2c_static_engine_restore(void) {
+    wasm_rt_memory_t* memory = w2c_staticmodule_memory(&instance);
+    MemorySnapshotKind kind = memory_snapshot_restore(&memory_snapshot, memory->data, memory->size);
+    if (kind == MEMORY_SNAPSHOT_NONE) return kind;
+
+    instance = instance_snapshot;
+    num_channels = 1;
+    return kind;
+}
+
+size_t wasm2c_static_engine_instance_size(void) {
+    return sizeof(instance);
+}
+
+size_t wasm2c_static_engine_linear_memory_size(void) {
+    return (size_t)w2c_staticmodule_memory(&instance)->size;
+}
+
+int32_t wasm2c_static_engine_memory_info(int32_t query) {
+    return (int32_t)w2c_staticmodule_memory_info(&instance, (uint32_t)query);
+}
+
+bool wasm2c_static_engine_set_kernel(int32_t kernel) {
+    return (int32_t)w2c_staticmodule_set_kernel(&instance, (uint32_t)kernel) == kernel;
+}
+
+bool wasm2c_static_engine_set_sample_rate(int32_t rate) {
+    if (wasm_rt_impl_try() != 0) return false;
+    return (int32_t)w2c_staticmodule_set_sample_rate(&instance, (uint32_t)rate) == rate;
+}
+
+bool wasm2c_static_engine_set_params(const float* values, uint32_t count) {
+    if (count > WASM_MODULE_MAX_PARAMS) return false;
+    memcpy(w2c_staticmodule_memory(&instance)->data + param_offset, values, count * sizeof(float));
+    return true;
+}
+
+bool wasm2c_static_engine_set_events(const WasmMidiEvent* events, uint32_t count) {
+    if (count > WASM_MODULE_MAX_EVENTS) return false;
+    WasmMidiEventQueue* queue = (WasmMidiEventQueue*)(w2c_staticmodule_memory(&instance)->data + event_offset);
+    memcpy(queue->events, events, count * sizeof(WasmMidiEvent));
+    queue->next = 0;
+    queue->elapsed = 0;
+    queue->count = (int32_t)count;
+    return true;
+}
+
+static bool set_num_channels(uint32_t channels) {
+    if (channels != num_channels) {
+        num_channels = w2c_staticmodule_set_num_channels(&instance, channels);
+    }
+    return num_channels == channels;
+}
+
+static bool process_chunks(const float* const* input, float* const* output, uint32_t channels, uint32_t num_samples) {
+    if (!set_num_channels(channels)) return false;
+
+    // Feed the module in chunks no larger than its I/O buffers
+    for (uint32_t offset = 0; offset < num_samples; ) {
+        uint32_t chunk = num_samples - offset;
+        if (chunk > WASM_MODULE_MAX_BLOCK_SIZE) chunk = WASM_MODULE_MAX_BLOCK_SIZE;
+
+        // Re-read the memory base each call in case the module grew its memory
+        uint8_t* memory = w2c_staticmodule_memory(&instance)->data;
+        for (uint32_t ch = 0; ch < channels; ch++) {
+            memcpy(memory + input_offsets[ch], input[ch] + offset, chunk * sizeof(float));
+        }
+
+        w2c_staticmodule_process_block(&instance, chunk);
+
+        memory = w2c_staticmodule_memory(&instance)->data;
+        for (uint32_t ch = 0; ch < channels; ch++) {
+            memcpy(output[ch] + offset, memory + output_offsets[ch], chunk * sizeof(float));
+        }
+        offset += chunk;
+    }
+    return true;
+}
+
+static bool process_samples(const float* const* input, float* const* output, uint32_t channels, uint32_t num_samples) {
+    if (!set_num_channels(channels)) return false;
+
+    for (uint32_t i = 0; i < num_samples; i++) {
+        for (uint32_t ch = 0; ch < channels; ch++) {
+            output[ch][i] = w2c_staticmodule_get_sample(&instance, ch, input[ch][i]);
+        }
+    }
+    return true;
+}
+
+// A trap in the module unwinds to the wasm_rt_impl_try here, failing the call
+bool wasm2c_static_engine_process_block(const float* const* input, float* const* output,
+                                        uint32_t channels, uint32_t num_samples) {
+    if (channels == 0 || channels > WASM_MODULE_MAX_CHANNELS) return false;
+    if (wasm_rt_impl_try() != 0) return false;
+    return process_chunks(input, output, channels, num_samples);
+}
+
+bool wasm2c_static_engine_process_per_sample(const float* const* input, float* const* output,
+                                             uint32_t channels, uint32_t num_samples) {
+    if (channels == 0 || channels > WASM_MODULE_MAX_CHANNELS) return false;
+    if (wasm_rt_impl_try() != 0) return false;
+    return process_samples(input, output, channels, num_samples);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "memory_snapshot.h"
+#include "module_abi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// wasm2c engine over a single statically allocated instance of the scalar
+// module, whose generated code is compiled into the same translation unit
+// so the compiler can inline the calls into it. There is no instance
+// pointer or function table; only one engine can exist per process
+bool wasm2c_static_engine_acquire(void);
+void wasm2c_static_engine_release(void);
+bool wasm2c_static_engine_reset(void);
+
+// Put the instance back as it was instantiated, by copying back the
+// instance and its linear memory; MEMORY_SNAPSHOT_NONE if the memory has
+// grown since
+MemorySnapshotKind wasm2c_static_engine_restore(void);
+
+// Size of the static instance, its current linear memory, and the module's
+// memory_info answer to a query; not for the audio thread
+size_t wasm2c_static_engine_instance_size(void);
+size_t wasm2c_static_engine_linear_memory_size(void);
+int32_t wasm2c_static_engine_memory_info(int32_t query);
+
+// Select a WasmModuleKernel; not for the audio thread
+bool wasm2c_static_engine_set_kernel(int32_t kernel);
+
+// Set the rate in Hz the module designs its coefficients for; false if it
+// rejects the rate or traps. Safe on the audio thread
+bool wasm2c_static_engine_set_sample_rate(int32_t rate);
+
+// Write values[0..count) into the module's parameter block; safe on the audio thread
+bool wasm2c_static_engine_set_params(const float* values, uint32_t count);
+
+// Replace the module's MIDI event queue, timed from the next call; safe on the audio thread
+bool wasm2c_static_engine_set_events(const WasmMidiEvent* events, uint32_t count);
+
+// Planar buffers for up to WASM_MODULE_MAX_CHANNELS channels, through
+// process_block or a get_sample call per channel per sample (channel 0 up,
+// see module_abi.h). False if the module trapped
+bool wasm2c_static_engine_process_block(const float* const* input, float* const* output,
+                                        uint32_t num_channels, uint32_t num_samples);
+bool wasm2c_static_engine_process_per_sample(const float* const* input, float* const* output,
+                                             uint32_t num_channels, uint32_t num_samples);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,8 +1,97 @@
 #include "wasm2c_wrapper.h"
 #include <wasm-rt.h>
-#include "module.h"  // Generated by wasm2c
+#include <wasm-rt-impl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
+#include <sys/mman.h>
+
+// Any wasm32 access is a 32-bit index plus a 32-bit offset, so it falls
+// within 8 GiB of the memory base
+#define GUARD_RESERVATION_SIZE (8ull << 30)
+
+// wasm_rt_init/wasm_rt_free are process-wide; engines share them by refcount
+// so deleting one engine never frees the runtime under another
+static pthread_mutex_t runtime_lock = PTHREAD_MUTEX_INITIALIZER;
+static int runtime_refs = 0;
+
+void wasm2c_runtime_acquire(void) {
+    pthread_mutex_lock(&runtime_lock);
+    if (runtime_refs++ == 0) {
+        wasm_rt_init();
+    }
+    pthread_mutex_unlock(&runtime_lock);
+}
+
+void wasm2c_runtime_release(void) {
+    pthread_mutex_lock(&runtime_lock);
+    if (--runtime_refs == 0) {
+        wasm_rt_free();
+    }
+    pthread_mutex_unlock(&runtime_lock);
+}
+
+// The module built without inline memory checks faults instead of trapping
+// on an out-of-bounds access or a stack overflow, and the runtime is built
+// without its signal handler. While an instance of it runs, this handler
+// turns SIGSEGV/SIGBUS into an ordinary trap, which unwinds to the
+// wasm_rt_impl_try around the call; other faults go to the handler that was
+// installed before
+static _Thread_local bool running_unchecked;
+static struct sigaction previous_segv;
+static struct sigaction previous_bus;
+static pthread_once_t fault_handler_once = PTHREAD_ONCE_INIT;
+static pthread_key_t alt_stack_key;
+
+static void handle_fault(int sig, siginfo_t* info, void* context) {
+    (void)info;
+    (void)context;
+    if (running_unchecked) {
+        running_unchecked = false;
+        wasm_rt_trap(WASM_RT_TRAP_OOB);
+    }
+    // Not the module's: returning retries the access under the previous handler
+    sigaction(sig, sig == SIGSEGV ? &previous_segv : &previous_bus, NULL);
+}
+
+static void free_alt_stack(void* stack) {
+    stack_t disable = { .ss_flags = SS_DISABLE };
+    sigaltstack(&disable, NULL);
+    free(stack);
+}
+
+static void install_fault_handler(void) {
+    pthread_key_create(&alt_stack_key, free_alt_stack);
+
+    // The trap leaves the handler by longjmp, so the signal mustn't stay
+    // blocked, and a stack overflow needs the handler on its own stack
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = handle_fault;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &previous_segv);
+    sigaction(SIGBUS, &action, &previous_bus);
+}
+
+bool wasm2c_engine_attach_thread(void) {
+    pthread_once(&fault_handler_once, install_fault_handler);
+
+    stack_t current;
+    if (sigaltstack(NULL, &current) == 0 && !(current.ss_flags & SS_DISABLE)) return true;
+
+    size_t size = SIGSTKSZ < 65536 ? 65536 : SIGSTKSZ;
+    stack_t stack = { .ss_sp = malloc(size), .ss_size = size, .ss_flags = 0 };
+    if (!stack.ss_sp) return false;
+    if (sigaltstack(&stack, NULL) != 0) {
+        free(stack.ss_sp);
+        return false;
+    }
+    pthread_setspecific(alt_stack_key, stack.ss_sp);  // Freed when the thread exits
+    return true;
+}
 
 // Provide a weak implementation of os_print_last_error if not provided by runtime
 __attribute__((weak))
@@ -10,22 +99,88 @@ void os_print_last_error(const char* msg) {
     perror(msg);
 }
 
-Wasm2cEngine* wasm2c_engine_new(void) {
+// Move the instance's linear memory into a guard-page reservation, keeping
+// the runtime's allocation to hand back before the instance is freed
+static bool move_to_guard_region(Wasm2cEngine* engine) {
+    if (UINTPTR_MAX <= 0xffffffffu) return false;  // No room to reserve on 32-bit hosts
+
+    wasm_rt_memory_t* memory = engine->api->memory(engine->instance);
+    if (memory->max_pages != memory->pages) return false;
+
+    void* region = mmap(NULL, GUARD_RESERVATION_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) return false;
+    if (memory->size > 0 && mprotect(region, memory->size, PROT_READ | PROT_WRITE) != 0) {
+        munmap(region, GUARD_RESERVATION_SIZE);
+        return false;
+    }
+
+    memcpy(region, memory->data, memory->size);
+    engine->heap_data = memory->data;
+    engine->guard_region = region;
+    memory->data = region;
+    return true;
+}
+
+static void free_instance(Wasm2cEngine* engine) {
+    memory_snapshot_release(&engine->memory_snapshot);
+    if (engine->guard_region) {
+        wasm_rt_memory_t* memory = engine->api->memory(engine->instance);
+        memory->data = engine->heap_data;
+        munmap(engine->guard_region, GUARD_RESERVATION_SIZE);
+        engine->guard_region = NULL;
+    }
+    engine->api->free(engine->instance);
+}
+
+static bool instantiate(Wasm2cEngine* engine) {
+    // Initialize the generated wasm2c module
+    engine->api->instantiate(engine->instance);
+    if (engine->guard_pages && !move_to_guard_region(engine)) {
+        engine->api->free(engine->instance);
+        return false;
+    }
+
+    // Resolve the block ABI buffers once; they are static data in the module
+    for (uint32_t ch = 0; ch < WASM_MODULE_MAX_CHANNELS; ch++) {
+        engine->input_offsets[ch] = engine->api->get_input_buffer(engine->instance, ch);
+        engine->output_offsets[ch] = engine->api->get_output_buffer(engine->instance, ch);
+    }
+    engine->param_offset = engine->api->get_param_buffer(engine->instance, 0);
+    engine->event_offset = engine->api->get_event_buffer(engine->instance, 0);
+    engine->num_channels = 1;  // The module starts out mono
+
+    // Nothing has run in the instance yet, so this is what a reset returns to.
+    // The guard region is ours to remap; the runtime's own allocation isn't
+    wasm_rt_memory_t* memory = engine->api->memory(engine->instance);
+    memory_snapshot_take(&engine->memory_snapshot, memory->data, memory->size, engine->guard_region != NULL);
+    if (!engine->instance_snapshot) engine->instance_snapshot = malloc(engine->api->instance_size);
+    if (engine->instance_snapshot) memcpy(engine->instance_snapshot, engine->instance, engine->api->instance_size);
+    return true;
+}
+
+Wasm2cEngine* wasm2c_engine_new(const Wasm2cModuleApi* api, bool guard_pages) {
     Wasm2cEngine* engine = calloc(1, sizeof(Wasm2cEngine));
     if (!engine) return NULL;
 
-    // Initialize WASM runtime
-    wasm_rt_init();
-
-    // Allocate and initialize the module instance
-    engine->instance = calloc(1, sizeof(struct w2c_module));
+    // Allocate the module instance; the generated code is shared by all
+    engine->api = api;
+    engine->guard_pages = guard_pages;
+    engine->catch_faults = api == &wasm2c_unchecked_module;
+    if (engine->catch_faults) pthread_once(&fault_handler_once, install_fault_handler);
+    engine->instance = calloc(1, api->instance_size);
     if (!engine->instance) {
         free(engine);
         return NULL;
     }
 
-    // Initialize the generated wasm2c module
-    wasm2c_module_instantiate(engine->instance);
+    wasm2c_runtime_acquire();
+
+    if (!instantiate(engine)) {
+        free(engine->instance);
+        engine->instance = NULL;
+        wasm2c_engine_delete(engine);
+        return NULL;
+    }
 
     return engine;
 }
@@ -33,22 +188,153 @@ Wasm2cEngine* wasm2c_engine_new(void) {
 void wasm2c_engine_delete(Wasm2cEngine* engine) {
     if (!engine) return;
     if (engine->instance) {
-        wasm2c_module_free(engine->instance);
+        free_instance(engine);
         free(engine->instance);
     }
-    wasm_rt_free();
+    free(engine->instance_snapshot);
+    wasm2c_runtime_release();
     free(engine);
 }
 
-float wasm2c_engine_get_sample(Wasm2cEngine* engine, float input) {
-    if (!engine || !engine->instance) {
-        printf("ERROR: wasm2c engine or instance is NULL!\n");
-        return 0.0f;
+bool wasm2c_engine_reset(Wasm2cEngine* engine) {
+    if (!engine || !engine->instance) return false;
+    free_instance(engine);
+    memset(engine->instance, 0, engine->api->instance_size);
+    if (!instantiate(engine)) {
+        free(engine->instance);
+        engine->instance = NULL;
+        return false;
     }
+    return true;
+}
+
+MemorySnapshotKind wasm2c_engine_restore(Wasm2cEngine* engine) {
+    if (!engine || !engine->instance || !engine->instance_snapshot) return MEMORY_SNAPSHOT_NONE;
+
+    wasm_rt_memory_t* memory = engine->api->memory(engine->instance);
+    MemorySnapshotKind kind = memory_snapshot_restore(&engine->memory_snapshot, memory->data, memory->size);
+    if (kind == MEMORY_SNAPSHOT_NONE) return kind;
 
-    // Call the generated wasm2c function
-    // The signature is: f32 w2c_module_get_sample(struct w2c_module*, f32)
-    float result = w2c_module_get_sample(engine->instance, input);
-    
-    return result;
+    // The memory hasn't moved, so the descriptors in the snapshot still point at it
+    memcpy(engine->instance, engine->instance_snapshot, engine->api->instance_size);
+    engine->num_channels = 1;
+    return kind;
+}
+
+size_t wasm2c_engine_linear_memory_size(Wasm2cEngine* engine) {
+    if (!engine || !engine->instance) return 0;
+    return (size_t)((wasm_rt_memory_t*)engine->api->memory(engine->instance))->size;
+}
+
+int32_t wasm2c_engine_memory_info(Wasm2cEngine* engine, int32_t query) {
+    if (!engine || !engine->instance) return -1;
+    return (int32_t)engine->api->memory_info(engine->instance, (uint32_t)query);
+}
+
+bool wasm2c_engine_set_params(Wasm2cEngine* engine, const float* values, uint32_t count) {
+    if (count > WASM_MODULE_MAX_PARAMS) return false;
+    memcpy(engine->api->memory_data(engine->instance) + engine->param_offset, values, count * sizeof(float));
+    return true;
+}
+
+bool wasm2c_engine_set_events(Wasm2cEngine* engine, const WasmMidiEvent* events, uint32_t count) {
+    if (count > WASM_MODULE_MAX_EVENTS) return false;
+    WasmMidiEventQueue* queue = (WasmMidiEventQueue*)(engine->api->memory_data(engine->instance) + engine->event_offset);
+    memcpy(queue->events, events, count * sizeof(WasmMidiEvent));
+    queue->next = 0;
+    queue->elapsed = 0;
+    queue->count = (int32_t)count;
+    return true;
+}
+
+bool wasm2c_engine_set_kernel(Wasm2cEngine* engine, int32_t kernel) {
+    if (!engine || !engine->instance) return false;
+    return (int32_t)engine->api->set_kernel(engine->instance, (uint32_t)kernel) == kernel;
+}
+
+bool wasm2c_engine_set_sample_rate(Wasm2cEngine* engine, int32_t rate) {
+    if (!engine || !engine->instance) return false;
+
+    if (wasm_rt_impl_try() != 0) {
+        running_unchecked = false;
+        return false;
+    }
+    running_unchecked = engine->catch_faults;
+    int32_t set = (int32_t)engine->api->set_sample_rate(engine->instance, (uint32_t)rate);
+    running_unchecked = false;
+    return set == rate;
+}
+
+static bool set_num_channels(Wasm2cEngine* engine, uint32_t num_channels) {
+    if (num_channels == engine->num_channels) return true;
+
+    engine->num_channels = engine->api->set_num_channels(engine->instance, num_channels);
+    return engine->num_channels == num_channels;
+}
+
+static bool process_chunks(Wasm2cEngine* engine, const float* const* input, float* const* output,
+                           uint32_t num_channels, uint32_t num_samples) {
+    if (!set_num_channels(engine, num_channels)) return false;
+    // Feed the module in chunks no larger than its I/O buffers
+    for (uint32_t offset = 0; offset < num_samples; ) {
+        uint32_t chunk = num_samples - offset;
+        if (chunk > WASM_MODULE_MAX_BLOCK_SIZE) chunk = WASM_MODULE_MAX_BLOCK_SIZE;
+
+        // Re-read the memory base each call in case the module grew its memory
+        uint8_t* memory = engine->api->memory_data(engine->instance);
+        for (uint32_t ch = 0; ch < num_channels; ch++) {
+            memcpy(memory + engine->input_offsets[ch], input[ch] + offset, chunk * sizeof(float));
+        }
+
+        engine->api->process_block(engine->instance, chunk);
+
+        memory = engine->api->memory_data(engine->instance);
+        for (uint32_t ch = 0; ch < num_channels; ch++) {
+            memcpy(output[ch] + offset, memory + engine->output_offsets[ch], chunk * sizeof(float));
+        }
+        offset += chunk;
+    }
+    return true;
+}
+
+static bool process_samples(Wasm2cEngine* engine, const float* const* input, float* const* output,
+                            uint32_t num_channels, uint32_t num_samples) {
+    if (!set_num_channels(engine, num_channels)) return false;
+
+    for (uint32_t i = 0; i < num_samples; i++) {
+        for (uint32_t ch = 0; ch < num_channels; ch++) {
+            output[ch][i] = engine->api->get_sample(engine->instance, ch, input[ch][i]);
+        }
+    }
+    return true;
+}
+
+bool wasm2c_engine_process_block(Wasm2cEngine* engine, const float* const* input, float* const* output,
+                                 uint32_t num_channels, uint32_t num_samples) {
+    if (!engine || !engine->instance) return false;
+    if (num_channels == 0 || num_channels > WASM_MODULE_MAX_CHANNELS) return false;
+
+    if (wasm_rt_impl_try() != 0) {
+        running_unchecked = false;
+        return false;
+    }
+    running_unchecked = engine->catch_faults;
+    bool ok = process_chunks(engine, input, output, num_channels, num_samples);
+    running_unchecked = false;
+    return ok;
+}
+
+bool wasm2c_engine_process_per_sample(Wasm2cEngine* engine, const float* const* input, float* const* output,
+                                      uint32_t num_channels, uint32_t num_samples) {
+    if (!engine || !engine->instance) return false;
+    if (num_channels == 0 || num_channels > WASM_MODULE_MAX_CHANNELS) return false;
+
+    if (wasm_rt_impl_try() != 0) {
+        running_unchecked = false;
+        return false;
+    }
+    running_unchecked = engine->catch_faults;
+    bool ok = process_samples(engine, input, output, num_channels, num_samples);
+    running_unchecked = false;
+    return ok;
 }
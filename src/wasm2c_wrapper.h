@@ -1,19 +1,87 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "memory_snapshot.h"
+#include "module_abi.h"
+#include "wasm2c_module_api.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-// Forward declare the generated wasm2c module struct
-struct w2c_module;
-
 typedef struct {
-    struct w2c_module* instance;
+    const Wasm2cModuleApi* api;  // Generated module this engine instantiates
+    void* instance;
+    bool guard_pages;     // Linear memory lives in a guard-page reservation
+    bool catch_faults;    // The module has no inline memory checks, so faults are turned into traps
+    uint8_t* guard_region;  // That reservation, while the instance exists
+    uint8_t* heap_data;     // The runtime's own allocation, restored before freeing
+    uint32_t num_channels;  // Channel count the module is currently set to
+    uint32_t input_offsets[WASM_MODULE_MAX_CHANNELS];   // Guest addresses of the module's input buffers
+    uint32_t output_offsets[WASM_MODULE_MAX_CHANNELS];  // Guest addresses of the module's output buffers
+    uint32_t param_offset;  // Guest address of the module's parameter block
+    uint32_t event_offset;  // Guest address of the module's MIDI event queue
+    void* instance_snapshot;          // The instance struct right after instantiation
+    MemorySnapshot memory_snapshot;   // Its linear memory then
 } Wasm2cEngine;
 
-Wasm2cEngine* wasm2c_engine_new(void);
+// The wasm2c runtime is process-wide and shared by refcount
+void wasm2c_runtime_acquire(void);
+void wasm2c_runtime_release(void);
+
+// Every engine is an independent instance of a compiled-in module. With
+// guard_pages the instance's linear memory is moved into a reservation
+// covering every address a wasm32 access can form, so a module built
+// without inline bounds checks faults on out-of-bounds accesses instead of
+// corrupting the heap. Fails for modules whose memory can grow, since the
+// runtime would reallocate it out of the reservation
+Wasm2cEngine* wasm2c_engine_new(const Wasm2cModuleApi* api, bool guard_pages);
 void wasm2c_engine_delete(Wasm2cEngine* engine);
-float wasm2c_engine_get_sample(Wasm2cEngine* engine, float input);
+
+// Install the fault handler and give the calling thread the alternate
+// signal stack it runs on, so the guard-page and unchecked engines can turn
+// an out-of-bounds access or a stack overflow on this thread into a trap.
+// Call once on each thread that processes
+bool wasm2c_engine_attach_thread(void);
+
+bool wasm2c_engine_reset(Wasm2cEngine* engine);
+
+// Put the instance back as it was instantiated from the snapshots taken
+// then: the instance struct (globals, memory and table descriptors) is
+// copied back and linear memory restored, copy-on-write for guard-page
+// instances. MEMORY_SNAPSHOT_NONE if the memory has grown since; reset
+// instead
+MemorySnapshotKind wasm2c_engine_restore(Wasm2cEngine* engine);
+
+// Current size of the instance's linear memory
+size_t wasm2c_engine_linear_memory_size(Wasm2cEngine* engine);
+
+// Ask the module's memory_info export; not for the audio thread
+int32_t wasm2c_engine_memory_info(Wasm2cEngine* engine, int32_t query);
+
+// Write values[0..count) into the module's parameter block; they apply from
+// the next call. Safe on the audio thread
+bool wasm2c_engine_set_params(Wasm2cEngine* engine, const float* values, uint32_t count);
+
+// Replace the module's MIDI event queue with events[0..count), timed from
+// the next call. Safe on the audio thread
+bool wasm2c_engine_set_events(Wasm2cEngine* engine, const WasmMidiEvent* events, uint32_t count);
+
+// Select a WasmModuleKernel; not for the audio thread
+bool wasm2c_engine_set_kernel(Wasm2cEngine* engine, int32_t kernel);
+
+// Set the rate in Hz the module designs its coefficients for; false if it
+// rejects the rate or traps. Safe on the audio thread
+bool wasm2c_engine_set_sample_rate(Wasm2cEngine* engine, int32_t rate);
+// Planar buffers for up to WASM_MODULE_MAX_CHANNELS channels, through
+// process_block or a get_sample call per channel per sample (channel 0 up,
+// see module_abi.h). False if the module trapped
+bool wasm2c_engine_process_block(Wasm2cEngine* engine, const float* const* input, float* const* output,
+                                 uint32_t num_channels, uint32_t num_samples);
+bool wasm2c_engine_process_per_sample(Wasm2cEngine* engine, const float* const* input, float* const* output,
+                                      uint32_t num_channels, uint32_t num_samples);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,438 @@
+#include "wasmi_wrapper.h"
+#include "alloc_counter.h"
+#include "wasmi_daisy.h"
+#include "module_abi.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+struct WasmiSharedModule {
+    _Atomic int refs;
+    WasmiEngine* engine;
+    WasmiModule* module;  // NULL until a module is loaded
+    size_t code_size;     // Bytes of wasm the module was compiled from
+};
+
+static WasmiSharedModule* shared_new(void) {
+    WasmiSharedModule* shared = calloc(1, sizeof(WasmiSharedModule));
+    if (!shared) return NULL;
+
+    shared->engine = wasmi_engine_new();
+    if (!shared->engine) {
+        free(shared);
+        return NULL;
+    }
+    atomic_init(&shared->refs, 1);
+    return shared;
+}
+
+static void shared_release(WasmiSharedModule* shared) {
+    if (atomic_fetch_sub_explicit(&shared->refs, 1, memory_order_acq_rel) != 1) return;
+
+    if (shared->module) wasmi_module_delete(shared->module);
+    wasmi_engine_delete(shared->engine);
+    free(shared);
+}
+
+// Memory allocation functions required by wasmi-daisy. Everything it
+// allocates comes through here, linear memory included, so it is counted
+static AllocCounter wasmi_allocations;
+
+void* jaffx_sdram_malloc(size_t size) {
+    return alloc_counter_malloc(&wasmi_allocations, size);
+}
+
+void jaffx_sdram_free(void* ptr) {
+    alloc_counter_free(&wasmi_allocations, ptr);
+}
+
+#ifndef WASMI_DAISY_BLOCK_API
+#define WASMI_DAISY_BLOCK_API 0
+#endif
+
+// Stand-ins for a wasmi-daisy without the exports the module's ABI needs, so
+// the engine still links and instantiation fails cleanly
+#if !WASMI_DAISY_BLOCK_API
+static bool wasmi_func_call_i32_to_i32(WasmiStore* store, WasmiFunc* func, int32_t input, int32_t* result) {
+    (void)store; (void)func; (void)input; (void)result;
+    return false;
+}
+
+static bool wasmi_func_call_i32_f32_to_f32(WasmiStore* store, WasmiFunc* func, int32_t arg0, float arg1,
+                                           float* result) {
+    (void)store; (void)func; (void)arg0; (void)arg1; (void)result;
+    return false;
+}
+
+static uint8_t* wasmi_instance_memory_data(WasmiStore* store, WasmiInstance* instance, const uint8_t* name,
+                                           size_t name_len, size_t* out_len) {
+    (void)store; (void)instance; (void)name; (void)name_len;
+    *out_len = 0;
+    return NULL;
+}
+#endif
+
+bool wasmi_interp_supported(void) {
+    return WASMI_DAISY_BLOCK_API;
+}
+
+struct WasmiCallFailures {
+    _Atomic uint32_t count;
+    const char* _Atomic last_export;  // String literal naming the export
+};
+
+static WasmiFunc* lookup_func(WasmiInterpEngine* engine, const char* name) {
+    return wasmi_instance_get_func(engine->store, engine->instance,
+                                   (const uint8_t*)name, strlen(name));
+}
+
+// Base of the module's exported linear memory, or NULL if unavailable
+static uint8_t* memory_base(WasmiInterpEngine* engine) {
+    static const char memory_name[] = "memory";
+    size_t memory_len = 0;
+    uint8_t* memory = wasmi_instance_memory_data(engine->store, engine->instance,
+                                                 (const uint8_t*)memory_name,
+                                                 sizeof(memory_name) - 1, &memory_len);
+    return memory_len > 0 ? memory : NULL;
+}
+
+// Count a trapped call against the engine. name must be a string literal,
+// since it is read back on another thread
+static void count_failure(WasmiInterpEngine* engine, const char* name) {
+    atomic_store_explicit(&engine->failures->last_export, name, memory_order_relaxed);
+    atomic_fetch_add_explicit(&engine->failures->count, 1, memory_order_release);
+}
+
+static bool call_i32(WasmiInterpEngine* engine, WasmiFunc* func, const char* name, int32_t input, int32_t* result) {
+    if (wasmi_func_call_i32_to_i32(engine->store, func, input, result)) return true;
+
+    count_failure(engine, name);
+    return false;
+}
+
+// Whether a buffer the module reported lies inside its linear memory.
+// Memory only ever grows, so a buffer that fits once always does
+static bool fits(uint32_t offset, size_t bytes, size_t memory_len) {
+    return (uint64_t)offset + bytes <= memory_len;
+}
+
+// Look up the exports of a new instance and where its buffers live. Unlike
+// WAMR there is no per-sample fallback, so the block ABI is required
+static bool bind_exports(WasmiInterpEngine* engine) {
+    size_t memory_len = wasmi_interp_engine_linear_memory_size(engine);
+    if (!memory_base(engine)) return false;
+
+    engine->get_sample_func = lookup_func(engine, "get_sample");
+    engine->process_block_func = lookup_func(engine, "process_block");
+    engine->set_num_channels_func = lookup_func(engine, "set_num_channels");
+    engine->set_sample_rate_func = lookup_func(engine, "set_sample_rate");
+    WasmiFunc* get_input = lookup_func(engine, "get_input_buffer");
+    WasmiFunc* get_output = lookup_func(engine, "get_output_buffer");
+    bool ok = engine->get_sample_func && engine->process_block_func && engine->set_num_channels_func
+              && get_input && get_output;
+    for (uint32_t ch = 0; ok && ch < WASM_MODULE_MAX_CHANNELS; ch++) {
+        int32_t input_offset = 0, output_offset = 0;
+        ok = call_i32(engine, get_input, "get_input_buffer", (int32_t)ch, &input_offset)
+             && call_i32(engine, get_output, "get_output_buffer", (int32_t)ch, &output_offset);
+        engine->input_offsets[ch] = (uint32_t)input_offset;
+        engine->output_offsets[ch] = (uint32_t)output_offset;
+        ok = ok && fits(engine->input_offsets[ch], WASM_MODULE_MAX_BLOCK_SIZE * sizeof(float), memory_len)
+             && fits(engine->output_offsets[ch], WASM_MODULE_MAX_BLOCK_SIZE * sizeof(float), memory_len);
+    }
+    if (get_input) wasmi_func_delete(get_input);
+    if (get_output) wasmi_func_delete(get_output);
+    if (!ok) return false;
+
+    // Modules without parameters or MIDI still run, ignoring set_params and set_events
+    WasmiFunc* get_param = lookup_func(engine, "get_param_buffer");
+    if (get_param) {
+        int32_t offset = 0;
+        engine->has_params = call_i32(engine, get_param, "get_param_buffer", 0, &offset);
+        engine->param_offset = (uint32_t)offset;
+        wasmi_func_delete(get_param);
+        if (!engine->has_params
+            || !fits(engine->param_offset, WASM_MODULE_MAX_PARAMS * sizeof(float), memory_len)) {
+            return false;
+        }
+    }
+    WasmiFunc* get_events = lookup_func(engine, "get_event_buffer");
+    if (get_events) {
+        int32_t offset = 0;
+        engine->has_events = call_i32(engine, get_events, "get_event_buffer", 0, &offset);
+        engine->event_offset = (uint32_t)offset;
+        wasmi_func_delete(get_events);
+        if (!engine->has_events || !fits(engine->event_offset, sizeof(WasmMidiEventQueue), memory_len)) {
+            return false;
+        }
+    }
+    engine->num_channels = 1;  // The module starts out mono
+    return true;
+}
+
+static void deinstantiate(WasmiInterpEngine* engine) {
+    memory_snapshot_release(&engine->memory_snapshot);
+    if (engine->process_block_func) wasmi_func_delete(engine->process_block_func);
+    if (engine->set_num_channels_func) wasmi_func_delete(engine->set_num_channels_func);
+    if (engine->set_sample_rate_func) wasmi_func_delete(engine->set_sample_rate_func);
+    if (engine->get_sample_func) wasmi_func_delete(engine->get_sample_func);
+    if (engine->instance) wasmi_instance_delete(engine->instance);
+    engine->process_block_func = NULL;
+    engine->set_num_channels_func = NULL;
+    engine->set_sample_rate_func = NULL;
+    engine->get_sample_func = NULL;
+    engine->instance = NULL;
+    engine->has_params = false;
+    engine->has_events = false;
+}
+
+// Create the instance and function handles from the loaded module, leaving
+// the engine uninstantiated if the module doesn't fit the ABI
+static bool instantiate(WasmiInterpEngine* engine) {
+    // Loads elsewhere in the process at the same time would be counted too
+    size_t allocated_before = alloc_counter_current(&wasmi_allocations);
+    engine->instance = wasmi_instance_new(engine->store, engine->shared->module);
+    if (!engine->instance) return false;
+
+    size_t allocated_after = alloc_counter_current(&wasmi_allocations);
+    size_t allocated = allocated_after > allocated_before ? allocated_after - allocated_before : 0;
+    size_t memory = wasmi_interp_engine_linear_memory_size(engine);
+    engine->instance_bytes = allocated > memory ? allocated - memory : 0;
+
+    if (!bind_exports(engine)) {
+        deinstantiate(engine);
+        return false;
+    }
+
+    // Nothing has run in the instance yet, so this is what a restore returns to
+    uint8_t* base = memory_base(engine);
+    if (base) {
+        memory_snapshot_take(&engine->memory_snapshot, base, wasmi_interp_engine_linear_memory_size(engine), false);
+    }
+    return true;
+}
+
+static WasmiInterpEngine* engine_new(WasmiSharedModule* shared) {
+    WasmiInterpEngine* engine = calloc(1, sizeof(WasmiInterpEngine));
+    if (!engine) {
+        shared_release(shared);
+        return NULL;
+    }
+
+    engine->shared = shared;
+    engine->failures = calloc(1, sizeof(struct WasmiCallFailures));
+    engine->store = wasmi_store_new(shared->engine);
+    if (!engine->failures || !engine->store) {
+        wasmi_interp_engine_delete(engine);
+        return NULL;
+    }
+
+    return engine;
+}
+
+WasmiInterpEngine* wasmi_interp_engine_new(void) {
+    WasmiSharedModule* shared = shared_new();
+    if (!shared) return NULL;
+    return engine_new(shared);
+}
+
+WasmiInterpEngine* wasmi_interp_engine_new_instance(WasmiInterpEngine* source) {
+    if (!source->shared->module) return NULL;
+
+    atomic_fetch_add_explicit(&source->shared->refs, 1, memory_order_relaxed);
+    WasmiInterpEngine* engine = engine_new(source->shared);
+    if (engine && !instantiate(engine)) {
+        wasmi_interp_engine_delete(engine);
+        return NULL;
+    }
+    return engine;
+}
+
+void wasmi_interp_engine_delete(WasmiInterpEngine* engine) {
+    if (!engine) return;
+    deinstantiate(engine);
+    if (engine->store) wasmi_store_delete(engine->store);
+    shared_release(engine->shared);
+    free(engine->failures);
+    free(engine);
+}
+
+bool wasmi_interp_engine_load_module(WasmiInterpEngine* engine, const uint8_t* wasm_bytes, size_t size) {
+    deinstantiate(engine);
+
+    // Other instances may still run the module loaded before, so rather than
+    // replace it this engine moves to a shared module, and a store, of its own
+    if (engine->shared->module) {
+        WasmiSharedModule* shared = shared_new();
+        if (!shared) return false;
+        WasmiStore* store = wasmi_store_new(shared->engine);
+        if (!store) {
+            shared_release(shared);
+            return false;
+        }
+        wasmi_store_delete(engine->store);
+        shared_release(engine->shared);
+        engine->shared = shared;
+        engine->store = store;
+    }
+
+    engine->shared->module = wasmi_module_new(engine->shared->engine, wasm_bytes, size);
+    if (!engine->shared->module) return false;
+    engine->shared->code_size = size;
+
+    return instantiate(engine);
+}
+
+// Note: the store keeps the data of previous instances alive until it is
+// deleted, so frequent resets grow the store
+bool wasmi_interp_engine_reset(WasmiInterpEngine* engine) {
+    if (!engine->shared->module) return false;
+    deinstantiate(engine);
+    return instantiate(engine);
+}
+
+MemorySnapshotKind wasmi_interp_engine_restore(WasmiInterpEngine* engine) {
+    if (!engine->instance) return MEMORY_SNAPSHOT_NONE;
+
+    uint8_t* memory = memory_base(engine);
+    if (!memory) return MEMORY_SNAPSHOT_NONE;
+    MemorySnapshotKind kind = memory_snapshot_restore(&engine->memory_snapshot, memory,
+                                                      wasmi_interp_engine_linear_memory_size(engine));
+    if (kind != MEMORY_SNAPSHOT_NONE) engine->num_channels = 1;
+    return kind;
+}
+
+void wasmi_interp_allocated_bytes(size_t* current, size_t* peak) {
+    *current = alloc_counter_current(&wasmi_allocations);
+    *peak = alloc_counter_peak(&wasmi_allocations);
+}
+
+size_t wasmi_interp_engine_linear_memory_size(WasmiInterpEngine* engine) {
+    static const char memory_name[] = "memory";
+    size_t memory_len = 0;
+    if (engine->instance) {
+        wasmi_instance_memory_data(engine->store, engine->instance, (const uint8_t*)memory_name,
+                                   sizeof(memory_name) - 1, &memory_len);
+    }
+    return memory_len;
+}
+
+size_t wasmi_interp_engine_code_size(WasmiInterpEngine* engine) {
+    return engine->shared->module ? engine->shared->code_size : 0;
+}
+
+int32_t wasmi_interp_engine_memory_info(WasmiInterpEngine* engine, int32_t query) {
+    if (!engine->instance) return -1;
+
+    WasmiFunc* func = lookup_func(engine, "memory_info");
+    if (!func) return -1;
+
+    int32_t result = -1;
+    if (!call_i32(engine, func, "memory_info", query, &result)) result = -1;
+    wasmi_func_delete(func);
+    return result;
+}
+
+bool wasmi_interp_engine_set_params(WasmiInterpEngine* engine, const float* values, uint32_t count) {
+    if (!engine->has_params || count > WASM_MODULE_MAX_PARAMS) return false;
+
+    uint8_t* memory = memory_base(engine);
+    if (!memory) return false;
+    memcpy(memory + engine->param_offset, values, count * sizeof(float));
+    return true;
+}
+
+bool wasmi_interp_engine_set_events(WasmiInterpEngine* engine, const WasmMidiEvent* events, uint32_t count) {
+    if (!engine->has_events || count > WASM_MODULE_MAX_EVENTS) return false;
+
+    uint8_t* memory = memory_base(engine);
+    if (!memory) return false;
+    WasmMidiEventQueue* queue = (WasmMidiEventQueue*)(memory + engine->event_offset);
+    memcpy(queue->events, events, count * sizeof(WasmMidiEvent));
+    queue->next = 0;
+    queue->elapsed = 0;
+    queue->count = (int32_t)count;
+    return true;
+}
+
+bool wasmi_interp_engine_set_kernel(WasmiInterpEngine* engine, int32_t kernel) {
+    if (!engine->instance) return false;
+
+    WasmiFunc* func = lookup_func(engine, "set_kernel");
+    if (!func) return false;
+
+    int32_t selected = -1;
+    bool ok = call_i32(engine, func, "set_kernel", kernel, &selected);
+    wasmi_func_delete(func);
+    return ok && selected == kernel;
+}
+
+bool wasmi_interp_engine_set_sample_rate(WasmiInterpEngine* engine, int32_t rate) {
+    if (!engine->set_sample_rate_func) return false;
+
+    int32_t set = -1;
+    return call_i32(engine, engine->set_sample_rate_func, "set_sample_rate", rate, &set) && set == rate;
+}
+
+bool wasmi_interp_engine_set_num_channels(WasmiInterpEngine* engine, uint32_t num_channels) {
+    if (num_channels == engine->num_channels) return true;
+    if (!engine->set_num_channels_func) return false;
+
+    int32_t set = 0;
+    if (!call_i32(engine, engine->set_num_channels_func, "set_num_channels", (int32_t)num_channels, &set)
+        || set != (int32_t)num_channels) {
+        return false;
+    }
+    engine->num_channels = num_channels;
+    return true;
+}
+
+float wasmi_interp_engine_get_sample(WasmiInterpEngine* engine, uint32_t channel, float input, bool* trapped) {
+    float output = 0.0f;
+    if (!wasmi_func_call_i32_f32_to_f32(engine->store, engine->get_sample_func, (int32_t)channel, input, &output)) {
+        count_failure(engine, "get_sample");
+        *trapped = true;
+        return 0.0f;
+    }
+    return output;
+}
+
+bool wasmi_interp_engine_process_block(WasmiInterpEngine* engine, const float* const* input, float* const* output,
+                                       uint32_t num_channels, uint32_t num_samples) {
+    if (!engine->process_block_func) return false;
+    if (num_channels == 0 || num_channels > WASM_MODULE_MAX_CHANNELS) return false;
+
+    uint8_t* memory = memory_base(engine);
+    if (!memory) return false;
+
+    if (!wasmi_interp_engine_set_num_channels(engine, num_channels)) return false;
+
+    // Feed the module in chunks no larger than its I/O buffers
+    for (uint32_t offset = 0; offset < num_samples; ) {
+        uint32_t chunk = num_samples - offset;
+        if (chunk > WASM_MODULE_MAX_BLOCK_SIZE) chunk = WASM_MODULE_MAX_BLOCK_SIZE;
+        for (uint32_t ch = 0; ch < num_channels; ch++) {
+            memcpy(memory + engine->input_offsets[ch], input[ch] + offset, chunk * sizeof(float));
+        }
+
+        int32_t processed = 0;
+        if (!call_i32(engine, engine->process_block_func, "process_block", (int32_t)chunk, &processed)
+            || processed != (int32_t)chunk) {
+            return false;
+        }
+
+        // Re-read the memory base in case the call grew linear memory
+        memory = memory_base(engine);
+        for (uint32_t ch = 0; ch < num_channels; ch++) {
+            memcpy(output[ch] + offset, memory + engine->output_offsets[ch], chunk * sizeof(float));
+        }
+        offset += chunk;
+    }
+    return true;
+}
+
+uint32_t wasmi_interp_engine_take_failures(WasmiInterpEngine* engine, const char** last_export) {
+    uint32_t count = atomic_exchange_explicit(&engine->failures->count, 0, memory_order_acquire);
+    *last_export = count > 0 ? atomic_load_explicit(&engine->failures->last_export, memory_order_relaxed) : NULL;
+    return count;
+}
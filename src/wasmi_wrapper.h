@@ -0,0 +1,120 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "memory_snapshot.h"
+#include "module_abi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Forward declarations for wasmi
+typedef struct WasmiEngine WasmiEngine;
+typedef struct WasmiStore WasmiStore;
+typedef struct WasmiModule WasmiModule;
+typedef struct WasmiInstance WasmiInstance;
+typedef struct WasmiFunc WasmiFunc;
+
+// Refcounted Wasmi engine and compiled module, shared by every instance
+typedef struct WasmiSharedModule WasmiSharedModule;
+
+// Calls that trapped, counted by the audio thread
+struct WasmiCallFailures;
+
+typedef struct {
+    WasmiSharedModule* shared;
+    WasmiStore* store;  // Each instance gets its own store
+    WasmiInstance* instance;
+    WasmiFunc* get_sample_func;
+    WasmiFunc* process_block_func;
+    WasmiFunc* set_num_channels_func;
+    WasmiFunc* set_sample_rate_func;  // NULL if the module has no set_sample_rate
+    size_t instance_bytes;  // Runtime allocations the last instantiation made, linear memory excluded
+    uint32_t num_channels;  // Channel count the module is currently set to
+    uint32_t input_offsets[WASM_MODULE_MAX_CHANNELS];   // Guest addresses of the module's input buffers
+    uint32_t output_offsets[WASM_MODULE_MAX_CHANNELS];  // Guest addresses of the module's output buffers
+    bool has_params;        // The module has a parameter block and it was resolved
+    uint32_t param_offset;  // Guest address of that block
+    bool has_events;        // The module has a MIDI event queue and it was resolved
+    uint32_t event_offset;  // Guest address of that queue
+    MemorySnapshot memory_snapshot;  // Linear memory right after instantiation
+    struct WasmiCallFailures* failures;
+} WasmiInterpEngine;
+
+// Whether this wasmi-daisy can run the module's ABI. get_sample, the block
+// path, kernels, parameters, MIDI, snapshots and memory_info all need its
+// i32 call and memory exports (wasmi_func_call_i32_to_i32,
+// wasmi_func_call_i32_f32_to_f32 and wasmi_instance_memory_data), which
+// CMake looks for in wasmi_daisy.h. Without them every engine fails to load
+bool wasmi_interp_supported(void);
+
+WasmiInterpEngine* wasmi_interp_engine_new(void);
+
+// New instance of the module already compiled by source, without recompiling it
+WasmiInterpEngine* wasmi_interp_engine_new_instance(WasmiInterpEngine* source);
+void wasmi_interp_engine_delete(WasmiInterpEngine* engine);
+
+// Compile and instantiate a module. Fails unless it exports get_sample and
+// the whole block ABI (see module_abi.h), and every buffer it reports lies
+// inside its linear memory, so later copies need no bounds checks. Loading
+// again replaces the engine's instance, leaving instances created from it
+// running the module loaded before
+bool wasmi_interp_engine_load_module(WasmiInterpEngine* engine, const uint8_t* wasm_bytes, size_t size);
+
+// Channels process_block and a get_sample frame cover; get_sample is called
+// channel 0 up for each sample (see module_abi.h), and if it traps returns 0
+// and sets *trapped, which it leaves alone otherwise
+bool wasmi_interp_engine_set_num_channels(WasmiInterpEngine* engine, uint32_t num_channels);
+float wasmi_interp_engine_get_sample(WasmiInterpEngine* engine, uint32_t channel, float input, bool* trapped);
+
+bool wasmi_interp_engine_reset(WasmiInterpEngine* engine);
+
+// Put the instance back as it was instantiated by restoring its linear
+// memory from a copy taken then, without growing the store as a reset does.
+// Like WAMR's, relies on the module keeping its state in memory.
+// MEMORY_SNAPSHOT_NONE if the memory has grown since
+MemorySnapshotKind wasmi_interp_engine_restore(WasmiInterpEngine* engine);
+
+// Bytes wasmi-daisy has allocated (through jaffx_sdram_malloc), process-wide,
+// now and at the most
+void wasmi_interp_allocated_bytes(size_t* current, size_t* peak);
+
+// Current size of the instance's linear memory
+size_t wasmi_interp_engine_linear_memory_size(WasmiInterpEngine* engine);
+
+// Size of the loaded wasm bytecode
+size_t wasmi_interp_engine_code_size(WasmiInterpEngine* engine);
+
+// Ask the module's memory_info export; -1 if it has none or it trapped.
+// Not for the audio thread
+int32_t wasmi_interp_engine_memory_info(WasmiInterpEngine* engine, int32_t query);
+
+// Write values[0..count) into the module's parameter block; they apply from
+// the next call. Safe on the audio thread
+bool wasmi_interp_engine_set_params(WasmiInterpEngine* engine, const float* values, uint32_t count);
+
+// Replace the module's MIDI event queue with events[0..count), timed from
+// the next call. Safe on the audio thread
+bool wasmi_interp_engine_set_events(WasmiInterpEngine* engine, const WasmMidiEvent* events, uint32_t count);
+
+// Select a WasmModuleKernel. Not for the audio thread
+bool wasmi_interp_engine_set_kernel(WasmiInterpEngine* engine, int32_t kernel);
+
+// Set the rate in Hz the module designs its coefficients for; false if it
+// has no set_sample_rate export, rejects the rate or traps. Safe on the
+// audio thread
+bool wasmi_interp_engine_set_sample_rate(WasmiInterpEngine* engine, int32_t rate);
+// Planar buffers for up to WASM_MODULE_MAX_CHANNELS channels; false if a
+// call trapped or the module processed fewer samples than asked
+bool wasmi_interp_engine_process_block(WasmiInterpEngine* engine, const float* const* input, float* const* output,
+                                       uint32_t num_channels, uint32_t num_samples);
+
+// How many calls have trapped since this was last asked, and the export the
+// latest of them called (NULL if none). Call from a single non-audio thread
+uint32_t wasmi_interp_engine_take_failures(WasmiInterpEngine* engine, const char** last_export);
+
+#ifdef __cplusplus
+}
+#endif
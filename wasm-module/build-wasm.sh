@@ -9,16 +9,23 @@ cat > build/module_wrapper.cpp << 'EOF'
 EOF
 
 # Compile C++ to WebAssembly with exported functions
-# The wrapper provides extern "C" linkage without modifying the original source
-emcc build/module_wrapper.cpp -O2 -o build/module.wasm \
-  -I. \
-  -sSTANDALONE_WASM \
-  -sEXPORTED_RUNTIME_METHODS=[] \
-  -sEXPORTED_FUNCTIONS=_get_sample \
-  --no-entry
-
-# Convert WASM binary to C header array
+# The wrapper provides extern "C" linkage without modifying the original source.
+# The module is built twice: scalar, and with 128-bit SIMD (-msimd128)
+EXPORTS=_get_sample,_get_input_buffer,_get_output_buffer,_set_num_channels,_set_kernel,_process_block,_memory_info,_get_param_buffer,_get_event_buffer,_set_sample_rate
+build_variant() {
+  emcc build/module_wrapper.cpp kernels.cpp -O2 "$@" \
+    -I. \
+    -sSTANDALONE_WASM \
+    -sEXPORTED_RUNTIME_METHODS=[] \
+    -sEXPORTED_FUNCTIONS=$EXPORTS \
+    --no-entry
+}
+build_variant -o build/module.wasm
+build_variant -msimd128 -o build/module_simd.wasm
+
+# Convert WASM binaries to C header arrays
 xxd -i -n module_wasm build/module.wasm > build/module_wasm.h
+xxd -i -n module_simd_wasm build/module_simd.wasm > build/module_simd_wasm.h
 
 # Build AOT file using wamrc (if available)
 if [ -f "../build/wamrc" ]; then
@@ -33,6 +40,46 @@ if [ -f "../build/wamrc" ]; then
     ../build/wamrc --target=$TARGET -o build/module.aot build/module.wasm
     xxd -i -n module_aot build/module.aot > build/module_aot.h
     echo "✓ Built AOT file for $TARGET and generated module_aot.h"
+
+    # wamrc enables 128-bit SIMD by default on x86_64 and aarch64, which
+    # the runtime must also be built with (WAMR_BUILD_SIMD)
+    ../build/wamrc --target=$TARGET -o build/module_simd.aot build/module_simd.wasm
+    xxd -i -n module_simd_aot build/module_simd.aot > build/module_simd_aot.h
+    echo "✓ Built SIMD AOT file for $TARGET and generated module_simd_aot.h"
+
+    # Matrix of AOT builds, one wamrc setting changed from the default each,
+    # so wasm-bench --aot-variants can measure what every setting costs.
+    # Entries are "label|wamrc flags"; "host-cpu" omits --target so wamrc
+    # generates code for this machine's CPU and features
+    AOT_MATRIX=(
+        "default|--target=$TARGET"
+        "O0|--target=$TARGET --opt-level=0"
+        "O1|--target=$TARGET --opt-level=1"
+        "O2|--target=$TARGET --opt-level=2"
+        "size0|--target=$TARGET --size-level=0"
+        "size1|--target=$TARGET --size-level=1"
+        "bounds-checks|--target=$TARGET --bounds-checks=1"
+        "stack-checks|--target=$TARGET --stack-bounds-checks=1"
+        "no-stack-checks|--target=$TARGET --stack-bounds-checks=0"
+        "host-cpu|"
+    )
+    # A newer x86-64 baseline, only where this CPU can run it
+    if [ "$TARGET" = "x86_64" ] && { grep -qw avx2 /proc/cpuinfo 2>/dev/null ||
+                                     sysctl -n machdep.cpu.leaf7_features 2>/dev/null | grep -qw AVX2; }; then
+        AOT_MATRIX+=("x86-64-v3|--target=$TARGET --cpu=x86-64-v3")
+    fi
+
+    rm -rf build/aot
+    mkdir -p build/aot
+    for ENTRY in "${AOT_MATRIX[@]}"; do
+        LABEL=${ENTRY%%|*}
+        FLAGS=${ENTRY#*|}
+        ../build/wamrc $FLAGS -o build/aot/module-$LABEL.aot build/module.wasm > /dev/null &&
+        ../build/wamrc $FLAGS -o build/aot/module_simd-$LABEL.aot build/module_simd.wasm > /dev/null ||
+            { echo "⚠ wamrc failed for AOT variant $LABEL"; continue; }
+        printf '%s\t%s\n' "$LABEL" "$FLAGS" >> build/aot/matrix.txt
+    done
+    echo "✓ Built $(wc -l < build/aot/matrix.txt | tr -d ' ') AOT variants in build/aot"
 else
     echo "⚠ wamrc not found, skipping AOT build"
 fi
@@ -42,9 +89,23 @@ if command -v wasm2c >/dev/null 2>&1; then
     echo "Converting build/module.wasm to C using wasm2c..."
     wasm2c build/module.wasm -o ../build/module.c
     echo "✓ Generated ../build/module.c and ../build/module.h"
+
+    # Separate module name so both variants can link into one binary. The
+    # SIMD output includes SIMDe, which the build only compiles if found
+    wasm2c --enable-simd -n simdmodule build/module_simd.wasm -o ../build/module_simd.c
+    echo "✓ Generated ../build/module_simd.c and ../build/module_simd.h"
+
+    # Copies of the scalar module for the wasm2c engine variants: compiled
+    # without inline bounds checks (for guard pages, or no checks at all),
+    # with explicit bounds checks, and compiled into the static-instance
+    # engine's translation unit
+    wasm2c -n uncheckedmodule build/module.wasm -o ../build/module_unchecked.c
+    wasm2c -n boundsmodule build/module.wasm -o ../build/module_bounds.c
+    wasm2c -n staticmodule build/module.wasm -o ../build/module_static.c
+    echo "✓ Generated ../build/module_unchecked.c, module_bounds.c and module_static.c"
 else
     echo "⚠ wasm2c not found, skipping wasm2c conversion"
 fi
 
-echo "✓ Built WASM file and generated module_wasm.h"
-echo "✓ Function 'get_sample' exported with C linkage"
\ No newline at end of file
+echo "✓ Built WASM files and generated module_wasm.h and module_simd_wasm.h"
+echo "✓ Functions 'get_sample', 'process_block' and 'set_kernel' exported with C linkage"
\ No newline at end of file
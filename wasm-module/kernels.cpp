@@ -0,0 +1,577 @@
+#include "kernels.h"
+#include <math.h>
+#include <string.h>
+
+// Built together with module.cpp, once plain and once with -msimd128. Only
+// the gain kernel uses SIMD explicitly; the others are left to the
+// auto-vectoriser so each engine sees the code a compiler would produce
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+namespace {
+
+float sample_rate = WASM_MODULE_DEFAULT_SAMPLE_RATE;  // What the coefficients are designed for
+const float pi = 3.14159265358979f;
+
+//==============================================================================
+// Gain: call overhead and memory bandwidth only
+
+const float gain = 0.2f;
+
+void gain_reset(void) {}
+
+void gain_process(int, const float* input, float* output, int num_samples) {
+    int i = 0;
+#ifdef __wasm_simd128__
+    const v128_t gain4 = wasm_f32x4_splat(gain);
+    for (; i + 4 <= num_samples; i += 4) {
+        v128_t x = wasm_v128_load(&input[i]);
+        wasm_v128_store(&output[i], wasm_f32x4_mul(x, gain4));
+    }
+#endif
+    for (; i < num_samples; i++) {
+        output[i] = input[i] * gain;
+    }
+}
+
+//==============================================================================
+// Biquad cascade: serially dependent arithmetic, small state
+
+const int biquad_sections = 8;
+
+struct Biquad {
+    float b0, b1, b2, a1, a2;
+};
+
+Biquad biquad_coeffs[biquad_sections];
+float biquad_state[WASM_MODULE_MAX_CHANNELS][biquad_sections][2];
+
+// RBJ cookbook peaking EQ; centres past the rate's Nyquist are pulled below it
+Biquad design_peaking(float frequency, float q, float gain_db) {
+    float a = powf(10.0f, gain_db / 40.0f);
+    float w0 = 2.0f * pi * fminf(frequency, 0.45f * sample_rate) / sample_rate;
+    float alpha = sinf(w0) / (2.0f * q);
+    float a0 = 1.0f + alpha / a;
+    Biquad c;
+    c.b0 = (1.0f + alpha * a) / a0;
+    c.b1 = -2.0f * cosf(w0) / a0;
+    c.b2 = (1.0f - alpha * a) / a0;
+    c.a1 = c.b1;
+    c.a2 = (1.0f - alpha / a) / a0;
+    return c;
+}
+
+void biquad_design(void) {
+    for (int s = 0; s < biquad_sections; s++) {
+        float frequency = 60.0f * powf(2.0f, (float)s * 1.2f);
+        biquad_coeffs[s] = design_peaking(frequency, 1.0f, (s & 1) ? -4.0f : 4.0f);
+    }
+}
+
+void biquad_reset(void) {
+    biquad_design();
+    memset(biquad_state, 0, sizeof(biquad_state));
+}
+
+void biquad_process(int channel, const float* input, float* output, int num_samples) {
+    float (*state)[2] = biquad_state[channel];
+    for (int i = 0; i < num_samples; i++) {
+        float x = input[i];
+        // Transposed direct form II
+        for (int s = 0; s < biquad_sections; s++) {
+            const Biquad& c = biquad_coeffs[s];
+            float y = c.b0 * x + state[s][0];
+            state[s][0] = c.b1 * x - c.a1 * y + state[s][1];
+            state[s][1] = c.b2 * x - c.a2 * y;
+            x = y;
+        }
+        output[i] = x;
+    }
+}
+
+//==============================================================================
+// FIR: long multiply-accumulate over a history buffer
+
+const int fir_taps = 512;
+
+float fir_coeffs[fir_taps];
+
+// History is stored twice so every dot product reads one contiguous run
+float fir_history[WASM_MODULE_MAX_CHANNELS][2 * fir_taps];
+int fir_position[WASM_MODULE_MAX_CHANNELS];
+
+void fir_design(void) {
+    // Hann-windowed sinc lowpass at 4 kHz
+    const float cutoff = 4000.0f / sample_rate;
+    const float centre = 0.5f * (float)(fir_taps - 1);
+    for (int k = 0; k < fir_taps; k++) {
+        float t = (float)k - centre;
+        float sinc = t == 0.0f ? 2.0f * cutoff : sinf(2.0f * pi * cutoff * t) / (pi * t);
+        float window = 0.5f - 0.5f * cosf(2.0f * pi * (float)k / (float)(fir_taps - 1));
+        fir_coeffs[k] = sinc * window;
+    }
+}
+
+void fir_reset(void) {
+    fir_design();
+    memset(fir_history, 0, sizeof(fir_history));
+    memset(fir_position, 0, sizeof(fir_position));
+}
+
+void fir_process(int channel, const float* input, float* output, int num_samples) {
+    float* history = fir_history[channel];
+    int position = fir_position[channel];
+    for (int i = 0; i < num_samples; i++) {
+        position = (position == 0 ? fir_taps : position) - 1;
+        history[position] = history[position + fir_taps] = input[i];
+
+        // history[position + k] is the input k samples ago
+        const float* x = history + position;
+        float acc = 0.0f;
+        for (int k = 0; k < fir_taps; k++) {
+            acc += fir_coeffs[k] * x[k];
+        }
+        output[i] = acc;
+    }
+    fir_position[channel] = position;
+}
+
+//==============================================================================
+// FFT filter: frames of fft_size samples go through a forward FFT, a
+// spectral lowpass and an inverse FFT. Output lags input by one frame
+
+const int fft_size = 1024;
+const int fft_log2 = 10;
+
+float fft_cos[fft_size / 2];
+float fft_sin[fft_size / 2];
+int fft_bit_reverse[fft_size];
+
+float fft_in_frame[WASM_MODULE_MAX_CHANNELS][fft_size];
+float fft_out_frame[WASM_MODULE_MAX_CHANNELS][fft_size];
+int fft_fill[WASM_MODULE_MAX_CHANNELS];
+
+// Scratch shared by all channels; channels are processed one at a time
+float fft_re[fft_size];
+float fft_im[fft_size];
+
+void fft_reset(void) {
+    for (int k = 0; k < fft_size / 2; k++) {
+        fft_cos[k] = cosf(2.0f * pi * (float)k / (float)fft_size);
+        fft_sin[k] = sinf(2.0f * pi * (float)k / (float)fft_size);
+    }
+    for (int i = 0; i < fft_size; i++) {
+        int reversed = 0;
+        for (int b = 0; b < fft_log2; b++) {
+            reversed |= ((i >> b) & 1) << (fft_log2 - 1 - b);
+        }
+        fft_bit_reverse[i] = reversed;
+    }
+    memset(fft_in_frame, 0, sizeof(fft_in_frame));
+    memset(fft_out_frame, 0, sizeof(fft_out_frame));
+    memset(fft_fill, 0, sizeof(fft_fill));
+}
+
+// In-place iterative radix-2 FFT of fft_re/fft_im; inverse uses conjugate twiddles
+void fft_transform(bool inverse) {
+    for (int i = 0; i < fft_size; i++) {
+        int j = fft_bit_reverse[i];
+        if (j > i) {
+            float re = fft_re[i], im = fft_im[i];
+            fft_re[i] = fft_re[j]; fft_im[i] = fft_im[j];
+            fft_re[j] = re; fft_im[j] = im;
+        }
+    }
+
+    const float sign = inverse ? 1.0f : -1.0f;
+    for (int half = 1; half < fft_size; half <<= 1) {
+        int stride = fft_size / (2 * half);
+        for (int start = 0; start < fft_size; start += 2 * half) {
+            for (int k = 0; k < half; k++) {
+                float wr = fft_cos[k * stride];
+                float wi = sign * fft_sin[k * stride];
+                int a = start + k, b = a + half;
+                float tr = wr * fft_re[b] - wi * fft_im[b];
+                float ti = wr * fft_im[b] + wi * fft_re[b];
+                fft_re[b] = fft_re[a] - tr;
+                fft_im[b] = fft_im[a] - ti;
+                fft_re[a] += tr;
+                fft_im[a] += ti;
+            }
+        }
+    }
+}
+
+void fft_filter_frame(int channel) {
+    memcpy(fft_re, fft_in_frame[channel], sizeof(fft_re));
+    memset(fft_im, 0, sizeof(fft_im));
+    fft_transform(false);
+
+    // Keep the bottom eighth of the spectrum (and its mirror)
+    const int cutoff_bin = fft_size / 16;
+    for (int k = cutoff_bin; k <= fft_size - cutoff_bin; k++) {
+        fft_re[k] = 0.0f;
+        fft_im[k] = 0.0f;
+    }
+
+    fft_transform(true);
+    const float scale = 1.0f / (float)fft_size;
+    for (int i = 0; i < fft_size; i++) {
+        fft_out_frame[channel][i] = fft_re[i] * scale;
+    }
+}
+
+void fft_process(int channel, const float* input, float* output, int num_samples) {
+    int fill = fft_fill[channel];
+    for (int i = 0; i < num_samples; i++) {
+        output[i] = fft_out_frame[channel][fill];
+        fft_in_frame[channel][fill] = input[i];
+        if (++fill == fft_size) {
+            fft_filter_frame(channel);
+            fill = 0;
+        }
+    }
+    fft_fill[channel] = fill;
+}
+
+//==============================================================================
+// Oscillator bank: table lookups with interpolation, mixed with the input
+
+const int oscillators = 32;
+const int table_size = 2048;
+
+float wavetable[table_size + 1];  // Guard point for interpolation
+float oscillator_increment[oscillators];
+float oscillator_phase[WASM_MODULE_MAX_CHANNELS][oscillators];
+
+void oscillator_design(void) {
+    for (int o = 0; o < oscillators; o++) {
+        float frequency = 55.0f * (float)(o + 1) * (1.0f + 0.003f * (float)o);
+        oscillator_increment[o] = frequency * (float)table_size / sample_rate;
+    }
+}
+
+void oscillator_reset(void) {
+    // Band-limited sawtooth from its first 16 harmonics
+    for (int i = 0; i <= table_size; i++) {
+        float sum = 0.0f;
+        for (int h = 1; h <= 16; h++) {
+            sum += sinf(2.0f * pi * (float)h * (float)i / (float)table_size) / (float)h;
+        }
+        wavetable[i] = sum * 0.5f;
+    }
+    oscillator_design();
+    memset(oscillator_phase, 0, sizeof(oscillator_phase));
+}
+
+void oscillator_process(int channel, const float* input, float* output, int num_samples) {
+    float* phase = oscillator_phase[channel];
+    const float bank_gain = 0.5f / (float)oscillators;
+    for (int i = 0; i < num_samples; i++) {
+        float sum = 0.0f;
+        for (int o = 0; o < oscillators; o++) {
+            int index = (int)phase[o];
+            float frac = phase[o] - (float)index;
+            sum += wavetable[index] + frac * (wavetable[index + 1] - wavetable[index]);
+
+            phase[o] += oscillator_increment[o];
+            if (phase[o] >= (float)table_size) phase[o] -= (float)table_size;
+        }
+        output[i] = 0.5f * input[i] + bank_gain * sum;
+    }
+}
+
+//==============================================================================
+// FDN reverb: eight delay lines mixed through a Hadamard matrix. Large state
+// and scattered reads make this the memory-heavy kernel
+
+const int fdn_lines = 8;
+const int fdn_buffer_size = 4096;  // Power of two, longer than any delay
+const int fdn_delays[fdn_lines] = { 1031, 1327, 1523, 1871, 2053, 2311, 2539, 2801 };
+const float fdn_feedback = 0.85f;
+const float fdn_damping = 0.3f;
+
+float fdn_buffer[WASM_MODULE_MAX_CHANNELS][fdn_lines][fdn_buffer_size];
+float fdn_lowpass[WASM_MODULE_MAX_CHANNELS][fdn_lines];
+int fdn_position[WASM_MODULE_MAX_CHANNELS];
+
+void fdn_reset(void) {
+    memset(fdn_buffer, 0, sizeof(fdn_buffer));
+    memset(fdn_lowpass, 0, sizeof(fdn_lowpass));
+    memset(fdn_position, 0, sizeof(fdn_position));
+}
+
+// Fast Walsh-Hadamard transform of 8 values, normalised to stay lossless
+void hadamard8(float* v) {
+    for (int half = 1; half < fdn_lines; half <<= 1) {
+        for (int start = 0; start < fdn_lines; start += 2 * half) {
+            for (int k = start; k < start + half; k++) {
+                float a = v[k], b = v[k + half];
+                v[k] = a + b;
+                v[k + half] = a - b;
+            }
+        }
+    }
+    const float norm = 0.35355339f;  // 1 / sqrt(8)
+    for (int k = 0; k < fdn_lines; k++) v[k] *= norm;
+}
+
+void fdn_process(int channel, const float* input, float* output, int num_samples) {
+    float (*lines)[fdn_buffer_size] = fdn_buffer[channel];
+    float* lowpass = fdn_lowpass[channel];
+    int position = fdn_position[channel];
+    const int mask = fdn_buffer_size - 1;
+
+    for (int i = 0; i < num_samples; i++) {
+        float taps[fdn_lines];
+        float wet = 0.0f;
+        for (int l = 0; l < fdn_lines; l++) {
+            float delayed = lines[l][(position - fdn_delays[l]) & mask];
+            lowpass[l] += fdn_damping * (delayed - lowpass[l]);
+            taps[l] = lowpass[l];
+            wet += delayed;
+        }
+
+        hadamard8(taps);
+        for (int l = 0; l < fdn_lines; l++) {
+            lines[l][position] = input[i] + fdn_feedback * taps[l];
+        }
+
+        output[i] = 0.7f * input[i] + 0.3f * wet / (float)fdn_lines;
+        position = (position + 1) & mask;
+    }
+    fdn_position[channel] = position;
+}
+
+//==============================================================================
+// Waveshaper at 4x oversampling: polyphase interpolation, a branchy soft
+// clipper per oversampled sample and decimation through the same lowpass
+
+const int oversampling = 4;
+const int os_taps = 32;  // os_taps / oversampling taps per polyphase branch
+const int os_branch_taps = os_taps / oversampling;
+const float drive = 4.0f;
+
+float os_coeffs[os_taps];
+float os_up_history[WASM_MODULE_MAX_CHANNELS][2 * os_branch_taps];
+int os_up_position[WASM_MODULE_MAX_CHANNELS];
+float os_down_history[WASM_MODULE_MAX_CHANNELS][2 * os_taps];
+int os_down_position[WASM_MODULE_MAX_CHANNELS];
+
+void waveshaper_reset(void) {
+    // Hann-windowed sinc at the original Nyquist, normalised to unity DC gain
+    const float cutoff = 0.5f / (float)oversampling;
+    const float centre = 0.5f * (float)(os_taps - 1);
+    float sum = 0.0f;
+    for (int k = 0; k < os_taps; k++) {
+        float t = (float)k - centre;
+        float sinc = sinf(2.0f * pi * cutoff * t) / (pi * t);
+        float window = 0.5f - 0.5f * cosf(2.0f * pi * (float)k / (float)(os_taps - 1));
+        os_coeffs[k] = sinc * window;
+        sum += os_coeffs[k];
+    }
+    for (int k = 0; k < os_taps; k++) os_coeffs[k] /= sum;
+
+    memset(os_up_history, 0, sizeof(os_up_history));
+    memset(os_up_position, 0, sizeof(os_up_position));
+    memset(os_down_history, 0, sizeof(os_down_history));
+    memset(os_down_position, 0, sizeof(os_down_position));
+}
+
+// Cubic soft clip with hard limits outside [-1, 1]
+float soft_clip(float x) {
+    x *= drive;
+    if (x > 1.0f) return 2.0f / 3.0f;
+    if (x < -1.0f) return -2.0f / 3.0f;
+    return x - x * x * x / 3.0f;
+}
+
+void waveshaper_process(int channel, const float* input, float* output, int num_samples) {
+    float* up = os_up_history[channel];
+    float* down = os_down_history[channel];
+    int up_position = os_up_position[channel];
+    int down_position = os_down_position[channel];
+
+    for (int i = 0; i < num_samples; i++) {
+        up_position = (up_position == 0 ? os_branch_taps : up_position) - 1;
+        up[up_position] = up[up_position + os_branch_taps] = input[i];
+
+        for (int phase = 0; phase < oversampling; phase++) {
+            // Zero-stuffed interpolation: branch `phase` uses every
+            // oversampling-th coefficient, gained back up by the factor
+            float acc = 0.0f;
+            for (int k = 0; k < os_branch_taps; k++) {
+                acc += os_coeffs[k * oversampling + phase] * up[up_position + k];
+            }
+
+            down_position = (down_position == 0 ? os_taps : down_position) - 1;
+            down[down_position] = down[down_position + os_taps] = soft_clip(acc * (float)oversampling);
+        }
+
+        // Only every oversampling-th output of the decimation filter is kept
+        float acc = 0.0f;
+        for (int k = 0; k < os_taps; k++) {
+            acc += os_coeffs[k] * down[down_position + k];
+        }
+        output[i] = acc;
+    }
+
+    os_up_position[channel] = up_position;
+    os_down_position[channel] = down_position;
+}
+
+//==============================================================================
+// Synth: up to 128 voices per channel, each a wavetable sawtooth through an
+// ADSR envelope, allocated and released by MIDI note events. The cost grows
+// with the number of sounding voices, like an instrument's
+
+const int synth_voices = 128;
+const float synth_attack_seconds = 0.005f;    // Linear
+const float synth_decay_seconds = 0.042f;     // Time constant towards sustain
+const float synth_sustain = 0.6f;
+const float synth_release_seconds = 0.021f;   // Time constant towards silence
+const float synth_silence = 1.0e-4f;
+const float synth_gain = 0.05f;
+
+enum SynthStage { synth_idle = 0, synth_attack_stage, synth_decay_stage, synth_release_stage };
+
+struct SynthVoice {
+    float phase;
+    float increment;
+    float level;     // Envelope
+    float velocity;
+    int stage;
+    int note;
+    unsigned age;    // Note-on order, to steal the oldest voice
+};
+
+SynthVoice synth_state[WASM_MODULE_MAX_CHANNELS][synth_voices];
+unsigned synth_clock[WASM_MODULE_MAX_CHANNELS];
+
+// Envelope steps per sample at the current rate
+float synth_attack;
+float synth_decay;
+float synth_release;
+
+void synth_design(void) {
+    synth_attack = 1.0f / (synth_attack_seconds * sample_rate);
+    synth_decay = expf(-1.0f / (synth_decay_seconds * sample_rate));
+    synth_release = expf(-1.0f / (synth_release_seconds * sample_rate));
+}
+
+void synth_reset(void) {
+    oscillator_reset();  // Shares the band-limited sawtooth table
+    synth_design();
+    memset(synth_state, 0, sizeof(synth_state));
+    memset(synth_clock, 0, sizeof(synth_clock));
+}
+
+// Free voice if there is one, else the quietest releasing one, else the oldest
+SynthVoice* synth_allocate(SynthVoice* voices) {
+    SynthVoice* releasing = nullptr;
+    SynthVoice* oldest = &voices[0];
+    for (int v = 0; v < synth_voices; v++) {
+        SynthVoice* voice = &voices[v];
+        if (voice->stage == synth_idle) return voice;
+        if (voice->stage == synth_release_stage && (!releasing || voice->level < releasing->level)) releasing = voice;
+        if (voice->age < oldest->age) oldest = voice;
+    }
+    return releasing ? releasing : oldest;
+}
+
+void synth_event(int channel, const WasmMidiEvent* event) {
+    SynthVoice* voices = synth_state[channel];
+    int type = event->status & 0xf0;
+    if (type == 0x90 && event->data2 > 0) {
+        SynthVoice* voice = synth_allocate(voices);
+        float frequency = 440.0f * powf(2.0f, ((float)event->data1 - 69.0f) / 12.0f);
+        voice->increment = frequency * (float)table_size / sample_rate;
+        voice->velocity = (float)event->data2 / 127.0f;
+        voice->stage = synth_attack_stage;
+        voice->note = event->data1;
+        voice->age = ++synth_clock[channel];
+        // A stolen voice keeps its phase and level, so it doesn't click
+    } else if (type == 0x80 || type == 0x90) {
+        for (int v = 0; v < synth_voices; v++) {
+            if (voices[v].note == event->data1 && voices[v].stage != synth_idle) voices[v].stage = synth_release_stage;
+        }
+    } else if (type == 0xb0 && (event->data1 == 120 || event->data1 == 123)) {
+        // All sound off / all notes off
+        for (int v = 0; v < synth_voices; v++) {
+            if (voices[v].stage != synth_idle) voices[v].stage = synth_release_stage;
+        }
+    }
+}
+
+void synth_process(int channel, const float*, float* output, int num_samples) {
+    memset(output, 0, (size_t)num_samples * sizeof(float));
+    SynthVoice* voices = synth_state[channel];
+    for (int v = 0; v < synth_voices; v++) {
+        SynthVoice* voice = &voices[v];
+        if (voice->stage == synth_idle) continue;
+
+        float phase = voice->phase;
+        float level = voice->level;
+        int stage = voice->stage;
+        const float gain = voice->velocity * synth_gain;
+        for (int i = 0; i < num_samples; i++) {
+            if (stage == synth_attack_stage) {
+                level += synth_attack;
+                if (level >= 1.0f) { level = 1.0f; stage = synth_decay_stage; }
+            } else if (stage == synth_decay_stage) {
+                level = synth_sustain + (level - synth_sustain) * synth_decay;
+            } else {
+                level *= synth_release;
+                if (level < synth_silence) { stage = synth_idle; break; }
+            }
+
+            int index = (int)phase;
+            float frac = phase - (float)index;
+            float sample = wavetable[index] + frac * (wavetable[index + 1] - wavetable[index]);
+            output[i] += sample * level * gain;
+
+            phase += voice->increment;
+            if (phase >= (float)table_size) phase -= (float)table_size;
+        }
+        voice->phase = phase;
+        voice->level = stage == synth_idle ? 0.0f : level;
+        voice->stage = stage;
+    }
+}
+
+//==============================================================================
+const Kernel kernels[WASM_KERNEL_COUNT] = {
+    { gain_reset, gain_process, nullptr },
+    { biquad_reset, biquad_process, nullptr },
+    { fir_reset, fir_process, nullptr },
+    { fft_reset, fft_process, nullptr },
+    { oscillator_reset, oscillator_process, nullptr },
+    { fdn_reset, fdn_process, nullptr },
+    { waveshaper_reset, waveshaper_process, nullptr },
+    { synth_reset, synth_process, synth_event },
+};
+
+}
+
+const Kernel* get_kernel(int id) {
+    if (id < 0 || id >= WASM_KERNEL_COUNT) return nullptr;
+    return &kernels[id];
+}
+
+// The FFT filter and the waveshaper work relative to Nyquist, and the FDN's
+// delays are in samples, so they have nothing to redesign
+void set_kernels_sample_rate(float rate) {
+    // Sounding voices keep their pitch
+    const float ratio = sample_rate / rate;
+    for (int ch = 0; ch < WASM_MODULE_MAX_CHANNELS; ch++) {
+        for (int v = 0; v < synth_voices; v++) synth_state[ch][v].increment *= ratio;
+    }
+
+    sample_rate = rate;
+    biquad_design();
+    fir_design();
+    oscillator_design();
+    synth_design();
+}
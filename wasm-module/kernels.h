@@ -0,0 +1,21 @@
+#pragma once
+
+#include "module_abi.h"
+
+// A benchmark kernel processes one channel of a block at a time. Kernels
+// keep their own per-channel state in static arrays, so nothing allocates
+typedef struct {
+    void (*reset)(void);  // Set up coefficients and clear all channel state
+    void (*process)(int channel, const float* input, float* output, int num_samples);
+
+    // Take a MIDI event between process calls, at the sample it is due; NULL
+    // for kernels that ignore events. Every channel gets every event
+    void (*event)(int channel, const WasmMidiEvent* event);
+} Kernel;
+
+// Kernel for a WasmModuleKernel id, or NULL if the id is out of range
+const Kernel* get_kernel(int id);
+
+// Redesign every kernel's rate-dependent coefficients for rate Hz, keeping
+// their state. Kernels start at WASM_MODULE_DEFAULT_SAMPLE_RATE
+void set_kernels_sample_rate(float rate);
@@ -1,7 +1,216 @@
+#include "module_abi.h"
+#include "kernels.h"
+#include <math.h>
+#include <stdint.h>
+
+// Built twice: plain, and with -msimd128 for the SIMD variant (see kernels.cpp)
+
 extern "C" {
 
-float get_sample(float input) {
-    return input * 0.2f;
+// Stack bounds defined by the linker; the stack grows down from high to low
+extern char __stack_low;
+extern char __stack_high;
+
+// I/O buffers live in linear memory so the host can write input and read
+// output directly without a call per sample
+static float input_buffer[WASM_MODULE_MAX_CHANNELS][WASM_MODULE_MAX_BLOCK_SIZE];
+static float output_buffer[WASM_MODULE_MAX_CHANNELS][WASM_MODULE_MAX_BLOCK_SIZE];
+static int num_channels = 1;
+
+static int kernel_id = WASM_KERNEL_GAIN;
+static const Kernel* kernel = get_kernel(WASM_KERNEL_GAIN);
+
+// Written by the host; see WasmModuleParam
+static float param_block[WASM_MODULE_MAX_PARAMS] = { 0.0f, 1.0f, 20000.0f };
+
+// Parameter values the coefficients below were derived from, so they are
+// only recomputed when the host changes something
+static float applied_params[WASM_PARAM_COUNT] = { 0.0f, 1.0f, 20000.0f };
+static float output_gain = 1.0f;
+static float mix = 1.0f;
+static float tone_coeff = 1.0f;  // 1 = filter off
+static bool params_neutral = true;
+static float tone_state[WASM_MODULE_MAX_CHANNELS];
+static float sample_rate = WASM_MODULE_DEFAULT_SAMPLE_RATE;
+static bool rate_changed = false;  // The coefficients above need redesigning for sample_rate
+
+// Written by the host; see WasmMidiEventQueue
+static WasmMidiEventQueue event_queue;
+static int due_offsets[WASM_MODULE_MAX_EVENTS];  // Per call, relative to its first sample
+
+// Events due within the next num_samples: how many follow the queue's next
+// one, with their offsets made relative to this call, non-decreasing and in
+// range
+static int due_events(int num_samples) {
+    if (event_queue.count <= 0) return 0;
+    if (event_queue.next < 0) event_queue.next = 0;
+    if (event_queue.count > WASM_MODULE_MAX_EVENTS) event_queue.count = WASM_MODULE_MAX_EVENTS;
+
+    int due = 0;
+    int previous = 0;
+    for (int i = event_queue.next; i < event_queue.count; i++) {
+        int offset = event_queue.events[i].sample_offset - event_queue.elapsed;
+        if (offset >= num_samples) break;
+        due_offsets[due++] = previous = offset > previous ? offset : previous;
+    }
+    return due;
+}
+
+// Mark the delivered events consumed and move the queue's clock on
+static void advance_events(int delivered, int num_samples) {
+    event_queue.next += delivered;
+    event_queue.elapsed += num_samples;
+    if (event_queue.next >= event_queue.count) event_queue.count = event_queue.next = event_queue.elapsed = 0;
+}
+
+// Run the kernel over one channel, handing it each due event at its sample
+static void process_channel(int channel, const float* input, float* output, int num_samples, int num_events) {
+    if (!kernel->event || num_events == 0) {
+        kernel->process(channel, input, output, num_samples);
+        return;
+    }
+
+    int start = 0;
+    for (int e = 0; e < num_events; e++) {
+        if (due_offsets[e] > start) {
+            kernel->process(channel, input + start, output + start, due_offsets[e] - start);
+            start = due_offsets[e];
+        }
+        kernel->event(channel, &event_queue.events[event_queue.next + e]);
+    }
+    if (start < num_samples) kernel->process(channel, input + start, output + start, num_samples - start);
+}
+
+static void update_params(void) {
+    bool changed = false;
+    for (int i = 0; i < WASM_PARAM_COUNT; i++) {
+        changed |= param_block[i] != applied_params[i];
+        applied_params[i] = param_block[i];
+    }
+    if (!changed && !rate_changed) return;
+
+    rate_changed = false;
+    output_gain = powf(10.0f, applied_params[WASM_PARAM_GAIN] / 20.0f);
+    mix = fminf(fmaxf(applied_params[WASM_PARAM_MIX], 0.0f), 1.0f);
+    float cutoff = applied_params[WASM_PARAM_TONE];
+    tone_coeff = cutoff >= 20000.0f ? 1.0f
+                                    : 1.0f - expf(-2.0f * 3.14159265f * fmaxf(cutoff, 1.0f) / sample_rate);
+    params_neutral = output_gain == 1.0f && mix == 1.0f && tone_coeff == 1.0f;
+}
+
+// Mix the kernel's output with the dry input, filter and scale it in place
+static void apply_params(int channel, const float* dry, float* wet, int num_samples) {
+    if (params_neutral) return;
+
+    float state = tone_state[channel];
+    for (int i = 0; i < num_samples; i++) {
+        float y = mix * wet[i] + (1.0f - mix) * dry[i];
+        state += tone_coeff * (y - state);
+        wet[i] = state * output_gain;
+    }
+    tone_state[channel] = state;
+}
+
+// Events due on the sample frame get_sample is in, found by its first channel
+static int frame_events;
+
+float get_sample(int channel, float input) {
+    if (channel < 0 || channel >= num_channels) channel = 0;
+
+    // A frame runs from channel 0 to the last channel; it takes parameter
+    // changes and delivers events once, like a one-sample process_block
+    if (channel == 0) {
+        update_params();
+        frame_events = due_events(1);
+    }
+
+    // Keep the original call-overhead measurement free of the dispatch
+    if (kernel_id == WASM_KERNEL_GAIN && params_neutral && event_queue.count == 0) return input * 0.2f;
+
+    float output;
+    process_channel(channel, &input, &output, 1, frame_events);
+    apply_params(channel, &input, &output, 1);
+    if (channel == num_channels - 1 && event_queue.count > 0) advance_events(frame_events, 1);
+    return output;
+}
+
+float* get_input_buffer(int channel) {
+    return input_buffer[channel];
+}
+
+float* get_output_buffer(int channel) {
+    return output_buffer[channel];
+}
+
+float* get_param_buffer(int param) {
+    if (param < 0 || param >= WASM_MODULE_MAX_PARAMS) param = 0;
+    return &param_block[param];
+}
+
+WasmMidiEventQueue* get_event_buffer(int) {
+    return &event_queue;
+}
+
+int set_num_channels(int channels) {
+    if (channels < 1) channels = 1;
+    if (channels > WASM_MODULE_MAX_CHANNELS) channels = WASM_MODULE_MAX_CHANNELS;
+    num_channels = channels;
+    return num_channels;
 }
 
-}
\ No newline at end of file
+int set_kernel(int id) {
+    const Kernel* selected = get_kernel(id);
+    if (!selected) return -1;
+
+    selected->reset();
+    kernel = selected;
+    kernel_id = id;
+    for (int ch = 0; ch < WASM_MODULE_MAX_CHANNELS; ch++) tone_state[ch] = 0.0f;
+    event_queue.count = event_queue.next = event_queue.elapsed = 0;
+    return kernel_id;
+}
+
+int set_sample_rate(int rate) {
+    if (rate < WASM_MODULE_MIN_SAMPLE_RATE || rate > WASM_MODULE_MAX_SAMPLE_RATE) return -1;
+    if ((float)rate == sample_rate) return rate;
+
+    sample_rate = (float)rate;
+    set_kernels_sample_rate(sample_rate);
+    rate_changed = true;  // The tone filter follows at the next call
+    return rate;
+}
+
+int memory_info(int query) {
+    uintptr_t low = (uintptr_t)&__stack_low;
+    uintptr_t high = (uintptr_t)&__stack_high;
+    switch (query) {
+        case WASM_MEMORY_STACK_SIZE:
+            return (int)(high - low);
+
+        case WASM_MEMORY_STACK_HIGH_WATER: {
+            // Linear memory starts zeroed, so the lowest non-zero word marks
+            // the deepest the stack has reached. A frame that only ever
+            // stored zeros at its bottom reads a few bytes short
+            volatile char marker = 0;
+            const volatile uint32_t* word = (const volatile uint32_t*)low;
+            const volatile uint32_t* current = (const volatile uint32_t*)&marker;
+            while (word < current && *word == 0) word++;
+            return (int)(high - (uintptr_t)word);
+        }
+    }
+    return -1;
+}
+
+int process_block(int num_samples) {
+    if (num_samples > WASM_MODULE_MAX_BLOCK_SIZE) num_samples = WASM_MODULE_MAX_BLOCK_SIZE;
+    update_params();
+    int num_events = due_events(num_samples);
+    for (int ch = 0; ch < num_channels; ch++) {
+        process_channel(ch, input_buffer[ch], output_buffer[ch], num_samples, num_events);
+        apply_params(ch, input_buffer[ch], output_buffer[ch], num_samples);
+    }
+    if (event_queue.count > 0) advance_events(num_events, num_samples);
+    return num_samples;
+}
+
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h>
+
+// Block ABI shared between the wasm module and the host-side engine wrappers.
+//
+// The module keeps planar float I/O buffers in its linear memory and exports:
+//   float* get_input_buffer(int channel)   - guest address of an input buffer
+//   float* get_output_buffer(int channel)  - guest address of an output buffer
+//   int    set_num_channels(int channels)  - sets how many channels
+//                                            process_block handles (default 1),
+//                                            returns the clamped count
+//   int    process_block(int num_samples)  - processes input into output for
+//                                            each channel independently,
+//                                            returns the samples processed
+//   int    set_kernel(int kernel)          - selects the DSP kernel (below)
+//                                            and clears its state; returns
+//                                            the kernel, or -1 if unknown
+//   int    memory_info(int query)          - answers a WasmModuleMemoryQuery
+//                                            (below) in bytes, or -1
+//   float* get_param_buffer(int param)     - guest address of a parameter's
+//                                            slot in the parameter block
+//                                            (below); slots are consecutive
+//   WasmMidiEventQueue* get_event_buffer(int unused)
+//                                          - guest address of the MIDI event
+//                                            queue (below)
+//   int    set_sample_rate(int rate)       - sets the rate in Hz the kernels'
+//                                            coefficients and the tone
+//                                            parameter are designed for,
+//                                            keeping their state; returns
+//                                            the rate, or -1 if out of range
+// The host resolves the buffer addresses once after instantiation, copies a
+// block of input into guest memory, makes a single call and copies the output
+// back out. The channel count only changes with the host's bus layout, so it
+// is set by its own call instead of being passed on every block; all exports
+// other than get_sample take and return i32. get_sample(int channel, float)
+// remains exported for the per-sample path and runs the selected kernel on
+// one sample of that channel. The host calls it sample-outer, channel 0
+// through set_num_channels' count - 1 for each sample frame; the frame's
+// parameters and MIDI events are taken when channel 0 starts it.
+
+// Largest block the host may pass to process_block in one call
+#define WASM_MODULE_MAX_BLOCK_SIZE 4096
+
+// Number of planar I/O channels in the module
+#define WASM_MODULE_MAX_CHANNELS 16
+
+// Entries in the parameter block
+#define WASM_MODULE_MAX_PARAMS 16
+
+// Events the MIDI event queue holds
+#define WASM_MODULE_MAX_EVENTS 512
+
+// Rate the module runs at until set_sample_rate, and the range it accepts:
+// up to 192 kHz at 16x oversampling
+#define WASM_MODULE_DEFAULT_SAMPLE_RATE 48000
+#define WASM_MODULE_MIN_SAMPLE_RATE 8000
+#define WASM_MODULE_MAX_SAMPLE_RATE 3072000
+
+// Benchmark kernels selectable with set_kernel. Every kernel keeps separate
+// state per channel
+typedef enum {
+    WASM_KERNEL_GAIN = 0,         // Multiply by a constant; call overhead only
+    WASM_KERNEL_BIQUAD,           // Cascade of biquad sections
+    WASM_KERNEL_FIR,              // Long FIR convolution
+    WASM_KERNEL_FFT,              // Radix-2 FFT filter on whole frames
+    WASM_KERNEL_OSCILLATOR_BANK,  // Bank of wavetable oscillators
+    WASM_KERNEL_FDN_REVERB,       // Feedback delay network reverb
+    WASM_KERNEL_WAVESHAPER,       // Nonlinear waveshaper at 4x oversampling
+    WASM_KERNEL_SYNTH,            // Polyphonic synth played by MIDI events; ignores its input
+    WASM_KERNEL_COUNT
+} WasmModuleKernel;
+
+// Parameters in the parameter block, a float[WASM_MODULE_MAX_PARAMS] in
+// linear memory the host writes directly. The module reads it at the start
+// of every process_block call and get_sample frame, so a value written
+// between them applies from the next one's first sample; a host that wants a
+// change to land mid-block splits the block there. The parameters act on
+// the kernel's output, whichever kernel is selected
+typedef enum {
+    WASM_PARAM_GAIN = 0,  // Output gain in dB (default 0)
+    WASM_PARAM_MIX,       // Dry/wet mix from 0 (input) to 1 (kernel output, default)
+    WASM_PARAM_TONE,      // One-pole low-pass cutoff in Hz; off at 20000 and above (default)
+    WASM_PARAM_COUNT
+} WasmModuleParam;
+
+// Questions memory_info answers about the module's own stack, which lives in
+// its linear memory, so the answers don't depend on the engine running it
+typedef enum {
+    WASM_MEMORY_STACK_SIZE = 0,    // Bytes reserved for the stack at link time
+    WASM_MEMORY_STACK_HIGH_WATER   // Deepest the stack has been since instantiation
+} WasmModuleMemoryQuery;
+
+// A MIDI channel message at a sample offset from the start of the next
+// process_block call or get_sample frame. Single-byte and system messages
+// are not delivered
+typedef struct {
+    int32_t sample_offset;
+    uint8_t status;  // Message type in the high nibble, MIDI channel in the low
+    uint8_t data1;
+    uint8_t data2;
+    uint8_t reserved;
+} WasmMidiEvent;
+
+// Events waiting for the kernel, sorted by sample_offset. The host fills it
+// once per block: the events, then count, with next and elapsed set to 0,
+// replacing whatever is still queued. Each process_block(n) call (or frame
+// of get_sample calls, with n = 1) hands the kernel the events due within
+// its n samples, each at its sample, and advances next and elapsed; so a
+// host that splits a block into several calls still writes the queue only
+// once. Kernels that don't take events drop them
+typedef struct {
+    int32_t count;
+    int32_t next;     // First event not yet delivered
+    int32_t elapsed;  // Samples processed since the host wrote the queue
+    int32_t reserved;
+    WasmMidiEvent events[WASM_MODULE_MAX_EVENTS];
+} WasmMidiEventQueue;